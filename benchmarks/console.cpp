@@ -0,0 +1,55 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/stdioFeature.h>
+#include <jac/features/util/bufferedWritable.h>
+#include <jac/features/util/ostreamjs.h>
+#include <jac/machine/machine.h>
+
+#include <unistd.h>
+
+
+// Measures the throughput of console.log with unbuffered and buffered stdout.
+// The log lines are written to stdout, the results to stderr.
+//
+// usage: consoleBenchmark [lines=1000000] > /dev/null
+
+
+using Machine = jac::ComposeMachine<
+    jac::MachineBase,
+    jac::BasicStreamFeature,
+    jac::StdioFeature
+>;
+
+
+void run(const std::string& name, std::unique_ptr<jac::Writable> out, int lines) {
+    Machine machine;
+    machine.stdio.out = std::move(out);
+    machine.stdio.err = std::make_unique<jac::OsWritable>(std::cerr);
+    machine.initialize();
+
+    std::string code = R"(
+        for (let i = 0; i < )" + std::to_string(lines) + R"(; i++) {
+            console.log("log line number " + i);
+        }
+    )";
+
+    auto start = std::chrono::steady_clock::now();
+    machine.eval(code, "console.js", jac::EvalFlags::Global);
+    machine.stdio.out->flush();
+    auto duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    std::cerr << name << ": " << duration.count() << " s, " << lines / duration.count() << " lines/s" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+    int lines = argc > 1 ? std::stoi(argv[1]) : 1000000;
+
+    run("std::cout", std::make_unique<jac::OsWritable>(std::cout), lines);
+    run("unbuffered fd", std::make_unique<jac::BufferedWritable>(STDOUT_FILENO, 0, std::chrono::milliseconds(0)), lines);
+    run("buffered fd", std::make_unique<jac::BufferedWritable>(STDOUT_FILENO), lines);
+}
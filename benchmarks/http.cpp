@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/httpFeature.h>
+#include <jac/features/ioReactorFeature.h>
+#include <jac/features/netFeature.h>
+#include <jac/features/stdioFeature.h>
+#include <jac/features/util/ostreamjs.h>
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/machine.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+// Measures a loopback HTTP server written in JavaScript with the "http" module
+// using a wrk-style load generator: every keep-alive connection keeps a fixed
+// number of pipelined requests in flight; the clients run on a separate thread
+// with their own epoll loop.
+//
+// usage: httpBenchmark [connections=64] [seconds=5] [pipelining=1]
+
+
+using Machine = jac::ComposeMachine<
+    jac::MachineBase,
+    jac::EventQueueFeature,
+    jac::IoReactorFeature,
+    jac::EventLoopFeature,
+    jac::BasicStreamFeature,
+    jac::StdioFeature,
+    jac::NetFeature,
+    jac::HttpFeature,
+    jac::EventLoopTerminal
+>;
+
+using Clock = std::chrono::steady_clock;
+
+
+const char* stringServer = R"(
+import { serve } from "http";
+const server = serve({ port: 0 }, (request) => "Hello, world!");
+ready(server.port);
+)";
+
+const char* bufferServer = R"(
+import { serve } from "http";
+const body = new Uint8Array(4096).fill(120).buffer;
+const server = serve({ port: 0 }, (request) => ({
+    headers: { "Content-Type": "application/octet-stream" },
+    body
+}));
+ready(server.port);
+)";
+
+const char* asyncServer = R"(
+import { serve } from "http";
+const server = serve({ port: 0 }, async (request) => {
+    await null;
+    return { status: 200, body: request.headers["host"] };
+});
+ready(server.port);
+)";
+
+
+struct Connection {
+    int fd;
+    std::string input;
+    std::deque<Clock::time_point> sent;
+};
+
+
+void raiseFdLimit(int needed) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < static_cast<rlim_t>(needed)) {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, static_cast<rlim_t>(needed));
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+
+// returns the length of the first complete response in the input, or 0
+size_t responseLength(std::string_view input) {
+    size_t headEnd = input.find("\r\n\r\n");
+    if (headEnd == std::string_view::npos) {
+        return 0;
+    }
+    std::string_view head = input.substr(0, headEnd);
+    size_t pos = head.find("Content-Length: ");
+    if (pos == std::string_view::npos) {
+        std::cerr << "response without Content-Length" << std::endl;
+        std::exit(1);
+    }
+    size_t length = std::stoul(std::string(head.substr(pos + 16, head.find("\r\n", pos) - pos - 16)));
+    size_t total = headEnd + 4 + length;
+    return input.size() >= total ? total : 0;
+}
+
+
+void run(const std::string& name, const char* code, int connections, int seconds, int pipelining) {
+    Machine machine;
+    machine.stdio.out = std::make_unique<jac::OsWritable>(std::cout);
+    machine.stdio.err = std::make_unique<jac::OsWritable>(std::cerr);
+    machine.initialize();
+
+    std::promise<int> portPromise;
+    jac::FunctionFactory ff(machine.context());
+    machine.context().getGlobalObject().set("ready", ff.newFunction([&](int port) {
+        portPromise.set_value(port);
+    }));
+
+    std::thread server([&]() {
+        machine.evalModuleWithEventLoop(code, "server.js");
+    });
+    int port = portPromise.get_future().get();
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int epollFd = epoll_create1(0);
+    std::vector<Connection> clients(static_cast<size_t>(connections));
+    const std::string request = "GET /bench HTTP/1.1\r\nHost: localhost\r\nUser-Agent: httpBenchmark\r\n\r\n";
+    std::string batch;
+    for (int i = 0; i < pipelining; i++) {
+        batch += request;
+    }
+    std::vector<char> buffer(256 * 1024);
+
+    for (size_t i = 0; i < clients.size(); i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::cerr << name << ": cannot connect: " << std::strerror(errno) << std::endl;
+            std::exit(1);
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        clients[i].fd = fd;
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(1 << 22);
+    size_t bytes = 0;
+
+    auto start = Clock::now();
+    auto end = start + std::chrono::seconds(seconds);
+    for (auto& client : clients) {
+        client.sent.assign(static_cast<size_t>(pipelining), Clock::now());
+        send(client.fd, batch.data(), batch.size(), 0);
+    }
+
+    std::vector<epoll_event> events(1024);
+    while (true) {
+        auto now = Clock::now();
+        if (now >= end) {
+            break;
+        }
+        int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < count; i++) {
+            Connection& client = clients[events[static_cast<size_t>(i)].data.u64];
+            ssize_t size = recv(client.fd, buffer.data(), buffer.size(), 0);
+            if (size <= 0) {
+                std::cerr << name << ": connection closed" << std::endl;
+                std::exit(1);
+            }
+            client.input.append(buffer.data(), static_cast<size_t>(size));
+            bytes += static_cast<size_t>(size);
+
+            // every completed response is replaced with a new request to keep the pipeline full
+            size_t consumed = 0;
+            size_t completed = 0;
+            auto received = Clock::now();
+            while (size_t length = responseLength(std::string_view(client.input).substr(consumed))) {
+                consumed += length;
+                completed++;
+                latencies.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(received - client.sent.front()).count()));
+                client.sent.pop_front();
+                client.sent.push_back(received);
+            }
+            client.input.erase(0, consumed);
+            if (completed > 0) {
+                send(client.fd, batch.data(), request.size() * completed, 0);
+            }
+        }
+    }
+    auto duration = std::chrono::duration<double>(Clock::now() - start);
+
+    for (auto& client : clients) {
+        close(client.fd);
+    }
+    close(epollFd);
+    machine.scheduleEvent([&]() { machine.exit(0); });
+    server.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0 : latencies[static_cast<size_t>(p * static_cast<double>(latencies.size() - 1))];
+    };
+    std::cout << name << ": " << connections << " connections, pipelining " << pipelining << ", "
+              << static_cast<double>(latencies.size()) / duration.count() << " requests/s, "
+              << static_cast<double>(bytes) / duration.count() / (1024 * 1024) << " MiB/s, "
+              << "p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+    int connections = argc > 1 ? std::stoi(argv[1]) : 64;
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+    int pipelining = argc > 3 ? std::stoi(argv[3]) : 1;
+
+    raiseFdLimit(2 * connections + 64);
+
+    run("string", stringServer, connections, seconds, pipelining);
+    run("array buffer", bufferServer, connections, seconds, pipelining);
+    run("async", asyncServer, connections, seconds, pipelining);
+}
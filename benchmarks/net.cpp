@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/ioReactorFeature.h>
+#include <jac/features/netFeature.h>
+#include <jac/features/stdioFeature.h>
+#include <jac/features/util/ostreamjs.h>
+#include <jac/features/util/socket.h>
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/machine.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+// Measures a loopback echo server written in JavaScript with the "net" module.
+// Every connection sends a message, waits for the echo and repeats; the
+// clients run on a separate thread with their own epoll loop.
+//
+// usage: netBenchmark [connections=1000] [seconds=5] [messageSize=64]
+
+
+using Machine = jac::ComposeMachine<
+    jac::MachineBase,
+    jac::EventQueueFeature,
+    jac::IoReactorFeature,
+    jac::EventLoopFeature,
+    jac::BasicStreamFeature,
+    jac::StdioFeature,
+    jac::NetFeature,
+    jac::EventLoopTerminal
+>;
+
+using Clock = std::chrono::steady_clock;
+
+
+const char* jsEcho = R"(
+import { listen } from "net";
+const server = listen({ port: 0 }, async (socket) => {
+    for await (const chunk of socket.readable) {
+        if (!socket.writable.write(chunk)) {
+            await socket.writable.drain();
+        }
+    }
+    socket.close();
+});
+ready(server.port);
+)";
+
+const char* pipeEcho = R"(
+import { listen } from "net";
+const server = listen({ port: 0 }, async (socket) => {
+    await socket.readable.pipe(socket.writable);
+    socket.close();
+});
+ready(server.port);
+)";
+
+
+struct Connection {
+    int fd;
+    size_t received = 0;
+    Clock::time_point sent;
+};
+
+
+void raiseFdLimit(int needed) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < static_cast<rlim_t>(needed)) {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, static_cast<rlim_t>(needed));
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+
+void run(const std::string& name, const char* code, int connections, int seconds, size_t messageSize) {
+    Machine machine;
+    machine.stdio.out = std::make_unique<jac::OsWritable>(std::cout);
+    machine.stdio.err = std::make_unique<jac::OsWritable>(std::cerr);
+    machine.initialize();
+
+    std::promise<int> portPromise;
+    jac::FunctionFactory ff(machine.context());
+    machine.context().getGlobalObject().set("ready", ff.newFunction([&](int port) {
+        portPromise.set_value(port);
+    }));
+
+    std::thread server([&]() {
+        machine.evalModuleWithEventLoop(code, "server.js");
+    });
+    int port = portPromise.get_future().get();
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int epollFd = epoll_create1(0);
+    std::vector<Connection> clients(static_cast<size_t>(connections));
+    std::string message(messageSize, 'x');
+    std::vector<char> buffer(64 * 1024);
+
+    for (size_t i = 0; i < clients.size(); i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::cerr << name << ": cannot connect: " << std::strerror(errno) << std::endl;
+            std::exit(1);
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        clients[i].fd = fd;
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = i;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(1 << 22);
+
+    auto start = Clock::now();
+    auto end = start + std::chrono::seconds(seconds);
+    for (auto& client : clients) {
+        client.sent = Clock::now();
+        send(client.fd, message.data(), message.size(), 0);
+    }
+
+    std::vector<epoll_event> events(1024);
+    while (true) {
+        auto now = Clock::now();
+        if (now >= end) {
+            break;
+        }
+        int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), 100);
+        for (int i = 0; i < count; i++) {
+            Connection& client = clients[events[static_cast<size_t>(i)].data.u64];
+            ssize_t size = recv(client.fd, buffer.data(), buffer.size(), 0);
+            if (size <= 0) {
+                std::cerr << name << ": connection closed" << std::endl;
+                std::exit(1);
+            }
+            client.received += static_cast<size_t>(size);
+            if (client.received < messageSize) {
+                continue;
+            }
+
+            auto received = Clock::now();
+            latencies.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(received - client.sent).count()));
+            client.received = 0;
+            client.sent = received;
+            send(client.fd, message.data(), message.size(), 0);
+        }
+    }
+    auto duration = std::chrono::duration<double>(Clock::now() - start);
+
+    for (auto& client : clients) {
+        close(client.fd);
+    }
+    close(epollFd);
+    machine.scheduleEvent([&]() { machine.exit(0); });
+    server.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0 : latencies[static_cast<size_t>(p * static_cast<double>(latencies.size() - 1))];
+    };
+    std::cout << name << ": " << connections << " connections, "
+              << static_cast<double>(latencies.size()) / duration.count() << " msgs/s, "
+              << "p50 " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+    int connections = argc > 1 ? std::stoi(argv[1]) : 1000;
+    int seconds = argc > 2 ? std::stoi(argv[2]) : 5;
+    size_t messageSize = argc > 3 ? std::stoul(argv[3]) : 64;
+
+    raiseFdLimit(2 * connections + 64);
+
+    run("js echo", jsEcho, connections, seconds, messageSize);
+    run("native pipe", pipeEcho, connections, seconds, messageSize);
+}
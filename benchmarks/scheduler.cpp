@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/features/util/scheduler.h>
+#include <jac/machine/machine.h>
+
+#include <unistd.h>
+
+
+// Compares many mostly idle machines run by MachineScheduler with
+// a thread per machine blocked in runEventLoop.
+//
+// usage: schedulerBenchmark [machines=10000] [workers=hardware concurrency] [samples=1000]
+
+
+using Machine = jac::ComposeMachine<
+    jac::MachineBase,
+    jac::EventQueueFeature,
+    jac::EventLoopFeature,
+    jac::TimersFeature,
+    jac::EventLoopTerminal
+>;
+
+const char* code = R"(
+let ticks = 0;
+setInterval(() => { ticks++; }, 1000);
+)";
+
+
+using Clock = std::chrono::steady_clock;
+
+long residentKiB() {
+    std::ifstream statm("/proc/self/statm");
+    long size = 0;
+    long resident = 0;
+    statm >> size >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+std::vector<std::unique_ptr<Machine>> createMachines(int count) {
+    std::vector<std::unique_ptr<Machine>> machines;
+    machines.reserve(count);
+    for (int i = 0; i < count; i++) {
+        auto machine = std::make_unique<Machine>();
+        machine->initialize();
+        machine->eval(code, "idle.js", jac::EvalFlags::Global);
+        machines.push_back(std::move(machine));
+    }
+    return machines;
+}
+
+// measures the time from scheduling an event into an idle machine until it is dispatched
+void measureLatency(std::vector<std::unique_ptr<Machine>>& machines, int samples) {
+    std::vector<double> latencies;
+    latencies.reserve(samples);
+
+    for (int i = 0; i < samples; i++) {
+        Machine& machine = *machines[(i * 7919) % machines.size()];
+        std::atomic<bool> done = false;
+        Clock::time_point dispatched;
+
+        auto start = Clock::now();
+        machine.scheduleEvent([&done, &dispatched]() {
+            dispatched = Clock::now();
+            done = true;
+        });
+        while (!done) {
+            std::this_thread::yield();
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(dispatched - start).count());
+
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+    std::cout << "  latency p50: " << percentile(0.5) << " us, p99: " << percentile(0.99)
+              << " us, max: " << latencies.back() << " us" << std::endl;
+}
+
+void runScheduler(int count, unsigned workers, int samples) {
+    std::cout << "MachineScheduler (" << count << " machines, " << workers << " workers)" << std::endl;
+    long base = residentKiB();
+
+    auto machines = createMachines(count);
+    {
+        jac::MachineScheduler scheduler(workers);
+        for (auto& machine : machines) {
+            scheduler.add(*machine);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::cout << "  memory: " << (residentKiB() - base) / 1024 << " MiB, threads: " << workers + 1 << std::endl;
+        measureLatency(machines, samples);
+
+        for (auto& machine : machines) {
+            machine->kill();
+        }
+        scheduler.waitAll();
+    }
+}
+
+void runThreads(int count, int samples) {
+    std::cout << "Thread per machine (" << count << " machines)" << std::endl;
+    long base = residentKiB();
+
+    auto machines = createMachines(count);
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    for (auto& machine : machines) {
+        threads.emplace_back([&machine]() {
+            JS_UpdateStackTop(machine->runtime());
+            machine->runEventLoop();
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    std::cout << "  memory: " << (residentKiB() - base) / 1024 << " MiB, threads: " << count << std::endl;
+    measureLatency(machines, samples);
+
+    for (auto& machine : machines) {
+        machine->kill();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? std::stoi(argv[1]) : 10000;
+    unsigned workers = argc > 2 ? std::stoi(argv[2]) : std::thread::hardware_concurrency();
+    int samples = argc > 3 ? std::stoi(argv[3]) : 1000;
+
+    runScheduler(count, workers, samples);
+    runThreads(count, samples);
+}
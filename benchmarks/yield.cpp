@@ -0,0 +1,56 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/machine/machine.h>
+
+
+// Measures the cost of yielding to the event loop using different primitives.
+//
+// usage: yieldBenchmark [iterations=100000]
+
+
+using Machine = jac::ComposeMachine<
+    jac::MachineBase,
+    jac::EventQueueFeature,
+    jac::EventLoopFeature,
+    jac::TimersFeature,
+    jac::EventLoopTerminal
+>;
+
+
+void run(const std::string& name, const std::string& yield, int iterations) {
+    Machine machine;
+    machine.initialize();
+
+    std::string code = R"(
+        let count = 0;
+        function step() {
+            if (++count < )" + std::to_string(iterations) + R"() {
+                )" + yield + R"(;
+            }
+            else {
+                exit(0);
+            }
+        }
+        step();
+    )";
+
+    auto start = std::chrono::steady_clock::now();
+    machine.evalModuleWithEventLoop(code, "yield.js");
+    auto duration = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+
+    std::cout << name << ": " << duration.count() / iterations << " us per yield" << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 100000;
+
+    run("setTimeout(0)", "setTimeout(step, 0)", iterations);
+    run("setImmediate", "setImmediate(step)", iterations);
+    run("queueMicrotask", "queueMicrotask(step)", iterations);
+}
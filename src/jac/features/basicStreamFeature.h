@@ -5,21 +5,127 @@
 #include <jac/machine/machine.h>
 #include <jac/machine/values.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "types/streams.h"
+#include "util/streamTransforms.h"
 
 namespace jac {
 
 
+/**
+ * @brief Get the memory of an ArrayBuffer or a typed array
+ *
+ * @param ctx context to work in
+ * @param data the ArrayBuffer or typed array
+ * @return The memory of the buffer or std::nullopt if the value is not a buffer
+ */
+inline std::optional<std::span<uint8_t>> bufferData(ContextRef ctx, ValueWeak data) {
+    size_t size;
+    uint8_t* ptr = JS_GetArrayBuffer(ctx, &size, data.getVal());
+    if (ptr) {
+        return std::span<uint8_t>(ptr, size);
+    }
+    JS_FreeValue(ctx, JS_GetException(ctx));
+
+    size_t offset;
+    size_t length;
+    JSValue buffer = JS_GetTypedArrayBuffer(ctx, data.getVal(), &offset, &length, nullptr);
+    if (JS_IsException(buffer)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        return std::nullopt;
+    }
+    ptr = JS_GetArrayBuffer(ctx, &size, buffer);
+    JS_FreeValue(ctx, buffer);
+    if (!ptr) {
+        throw Exception::create(Exception::Type::TypeError, "Detached ArrayBuffer");
+    }
+    return std::span<uint8_t>(ptr + offset, length);
+}
+
+
 struct WritableProtoBuilder : public ProtoBuilder::Opaque<Writable>, public ProtoBuilder::Properties {
     static void addProperties(ContextRef ctx, Object proto) {
-        addMethodMember<void(Writable::*)(std::string), &Writable::write>(ctx, proto, "write");
+        FunctionFactory ff(ctx);
+
+        // returns false when the producer should wait for drain() before writing more
+        proto.defineProperty("write", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self, ValueWeak data) {
+            Writable& self_ = *WritableProtoBuilder::getOpaque(ctx_, self);
+
+            if (JS_IsString(data.getVal())) {
+                self_.write(data.to<std::string>());
+            }
+            // ArrayBuffer and views of it are written directly from their memory
+            else if (auto span = bufferData(ctx_, data)) {
+                self_.write(std::span<const uint8_t>(*span));
+            }
+            else {
+                self_.write(data.to<std::string>());
+            }
+            return !self_.needsDrain();
+        }));
+
+        proto.defineProperty("drain", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self) {
+            Writable& self_ = *WritableProtoBuilder::getOpaque(ctx_, self);
+            auto [promise, resolve, reject] = Promise::create(ctx_);
+
+            self_.onDrain([resolve_ = resolve]() mutable {
+                resolve_.call<void>();
+            });
+
+            return promise;
+        }));
+
+        proto.defineProperty("setHighWaterMark", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self, int bytes) {
+            if (bytes < 0) {
+                throw Exception::create(Exception::Type::RangeError, "highWaterMark must not be negative");
+            }
+            WritableProtoBuilder::getOpaque(ctx_, self)->setHighWaterMark(static_cast<size_t>(bytes));
+        }));
     }
 };
 
 
 struct ReadableProtoBuilder : public ProtoBuilder::Opaque<Readable>, public ProtoBuilder::Properties {
+    static void rejectWith(Function& reject, std::exception_ptr error) {
+        try {
+            std::rethrow_exception(error);
+        }
+        catch (Exception& e) {
+            reject.call<void>(e);
+        }
+        catch (std::exception& e) {
+            reject.call<void>(Exception::create(Exception::Type::Error, e.what()));
+        }
+        catch (...) {
+            reject.call<void>(Exception::create(Exception::Type::Error, "Unknown error"));
+        }
+    }
+
+    // the end of the stream resolves a read with the result, unless the stream ended with an error
+    static void settleEnd(ContextRef ctx, ValueWeak stream, Function& resolve, Function& reject, Value result) {
+        if (auto error = getOpaque(ctx, stream)->error()) {
+            rejectWith(reject, error);
+            return;
+        }
+        resolve.call<void>(result);
+    }
+
+    static Value iteratorResult(ContextRef ctx, Value value, bool done) {
+        Object result = Object::create(ctx);
+        result.set("value", value);
+        result.set("done", done);
+        return result;
+    }
+
     static void addProperties(ContextRef ctx, Object proto) {
         FunctionFactory ff(ctx);
 
@@ -27,8 +133,93 @@ struct ReadableProtoBuilder : public ProtoBuilder::Opaque<Readable>, public Prot
             Readable& self_ = *ReadableProtoBuilder::getOpaque(ctx_, self);
             auto [promise, resolve, reject] = Promise::create(ctx_);
 
-            bool res = self_.get([resolve_ = resolve](char data) mutable {
-                resolve_.call<void>(std::string{static_cast<char>(data)});
+            bool res = self_.get([ctx_, stream_ = self.to<Value>(), resolve_ = resolve, reject_ = reject](std::optional<char> data) mutable {
+                if (!data) {
+                    settleEnd(ctx_, stream_, resolve_, reject_, Value::null(ctx_));
+                    return;
+                }
+                resolve_.call<void>(std::string{ *data });
+            });
+
+            if (!res) {
+                reject.call<void>(Exception::create(Exception::Type::Error, "Stream is not readable"));
+            }
+
+            return promise;
+        }));
+
+        proto.defineProperty("read", ff.newFunctionThisVariadic([](ContextRef ctx_, ValueWeak self, std::vector<ValueWeak> args) {
+            Readable& self_ = *ReadableProtoBuilder::getOpaque(ctx_, self);
+            auto [promise, resolve, reject] = Promise::create(ctx_);
+
+            size_t maxBytes = std::numeric_limits<size_t>::max();
+            if (!args.empty() && !args[0].isUndefined()) {
+                int limit = args[0].to<int>();
+                if (limit <= 0) {
+                    throw Exception::create(Exception::Type::RangeError, "maxBytes must be positive");
+                }
+                maxBytes = static_cast<size_t>(limit);
+            }
+
+            bool res = self_.readSome(maxBytes, [ctx_, stream_ = self.to<Value>(), resolve_ = resolve, reject_ = reject](std::optional<std::string> data) mutable {
+                if (!data) {
+                    settleEnd(ctx_, stream_, resolve_, reject_, Value::null(ctx_));
+                    return;
+                }
+                resolve_.call<void>(*data);
+            });
+
+            if (!res) {
+                reject.call<void>(Exception::create(Exception::Type::Error, "Stream is not readable"));
+            }
+
+            return promise;
+        }));
+
+        proto.defineProperty("readInto", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self, ValueWeak buffer) {
+            Readable& self_ = *ReadableProtoBuilder::getOpaque(ctx_, self);
+            auto span = bufferData(ctx_, buffer);
+            if (!span) {
+                throw Exception::create(Exception::Type::TypeError, "Expected an ArrayBuffer or a typed array");
+            }
+            if (span->empty()) {
+                throw Exception::create(Exception::Type::RangeError, "Buffer is empty");
+            }
+            auto [promise, resolve, reject] = Promise::create(ctx_);
+
+            // the buffer is kept alive until the data arrive and its memory is looked up again,
+            // as it may have been detached in the meantime
+            bool res = self_.readSome(span->size(), [ctx_, stream_ = self.to<Value>(), resolve_ = resolve, reject_ = reject, buffer_ = buffer.to<Value>()](std::optional<std::string> data) mutable {
+                if (!data) {
+                    settleEnd(ctx_, stream_, resolve_, reject_, Value::null(ctx_));
+                    return;
+                }
+                auto target = bufferData(ctx_, buffer_);
+                if (!target || target->size() < data->size()) {
+                    reject_.call<void>(Exception::create(Exception::Type::TypeError, "Buffer was detached"));
+                    return;
+                }
+                std::copy(data->begin(), data->end(), target->begin());
+                resolve_.call<void>(static_cast<int>(data->size()));
+            });
+
+            if (!res) {
+                reject.call<void>(Exception::create(Exception::Type::Error, "Stream is not readable"));
+            }
+
+            return promise;
+        }));
+
+        proto.defineProperty("readLine", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self) {
+            Readable& self_ = *ReadableProtoBuilder::getOpaque(ctx_, self);
+            auto [promise, resolve, reject] = Promise::create(ctx_);
+
+            bool res = self_.readLine([ctx_, stream_ = self.to<Value>(), resolve_ = resolve, reject_ = reject](std::optional<std::string> line) mutable {
+                if (!line) {
+                    settleEnd(ctx_, stream_, resolve_, reject_, Value::null(ctx_));
+                    return;
+                }
+                resolve_.call<void>(*line);
             });
 
             if (!res) {
@@ -38,12 +229,16 @@ struct ReadableProtoBuilder : public ProtoBuilder::Opaque<Readable>, public Prot
             return promise;
         }));
 
-        proto.defineProperty("read", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self) {
+        proto.defineProperty("readBytes", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self) {
             Readable& self_ = *ReadableProtoBuilder::getOpaque(ctx_, self);
             auto [promise, resolve, reject] = Promise::create(ctx_);
 
-            bool res = self_.read([resolve_ = resolve](std::string data) mutable {
-                resolve_.call<void>(data);
+            bool res = self_.readBytes([ctx_, stream_ = self.to<Value>(), resolve_ = resolve, reject_ = reject](std::optional<std::vector<uint8_t>> data) mutable {
+                if (!data) {
+                    settleEnd(ctx_, stream_, resolve_, reject_, Value::null(ctx_));
+                    return;
+                }
+                resolve_.call<void>(ArrayBuffer::create(ctx_, std::move(*data)));
             });
 
             if (!res) {
@@ -52,6 +247,54 @@ struct ReadableProtoBuilder : public ProtoBuilder::Opaque<Readable>, public Prot
 
             return promise;
         }));
+
+        // the chunks are moved between the streams in C++, the promise resolves to the number of bytes
+        proto.defineProperty("pipe", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self, ValueWeak destination) {
+            Readable& self_ = *ReadableProtoBuilder::getOpaque(ctx_, self);
+            Writable& destination_ = *WritableProtoBuilder::getOpaque(ctx_, destination);
+            auto [promise, resolve, reject] = Promise::create(ctx_);
+
+            // the stream objects are kept alive until the transfer ends
+            pipeStreams(self_, destination_, [resolve_ = resolve, reject_ = reject, streams = std::make_pair(self.to<Value>(), destination.to<Value>())]
+                        (size_t transferred, std::exception_ptr error) mutable {
+                if (!error) {
+                    resolve_.call<void>(static_cast<double>(transferred));
+                    return;
+                }
+                rejectWith(reject_, error);
+            });
+
+            return promise;
+        }));
+
+        // for await (const chunk of stream) yields the chunks until the end of the stream
+        Value asyncIterator = ctx.getGlobalObject().get<Object>("Symbol").get<Value>("asyncIterator");
+        Atom asyncIteratorAtom(ctx, JS_ValueToAtom(ctx, asyncIterator.getVal()));
+        proto.defineProperty(asyncIteratorAtom, ff.newFunctionThis([](ContextRef ctx_, ValueWeak self) {
+            FunctionFactory ff_(ctx_);
+            Object iterator = Object::create(ctx_);
+            iterator.set("stream", self.to<Value>());
+            iterator.set("next", ff_.newFunctionThis([](ContextRef ctx__, ValueWeak iter) {
+                Value stream = iter.to<Object>().get<Value>("stream");
+                Readable& self_ = *ReadableProtoBuilder::getOpaque(ctx__, stream);
+                auto [promise, resolve, reject] = Promise::create(ctx__);
+
+                bool res = self_.readSome(std::numeric_limits<size_t>::max(), [ctx__, stream, resolve_ = resolve, reject_ = reject](std::optional<std::string> data) mutable {
+                    if (!data) {
+                        settleEnd(ctx__, stream, resolve_, reject_, iteratorResult(ctx__, Value::undefined(ctx__), true));
+                        return;
+                    }
+                    resolve_.call<void>(iteratorResult(ctx__, Value::from(ctx__, *data), false));
+                });
+
+                if (!res) {
+                    resolve.call<void>(iteratorResult(ctx__, Value::undefined(ctx__), true));
+                }
+
+                return promise;
+            }));
+            return iterator;
+        }));
     }
 };
 
@@ -73,6 +316,58 @@ public:
 
         WritableClass::initContext(this->context());
         ReadableClass::initContext(this->context());
+
+        FunctionFactory ff(this->context());
+        auto& mdl = this->newModule("streams");
+
+        // the transforms reference the underlying stream object, so it is not collected before them
+        auto readableTransform = [](ContextRef ctx, ValueWeak source, auto create) {
+            Readable& source_ = *ReadableProtoBuilder::getOpaque(ctx, source);
+            Object result = ReadableClass::createInstance(ctx, create(source_));
+            result.defineProperty("source", source.to<Value>());
+            return result;
+        };
+
+        mdl.addExport("lines", ff.newFunction([readableTransform, this](ValueWeak source) {
+            return readableTransform(this->context(), source, [](Readable& source_) {
+                return new LineSplitter(source_);
+            });
+        }));
+        mdl.addExport("utf8", ff.newFunction([readableTransform, this](ValueWeak source) {
+            return readableTransform(this->context(), source, [](Readable& source_) {
+                return new Utf8Decoder(source_);
+            });
+        }));
+        mdl.addExport("frames", ff.newFunctionVariadic([readableTransform, this](std::vector<ValueWeak> args) {
+            if (args.empty()) {
+                throw Exception::create(Exception::Type::TypeError, "Expected a Readable");
+            }
+            size_t headerSize = headerSizeArg(args);
+            return readableTransform(this->context(), args[0], [headerSize](Readable& source_) {
+                return new FrameDecoder(source_, headerSize);
+            });
+        }));
+        mdl.addExport("framed", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            if (args.empty()) {
+                throw Exception::create(Exception::Type::TypeError, "Expected a Writable");
+            }
+            Writable& sink = *WritableProtoBuilder::getOpaque(this->context(), args[0]);
+            Object result = WritableClass::createInstance(this->context(), new FrameEncoder(sink, headerSizeArg(args)));
+            result.defineProperty("sink", args[0].to<Value>());
+            return result;
+        }));
+    }
+
+private:
+    static size_t headerSizeArg(std::vector<ValueWeak>& args) {
+        if (args.size() < 2 || args[1].isUndefined()) {
+            return 4;
+        }
+        int size = args[1].to<int>();
+        if (size != 1 && size != 2 && size != 4) {
+            throw Exception::create(Exception::Type::RangeError, "Header size must be 1, 2 or 4");
+        }
+        return static_cast<size_t>(size);
     }
 };
 
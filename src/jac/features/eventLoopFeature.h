@@ -3,11 +3,15 @@
 #include <jac/machine/functionFactory.h>
 #include <jac/machine/machine.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <noal_func.h>
 #include <optional>
 
 #include "eventLoopTerminal.h"
+#include "util/loopMetrics.h"
 
 
 namespace jac {
@@ -18,10 +22,169 @@ namespace jac {
  */
 template<class Next>
 class EventLoopFeature : public Next {
+public:
+    /**
+     * @brief Exit code of a machine killed by the out of memory handler
+     */
+    static constexpr int outOfMemoryExitCode = 137;
+
 private:
     std::atomic<bool> _shouldExit = false;
     int _exitCode = 1;
 
+    std::atomic<uint64_t> _maxJobs = 0;
+    std::atomic<int64_t> _maxJobTimeUs = 0;
+
+    std::atomic<uint64_t> _statJobs = 0;
+    std::atomic<uint64_t> _statDrains = 0;
+    std::atomic<uint64_t> _statBudgetExceeded = 0;
+    std::atomic<uint64_t> _statMaxJobsPerDrain = 0;
+    std::atomic<int64_t> _statMaxDrainUs = 0;
+    std::atomic<int64_t> _statTotalDrainUs = 0;
+
+    static void storeMax(auto& stat, auto value) {
+        auto current = stat.load(std::memory_order_relaxed);
+        while (value > current && !stat.compare_exchange_weak(current, value, std::memory_order_relaxed));
+    }
+
+    void recordDrain(uint64_t jobs, std::chrono::steady_clock::duration duration, bool exceeded) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+
+        _statJobs.fetch_add(jobs, std::memory_order_relaxed);
+        _statDrains.fetch_add(1, std::memory_order_relaxed);
+        _statTotalDrainUs.fetch_add(us, std::memory_order_relaxed);
+        if (exceeded) {
+            _statBudgetExceeded.fetch_add(1, std::memory_order_relaxed);
+        }
+        storeMax(_statMaxJobsPerDrain, jobs);
+        storeMax(_statMaxDrainUs, us);
+
+        if constexpr (HasLoopMetrics<Next>) {
+            this->loopMetrics().jobsPerTurn.record(jobs);
+            this->loopMetrics().busyTime.fetch_add(LoopMetrics::micros(duration), std::memory_order_relaxed);
+        }
+    }
+
+    // binds the calling thread as the consumer of the event queue while the loop runs on it,
+    // a thread of a scheduler pool may run a different machine afterwards
+    class ConsumerScope {
+        EventLoopFeature& _loop;
+    public:
+        ConsumerScope(EventLoopFeature& loop) : _loop(loop) {
+            // the machine may run on a different thread than it was created on
+            JS_UpdateStackTop(_loop.runtime());
+            if constexpr (requires(Next& next) { next.bindConsumerThread(); }) {
+                _loop.bindConsumerThread();
+            }
+        }
+
+        ConsumerScope(const ConsumerScope&) = delete;
+        ConsumerScope& operator=(const ConsumerScope&) = delete;
+
+        ~ConsumerScope() {
+            if constexpr (requires(Next& next) { next.unbindConsumerThread(); }) {
+                _loop.unbindConsumerThread();
+            }
+        }
+    };
+
+    template<class... Args>
+    std::optional<std::function<void()>> waitEvent(Args... args) {
+        if constexpr (HasLoopMetrics<Next>) {
+            auto start = std::chrono::steady_clock::now();
+            auto event = this->getEvent(args...);
+            this->loopMetrics().idleTime.fetch_add(LoopMetrics::micros(std::chrono::steady_clock::now() - start), std::memory_order_relaxed);
+            return event;
+        }
+        else {
+            return this->getEvent(args...);
+        }
+    }
+
+    void dispatchEvent(std::function<void()>& event) {
+        TraceSpan span(this->tracer(), "event", "event");
+        this->resetWatchdog();
+        if constexpr (HasLoopMetrics<Next>) {
+            auto start = std::chrono::steady_clock::now();
+            event();
+            auto duration = LoopMetrics::micros(std::chrono::steady_clock::now() - start);
+
+            auto& metrics = this->loopMetrics();
+            metrics.executionTime.record(duration);
+            metrics.busyTime.fetch_add(duration, std::memory_order_relaxed);
+            metrics.eventsDispatched.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            event();
+        }
+    }
+
+    bool jobsPending() {
+        return JS_IsJobPending(JS_GetRuntime(this->context()));
+    }
+
+    /**
+     * @brief Execute pending jobs until the job queue is empty or the job budget is exceeded
+     * @return true if any job was executed
+     */
+    bool runPendingJobs() {
+        JSRuntime* rt = JS_GetRuntime(this->context());
+        JSContext* ctx1;
+
+        uint64_t maxJobs = _maxJobs.load(std::memory_order_relaxed);
+        std::chrono::microseconds maxTime(_maxJobTimeUs.load(std::memory_order_relaxed));
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t jobs = 0;
+        bool exceeded = false;
+        while (!_shouldExit) {
+            if ((maxJobs > 0 && jobs >= maxJobs)
+             || (maxTime.count() > 0 && jobs > 0 && std::chrono::steady_clock::now() - start >= maxTime)) {
+                // let the event queue be serviced before resuming the jobs
+                exceeded = JS_IsJobPending(rt);
+                break;
+            }
+
+            this->resetWatchdog();
+            int err = JS_ExecutePendingJob(rt, &ctx1);
+            if (err <= 0) {
+                if (err < 0) {
+                    recordDrain(jobs, std::chrono::steady_clock::now() - start, false);
+                    throw ContextRef(ctx1).getException();
+                }
+                break;
+            }
+            jobs++;
+        }
+
+        if (jobs > 0) {
+            auto end = std::chrono::steady_clock::now();
+            recordDrain(jobs, end - start, exceeded);
+            if (auto tracer = this->tracer()) {
+                tracer->record("jobs", "jobs", start, end);
+            }
+        }
+        return jobs > 0;
+    }
+
+    /**
+     * @brief Act on a failed allocation, see MachineBase::setOutOfMemoryHandler
+     *
+     * @return true if the machine was killed because it ran out of memory
+     */
+    bool checkOutOfMemory() {
+        this->handleOutOfMemory();
+        if (!this->outOfMemoryKillRequested()) {
+            return false;
+        }
+        if (!_shouldExit || _exitCode != outOfMemoryExitCode) {
+            exit(outOfMemoryExitCode);
+        }
+        // the out of memory error is expected, the exit code reports it
+        _error = std::nullopt;
+        return true;
+    }
+
 protected:
     std::optional<Exception> _error = std::nullopt;
 
@@ -42,39 +205,42 @@ protected:
 public:
 
     void runEventLoop() {
+        ConsumerScope consumer(*this);
         try {
-            JSRuntime* rt = JS_GetRuntime(this->context());
-            JSContext* ctx1;
-
             bool didJob = true;
             while (!_shouldExit) {
+                if (checkOutOfMemory()) {
+                    break;
+                }
                 runOnEventLoop();
 
-                auto event = this->getEvent(!didJob);
-                this->resetWatchdog();
+                // onEventLoop handlers (e.g. completing pending promises) may create jobs,
+                // the loop must not block before running them
+                bool poll = didJob || jobsPending();
+
+                std::optional<std::function<void()>> event;
+                if (poll) {
+                    event = this->getEvent(false);
+                }
+                else if (auto deadline = getNextDeadline()) {
+                    event = waitEvent(*deadline);
+                }
+                else {
+                    event = waitEvent(true);
+                }
+
                 if (event) {
-                    (*event)();
+                    dispatchEvent(*event);
                 }
-                else if (!didJob) {
+                else if (!poll) {
                     continue;
                 }
 
-                didJob = false;
-                while (!_shouldExit) {
-                    this->resetWatchdog();
-                    int err = JS_ExecutePendingJob(rt, &ctx1);
-                    if (err <= 0) {
-                        if (err < 0) {
-                            throw ContextRef(ctx1).getException();
-                        }
-                        break;
-                    }
-                    didJob = true;
-                }
+                didJob = runPendingJobs();
             }
         }
         catch (...) {
-            if (_shouldExit) {
+            if (checkOutOfMemory() || _shouldExit) {
                 // ignore
             }
             else {
@@ -82,11 +248,151 @@ public:
             }
         }
 
+        checkOutOfMemory();
         if (_error) {
             throw (*_error);
         }
     }
 
+    /**
+     * @brief Run a bounded step of the event loop. Pending jobs are executed
+     * first, then up to maxEvents events are dispatched, each followed by the
+     * jobs it produced. If no event is ready, the call waits for one at most
+     * for the given timeout.
+     * @note Used to embed the machine into an external reactor, see
+     * EventQueueFeature::eventFd
+     *
+     * @param timeout maximum time to wait for an event
+     * @param maxEvents maximum number of events to dispatch
+     * @return Time point at which the loop should be run again, or std::nullopt
+     * if it should only be run after it is notified or after it has exited
+     */
+    std::optional<std::chrono::steady_clock::time_point> runOnce(std::chrono::milliseconds timeout = std::chrono::milliseconds(0), int maxEvents = 64) {
+        int dispatched = 0;
+        ConsumerScope consumer(*this);
+        try {
+            auto until = std::chrono::steady_clock::now() + timeout;
+            runPendingJobs();
+
+            while (!_shouldExit && dispatched < maxEvents) {
+                if (checkOutOfMemory()) {
+                    break;
+                }
+                runOnEventLoop();
+
+                auto event = this->getEvent(false);
+                if (!event && jobsPending()) {
+                    // resume jobs interrupted by the job budget
+                    runPendingJobs();
+                    dispatched++;
+                    continue;
+                }
+                if (!event) {
+                    auto now = std::chrono::steady_clock::now();
+                    auto deadline = getNextDeadline();
+                    auto wakeup = deadline ? std::min(*deadline, until) : until;
+                    if (wakeup <= now) {
+                        break;
+                    }
+                    event = waitEvent(wakeup);
+                    until = now;
+                    if (!event) {
+                        continue;
+                    }
+                }
+
+                dispatchEvent(*event);
+                runPendingJobs();
+                dispatched++;
+            }
+        }
+        catch (...) {
+            if (!checkOutOfMemory() && !_shouldExit) {
+                throw;
+            }
+        }
+
+        checkOutOfMemory();
+        if (_error) {
+            throw (*_error);
+        }
+        if (_shouldExit) {
+            return std::nullopt;
+        }
+        if (dispatched >= maxEvents || jobsPending()) {
+            return std::chrono::steady_clock::now();
+        }
+        return getNextDeadline();
+    }
+
+    /**
+     * @brief Run a step of the event loop without waiting for events
+     * @return Time point at which the loop should be run again, see runOnce
+     */
+    std::optional<std::chrono::steady_clock::time_point> poll() {
+        return runOnce();
+    }
+
+    /**
+     * @brief Statistics of job (microtask) execution
+     */
+    struct JobStats {
+        /** @brief Total number of executed jobs */
+        uint64_t jobs;
+        /** @brief Number of turns in which jobs were drained */
+        uint64_t drains;
+        /** @brief Number of drains interrupted by the job budget */
+        uint64_t budgetExceeded;
+        /** @brief Largest number of jobs executed in a single drain */
+        uint64_t maxJobsPerDrain;
+        /** @brief Longest time the event queue was not serviced because of draining jobs */
+        std::chrono::microseconds maxStarvation;
+        /** @brief Total time spent draining jobs */
+        std::chrono::microseconds totalDrainTime;
+    };
+
+    /**
+     * @brief Limit the number of jobs (microtasks) executed in a single turn
+     * of the event loop. When the budget is exceeded, the event queue is
+     * serviced before the remaining jobs are executed, so that a promise chain
+     * which keeps scheduling jobs cannot starve timers and other events.
+     * @note Can be called from any thread. Zero disables the respective limit
+     * (default).
+     *
+     * @param maxJobs maximum number of jobs per turn
+     * @param maxTime maximum time spent executing jobs per turn
+     */
+    void setJobBudget(uint64_t maxJobs, std::chrono::microseconds maxTime = std::chrono::microseconds(0)) {
+        _maxJobs = maxJobs;
+        _maxJobTimeUs = maxTime.count();
+    }
+
+    /**
+     * @brief Get the statistics of job execution
+     * @note Can be called from any thread
+     *
+     * @return The statistics
+     */
+    JobStats jobStats() const {
+        return {
+            _statJobs.load(std::memory_order_relaxed),
+            _statDrains.load(std::memory_order_relaxed),
+            _statBudgetExceeded.load(std::memory_order_relaxed),
+            _statMaxJobsPerDrain.load(std::memory_order_relaxed),
+            std::chrono::microseconds(_statMaxDrainUs.load(std::memory_order_relaxed)),
+            std::chrono::microseconds(_statTotalDrainUs.load(std::memory_order_relaxed))
+        };
+    }
+
+    /**
+     * @brief Check if the event loop was stopped by exit() or kill()
+     *
+     * @return true if the event loop has exited
+     */
+    bool hasExited() {
+        return _shouldExit;
+    }
+
     void kill() {
         _shouldExit = true;
         this->interruptRuntime();
@@ -109,6 +415,7 @@ public:
     }
 
     virtual void runOnEventLoop() = 0;
+    virtual std::optional<std::chrono::steady_clock::time_point> getNextDeadline() = 0;
 
     void initialize() {
         Next::initialize();
@@ -121,6 +428,19 @@ public:
     void onEventLoop() {
         // last in stack
     }
+
+    /**
+     * @brief Get the earliest time point at which an MFeature needs the event
+     * loop to run, even if no event is scheduled. Other MFeatures in the Machine
+     * stack can implement this method, combining their deadline with the one
+     * returned by Next::nextDeadline().
+     *
+     * @return The deadline or std::nullopt if there is none
+     */
+    std::optional<std::chrono::steady_clock::time_point> nextDeadline() {
+        // last in stack
+        return std::nullopt;
+    }
 };
 
 
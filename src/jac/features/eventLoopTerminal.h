@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
+
 
 namespace jac {
 
@@ -10,6 +13,10 @@ public:
     virtual void runOnEventLoop() override {  // NOLINT
         Next::onEventLoop();
     };
+
+    virtual std::optional<std::chrono::steady_clock::time_point> getNextDeadline() override {  // NOLINT
+        return Next::nextDeadline();
+    };
 };
 
 
@@ -1,21 +1,168 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <functional>
 #include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "util/eventPriority.h"
+#include "util/loopMetrics.h"
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 
 namespace jac {
 
 
+/**
+ * @brief Behavior of a bounded event queue when an event is scheduled
+ * while the queue is full
+ */
+enum class OverflowPolicy {
+    /**
+     * @brief Block the producer until there is space in the queue
+     */
+    Block,
+    /**
+     * @brief Discard the oldest event of the lowest non-empty priority lane
+     */
+    DropOldest,
+    /**
+     * @brief Discard the scheduled event
+     */
+    DropNewest,
+    /**
+     * @brief Do not queue the scheduled event, the producer is expected to
+     * handle the failure (e.g. throttle and retry)
+     */
+    Reject
+};
+
+
+/**
+ * @brief Thread-safe event queue with priority lanes. Events are dequeued
+ * using weighted round robin - in each round, a lane can provide at most
+ * its weight of events, with higher priority lanes served first. Lower
+ * priority events therefore cannot be starved by higher priority ones.
+ */
 template<class Next>
 class EventQueueFeature : public Next {
 private:
-    std::deque<std::function<void()>> _scheduledFunctions;
+    std::array<std::deque<std::function<void()>>, eventPriorityCount> _scheduledFunctions;
+    std::array<unsigned, eventPriorityCount> _weights = { 8, 4, 1 };
+    std::array<unsigned, eventPriorityCount> _credits = _weights;
+    size_t _scheduledCount = 0;
     std::mutex _scheduledFunctionsMutex;
     std::condition_variable _scheduledFunctionsCondition;
+    bool _notified = false;
+    std::function<void()> _wakeupHandler;
+
+    size_t _capacity = 0;
+    OverflowPolicy _overflowPolicy = OverflowPolicy::Block;
+    std::condition_variable _spaceCondition;
+    std::thread::id _consumerThread;
+    // the thread which last ran the event loop, initially the one which created the machine
+    std::thread::id _ownerThread = std::this_thread::get_id();
+    bool _closed = false;
+    std::vector<std::function<void()>> _discarded;
+
+    size_t _highWaterMark = 0;
+    size_t _lowWaterMark = 0;
+    bool _aboveHighWater = false;
+    std::function<void(bool)> _highWaterCallback;
+
+#ifdef __linux__
+    int _eventFd = -1;
+#endif
+
+    bool isReady() const {
+        return _scheduledCount > 0 || _notified;
+    }
+
+    bool readinessChanged(bool wasReady) {
+        bool becameReady = !wasReady && isReady();
+#ifdef __linux__
+        if (_eventFd < 0 || wasReady == isReady()) {
+            return becameReady;
+        }
+        if (wasReady) {
+            eventfd_t value;
+            eventfd_read(_eventFd, &value);
+        }
+        else {
+            eventfd_write(_eventFd, 1);
+        }
+#endif
+        return becameReady;
+    }
+
+    size_t selectLane() {
+        while (true) {
+            for (size_t lane = 0; lane < eventPriorityCount; lane++) {
+                if (!_scheduledFunctions[lane].empty() && _credits[lane] > 0) {
+                    _credits[lane]--;
+                    return lane;
+                }
+            }
+            // all non-empty lanes used up their credits, start a new round
+            _credits = _weights;
+        }
+    }
+
+    bool isFull() const {
+        return _capacity > 0 && _scheduledCount >= _capacity;
+    }
+
+    std::function<void()> popOldest() {
+        for (size_t lane = eventPriorityCount; lane-- > 0;) {
+            if (!_scheduledFunctions[lane].empty()) {
+                auto func = std::move(_scheduledFunctions[lane].front());
+                _scheduledFunctions[lane].pop_front();
+                _scheduledCount--;
+                return func;
+            }
+        }
+        return nullptr;
+    }
+
+    std::optional<std::function<void()>> popEvent(bool& belowLowWater) {
+        bool wasReady = isReady();
+        _notified = false;
+        if (_scheduledCount == 0) {
+            readinessChanged(wasReady);
+            return std::nullopt;
+        }
+
+        auto& lane = _scheduledFunctions[selectLane()];
+        auto func = std::move(lane.front());
+        lane.pop_front();
+        _scheduledCount--;
+        readinessChanged(wasReady);
+
+        if (_capacity > 0) {
+            _spaceCondition.notify_one();
+        }
+        if (_aboveHighWater && _scheduledCount <= _lowWaterMark) {
+            _aboveHighWater = false;
+            belowLowWater = true;
+        }
+
+        if constexpr (HasLoopMetrics<Next>) {
+            this->loopMetrics().queueDepth.store(_scheduledCount, std::memory_order_relaxed);
+        }
+
+        return func;
+    }
 public:
     /**
      * @brief Check the event queue and return the first event
@@ -23,43 +170,278 @@ public:
      * @return Event or std::nullopt if no event is available
      */
     std::optional<std::function<void()>> getEvent(bool wait) {
-        std::unique_lock lock(_scheduledFunctionsMutex);
-        if (wait && _scheduledFunctions.empty()) {
-            _scheduledFunctionsCondition.wait(lock);
+        std::optional<std::function<void()>> event;
+        std::vector<std::function<void()>> discarded;
+        bool belowLowWater = false;
+        {
+            std::unique_lock lock(_scheduledFunctionsMutex);
+            if (wait) {
+                _scheduledFunctionsCondition.wait(lock, [this] { return isReady(); });
+            }
+            event = popEvent(belowLowWater);
+            discarded.swap(_discarded);
         }
-        if (_scheduledFunctions.empty()) {
-            return std::nullopt;
+        if (belowLowWater) {
+            _highWaterCallback(false);
         }
-        auto func = std::move(_scheduledFunctions.front());
-        _scheduledFunctions.pop_front();
-        lock.unlock();
+        return event;
+    }
 
-        return func;
+    /**
+     * @brief Check the event queue and return the first event, waiting
+     * for an event at most until the given time point
+     * @param until Time point to wait until if no event is available
+     * @return Event or std::nullopt if no event is available
+     */
+    std::optional<std::function<void()>> getEvent(std::chrono::steady_clock::time_point until) {
+        std::optional<std::function<void()>> event;
+        std::vector<std::function<void()>> discarded;
+        bool belowLowWater = false;
+        {
+            std::unique_lock lock(_scheduledFunctionsMutex);
+            _scheduledFunctionsCondition.wait_until(lock, until, [this] { return isReady(); });
+            event = popEvent(belowLowWater);
+            discarded.swap(_discarded);
+        }
+        if (belowLowWater) {
+            _highWaterCallback(false);
+        }
+        return event;
     }
 
     /**
-     * @brief Schedule an event to be run
+     * @brief Schedule an event to be run. If the queue is bounded and full,
+     * the overflow policy is applied, unless the event is scheduled from
+     * the thread running the event loop. The Block policy does not wait
+     * while the loop is not running if the caller is the thread which last
+     * ran it (or created the machine), as it is the only expected consumer.
      * @param func Function to be run
+     * @param priority Priority of the event
+     * @return true if the event was queued, false if it was discarded
      */
-    void scheduleEvent(std::function<void()> func) {
+    bool scheduleEvent(std::function<void()> func, EventPriority priority = EventPriority::Normal) {
+        size_t lane = static_cast<size_t>(priority);
+
+        if constexpr (HasLoopMetrics<Next>) {
+            func = [this, lane, scheduled = std::chrono::steady_clock::now(), func = std::move(func)]() {
+                auto latency = LoopMetrics::micros(std::chrono::steady_clock::now() - scheduled);
+                this->loopMetrics().dispatchLatency.record(latency);
+                this->loopMetrics().laneLatency[lane].record(latency);
+                func();
+            };
+        }
+
+        bool becameReady;
+        bool aboveHighWater = false;
         {
-            std::scoped_lock lock(_scheduledFunctionsMutex);
-            _scheduledFunctions.push_back(std::move(func));
+            std::unique_lock lock(_scheduledFunctionsMutex);
+            if (isFull() && std::this_thread::get_id() != _consumerThread) {
+                switch (_overflowPolicy) {
+                    case OverflowPolicy::Block:
+                        if (_consumerThread == std::thread::id() && std::this_thread::get_id() == _ownerThread) {
+                            // e.g. events scheduled while evaluating code before the loop runs
+                            break;
+                        }
+                        _spaceCondition.wait(lock, [this] { return !isFull() || _closed; });
+                        if (_closed) {
+                            return false;
+                        }
+                        break;
+                    case OverflowPolicy::DropOldest:
+                        // the event may hold JavaScript values, it is destroyed by the event loop thread
+                        _discarded.push_back(popOldest());
+                        if constexpr (HasLoopMetrics<Next>) {
+                            this->loopMetrics().eventsDropped.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        break;
+                    case OverflowPolicy::DropNewest:
+                        if constexpr (HasLoopMetrics<Next>) {
+                            this->loopMetrics().eventsDropped.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        lock.unlock();
+                        return false;
+                    case OverflowPolicy::Reject:
+                        if constexpr (HasLoopMetrics<Next>) {
+                            this->loopMetrics().eventsRejected.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        lock.unlock();
+                        return false;
+                }
+            }
+
+            bool wasReady = isReady();
+            _scheduledFunctions[lane].push_back(std::move(func));
+            _scheduledCount++;
+            becameReady = readinessChanged(wasReady);
+
+            if (_highWaterCallback && !_aboveHighWater && _scheduledCount >= _highWaterMark) {
+                _aboveHighWater = true;
+                aboveHighWater = true;
+            }
+
+            if constexpr (HasLoopMetrics<Next>) {
+                this->loopMetrics().eventsScheduled.fetch_add(1, std::memory_order_relaxed);
+                this->loopMetrics().queueDepth.store(_scheduledCount, std::memory_order_relaxed);
+            }
         }
         _scheduledFunctionsCondition.notify_one();
+        if (aboveHighWater) {
+            _highWaterCallback(true);
+        }
+        if (becameReady && _wakeupHandler) {
+            _wakeupHandler();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Bound the number of queued events
+     * @note Events scheduled from the thread running the event loop (e.g.
+     * timers) are always queued, so that the loop never blocks on itself.
+     * The same applies to the Block policy on the thread which last ran the
+     * loop (or created the machine) while the loop is not running.
+     * @param capacity Maximum number of queued events, 0 for unbounded (default)
+     * @param policy Behavior when an event is scheduled to a full queue
+     */
+    void setQueueLimit(size_t capacity, OverflowPolicy policy = OverflowPolicy::Block) {
+        {
+            std::scoped_lock lock(_scheduledFunctionsMutex);
+            _capacity = capacity;
+            _overflowPolicy = policy;
+        }
+        _spaceCondition.notify_all();
+    }
+
+    /**
+     * @brief Set a function called when the number of queued events reaches
+     * the high-water mark (with true) and when it then falls to the low-water
+     * mark (with false). Used to throttle producers at the source.
+     * @note The function is called from the thread which scheduled or dequeued
+     * the event, without holding the queue lock. Must be set before any events
+     * are scheduled from other threads.
+     * @param highWaterMark The high-water mark
+     * @param lowWaterMark The low-water mark
+     * @param callback The function
+     */
+    void setHighWaterMark(size_t highWaterMark, size_t lowWaterMark, std::function<void(bool)> callback) {
+        std::scoped_lock lock(_scheduledFunctionsMutex);
+        _highWaterMark = highWaterMark;
+        _lowWaterMark = std::min(lowWaterMark, highWaterMark);
+        _aboveHighWater = false;
+        _highWaterCallback = std::move(callback);
+    }
+
+    /**
+     * @brief Mark the calling thread as the one running the event loop, see
+     * setQueueLimit. Called by EventLoopFeature for the duration of each run.
+     */
+    void bindConsumerThread() {
+        std::scoped_lock lock(_scheduledFunctionsMutex);
+        _consumerThread = std::this_thread::get_id();
+        _ownerThread = _consumerThread;
+    }
+
+    /**
+     * @brief Unmark the thread bound by bindConsumerThread once the event
+     * loop stops running on it. Called by EventLoopFeature.
+     */
+    void unbindConsumerThread() {
+        std::scoped_lock lock(_scheduledFunctionsMutex);
+        _consumerThread = std::thread::id();
+    }
+
+    /**
+     * @brief Get the number of queued events
+     * @return The number of events
+     */
+    size_t queueSize() {
+        std::scoped_lock lock(_scheduledFunctionsMutex);
+        return _scheduledCount;
+    }
+
+    /**
+     * @brief Set the weight of a priority lane - the maximum number of its
+     * events dispatched in a single round of weighted round robin
+     * @param priority The priority lane
+     * @param weight The weight, at least 1 (default 8, 4 and 1 for urgent,
+     * normal and background events)
+     */
+    void setPriorityWeight(EventPriority priority, unsigned weight) {
+        std::scoped_lock lock(_scheduledFunctionsMutex);
+        _weights[static_cast<size_t>(priority)] = std::max(weight, 1u);
     }
 
     /**
      * @brief Wake up event loop if it is waiting for events
      */
     void notifyEventLoop() {
+        bool becameReady;
+        {
+            std::scoped_lock lock(_scheduledFunctionsMutex);
+            bool wasReady = isReady();
+            _notified = true;
+            becameReady = readinessChanged(wasReady);
+        }
         _scheduledFunctionsCondition.notify_one();
+        if (becameReady && _wakeupHandler) {
+            _wakeupHandler();
+        }
+    }
+
+    /**
+     * @brief Set a function to be called whenever the event loop gets work
+     * to do after being idle - an event is scheduled or the loop is notified.
+     * The function is called from the thread which scheduled the event.
+     * @note Used to run the machine on demand, see MachineScheduler. Must be
+     * set before any events are scheduled from other threads.
+     * @param handler The function
+     */
+    void setWakeupHandler(std::function<void()> handler) {
+        _wakeupHandler = std::move(handler);
+    }
+
+#ifdef __linux__
+    /**
+     * @brief Get a file descriptor which is readable whenever an event is
+     * available or the event loop was notified. The descriptor is created on
+     * the first call and is owned by the event queue.
+     * @note Used to multiplex the event loop with other sources of events,
+     * see EventLoopFeature::runOnce
+     * @return The file descriptor
+     */
+    int eventFd() {
+        std::scoped_lock lock(_scheduledFunctionsMutex);
+        if (_eventFd < 0) {
+            _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (_eventFd < 0) {
+                throw std::runtime_error("EventQueueFeature: eventfd failed");
+            }
+            readinessChanged(false);
+        }
+        return _eventFd;
     }
+#endif
 
     ~EventQueueFeature() {
+        _wakeupHandler = nullptr;
         notifyEventLoop();
+        {
+            std::scoped_lock lock(_scheduledFunctionsMutex);
+            _closed = true;
+        }
+        _spaceCondition.notify_all();
+
         std::scoped_lock lock(_scheduledFunctionsMutex);
-        _scheduledFunctions.clear();
+        for (auto& lane : _scheduledFunctions) {
+            lane.clear();
+        }
+        _scheduledCount = 0;
+        _discarded.clear();
+#ifdef __linux__
+        if (_eventFd >= 0) {
+            close(_eventFd);
+        }
+#endif
     }
 };
 
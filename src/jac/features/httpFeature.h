@@ -0,0 +1,290 @@
+#pragma once
+
+#include <jac/machine/class.h>
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "basicStreamFeature.h"
+#include "util/http.h"
+#include "util/httpServer.h"
+
+
+namespace jac {
+
+
+#ifdef __linux__
+
+struct HttpRequestProtoBuilder : public ProtoBuilder::Opaque<HttpRequest>, public ProtoBuilder::Properties {
+    using Getter = JSValue(*)(JSContext* ctx, JSValueConst thisVal);
+
+    static void defineGetter(ContextRef ctx, Object proto, const std::string& name, Getter get) {
+        JSValue getter = JS_NewCFunction2(ctx, reinterpret_cast<JSCFunction*>(reinterpret_cast<void*>(get)), ("get " + name).c_str(), 0, JS_CFUNC_getter, 0); // NOLINT
+        Atom atom = Atom::create(ctx, name);
+        JS_DefinePropertyGetSet(ctx, proto.getVal(), atom.get(), getter, JS_UNDEFINED, JS_PROP_CONFIGURABLE | JS_PROP_ENUMERABLE);
+    }
+
+    template<typename Func>
+    static JSValue getFromRequest(JSContext* ctx, JSValueConst thisVal, Func func) {
+        return propagateExceptions(ctx, [&]() -> JSValue {
+            HttpRequest& request = *getOpaque(ctx, ValueWeak(ctx, thisVal));
+            return func(ContextRef(ctx), request).loot().second;
+        });
+    }
+
+    static void addProperties(ContextRef ctx, Object proto) {
+        FunctionFactory ff(ctx);
+
+        defineGetter(ctx, proto, "method", [](JSContext* ctx_, JSValueConst thisVal) {
+            return getFromRequest(ctx_, thisVal, [](ContextRef c, HttpRequest& request) {
+                return Value::from(c, request.method);
+            });
+        });
+        defineGetter(ctx, proto, "url", [](JSContext* ctx_, JSValueConst thisVal) {
+            return getFromRequest(ctx_, thisVal, [](ContextRef c, HttpRequest& request) {
+                return Value::from(c, request.target);
+            });
+        });
+        defineGetter(ctx, proto, "httpVersion", [](JSContext* ctx_, JSValueConst thisVal) {
+            return getFromRequest(ctx_, thisVal, [](ContextRef c, HttpRequest& request) {
+                return Value::from(c, "1." + std::to_string(request.versionMinor));
+            });
+        });
+        defineGetter(ctx, proto, "body", [](JSContext* ctx_, JSValueConst thisVal) {
+            return getFromRequest(ctx_, thisVal, [](ContextRef c, HttpRequest& request) {
+                return Value::from(c, std::string(request.body.begin(), request.body.end()));
+            });
+        });
+
+        // the header object is created on the first access and then replaces the getter on the instance,
+        // names are lower-cased and repeated headers are joined with ", "
+        defineGetter(ctx, proto, "headers", [](JSContext* ctx_, JSValueConst thisVal) {
+            return getFromRequest(ctx_, thisVal, [thisVal](ContextRef c, HttpRequest& request) {
+                Object headers(c, JS_NewObjectProto(c, JS_NULL));
+                for (size_t i = 0; i < request.headers.size(); i++) {
+                    std::string name(request.headerName(i));
+                    for (char& ch : name) {
+                        ch = HttpRequest::toLower(ch);
+                    }
+                    std::string value(request.headerValue(i));
+
+                    Value previous = headers.get<Value>(name);
+                    if (!previous.isUndefined()) {
+                        value = previous.to<std::string>() + ", " + value;
+                    }
+                    headers.set(name, value);
+                }
+                ObjectWeak(c, thisVal).defineProperty("headers", headers, PropFlags::Enumerable);
+                return headers;
+            });
+        });
+
+        // looks up a single header without creating the header object
+        proto.defineProperty("header", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self, std::string name) {
+            HttpRequest& request = *HttpRequestProtoBuilder::getOpaque(ctx_, self);
+            auto value = request.header(name);
+            if (!value) {
+                return Value::undefined(ctx_);
+            }
+            return Value::from(ctx_, std::string(*value));
+        }));
+
+        proto.defineProperty("arrayBuffer", ff.newFunctionThis([](ContextRef ctx_, ValueWeak self) {
+            HttpRequest& request = *HttpRequestProtoBuilder::getOpaque(ctx_, self);
+            return ArrayBuffer::create(ctx_, std::vector<uint8_t>(request.body));
+        }));
+    }
+};
+
+
+/**
+ * @brief Adds the "http" module with an HTTP/1.1 server built on the sockets
+ * of the NetFeature.
+ *
+ * Requests are parsed natively and passed to the JavaScript handler once
+ * complete; the handler returns (or resolves to) the response. Keep-alive,
+ * pipelining and chunked request bodies are supported, responses are sent
+ * with Content-Length.
+ *
+ * @note Requires the NetFeature.
+ */
+template<class Next>
+class HttpFeature : public Next {
+    struct Handler {
+        std::optional<Function> function;
+    };
+
+    // the handlers are released before the runtime, even if connections still reference them
+    std::vector<std::shared_ptr<Handler>> _handlers;
+
+    void appendHeaders(HttpResponse& response, ValueWeak headers) {
+        ContextRef ctx = this->context();
+        JSPropertyEnum* props;
+        uint32_t count;
+        if (JS_GetOwnPropertyNames(ctx, &props, &count, headers.getVal(), JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) < 0) {
+            throw ctx.getException();
+        }
+        // the atoms are adopted, so they are released even if a conversion throws
+        std::vector<Atom> names;
+        names.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            names.emplace_back(ctx, props[i].atom);
+        }
+        js_free(ctx, props);
+
+        for (auto& name : names) {
+            Value value(ctx, JS_GetProperty(ctx, headers.getVal(), name.get()));
+            response.headers.emplace_back(std::string(name.toString()), value.to<std::string>());
+        }
+    }
+
+    HttpResponse toResponse(ValueWeak value) {
+        HttpResponse response;
+        if (value.isUndefined() || value.isNull()) {
+            response.status = 204;
+            return response;
+        }
+        if (JS_IsString(value.getVal())) {
+            response.headers.emplace_back("Content-Type", "text/plain; charset=utf-8");
+            response.bodyString = value.to<std::string>();
+            return response;
+        }
+
+        Object object = value.to<Object>();
+        Value status = object.get<Value>("status");
+        if (!status.isUndefined()) {
+            response.status = status.to<int>();
+        }
+        Value headers = object.get<Value>("headers");
+        if (headers.isObject()) {
+            appendHeaders(response, headers);
+        }
+
+        Value body = object.get<Value>("body");
+        if (body.isUndefined() || body.isNull()) {
+            return response;
+        }
+        if (JS_IsString(body.getVal())) {
+            response.bodyString = body.to<std::string>();
+        }
+        // the memory of the buffer is written to the socket without copying
+        else if (auto span = bufferData(this->context(), body)) {
+            response.bodyView = *span;
+            response.bodyOwner = std::make_shared<Value>(body);
+        }
+        else {
+            response.bodyString = body.to<std::string>();
+        }
+        return response;
+    }
+
+    static HttpResponse errorResponse() {
+        HttpResponse response;
+        response.status = 500;
+        return response;
+    }
+
+    void handle(Handler& handler, HttpRequest request, HttpResponder responder) {
+        if (!handler.function) {
+            responder.send(errorResponse());
+            return;
+        }
+        ContextRef ctx = this->context();
+        FunctionFactory ff(ctx);
+
+        Value requestObj = HttpRequestClass::createInstance(ctx, new HttpRequest(std::move(request)));
+        Function function = *handler.function;
+        Value result = function.call<Value>(requestObj);
+
+        Value then = result.isObject() ? result.to<Object>().get<Value>("then") : Value::undefined(ctx);
+        if (!JS_IsFunction(ctx, then.getVal())) {
+            responder.send(toResponse(result));
+            return;
+        }
+
+        // a promise of the response, responses of later pipelined requests wait for it
+        auto onResolved = ff.newFunction([this, responder](ValueWeak value) mutable {
+            try {
+                responder.send(toResponse(value));
+            }
+            catch (...) {
+                responder.send(errorResponse());
+            }
+        });
+        auto onRejected = ff.newFunction([responder](ValueWeak) mutable {
+            responder.send(errorResponse());
+        });
+        then.to<Function>().callThis<void>(result, onResolved, onRejected);
+    }
+
+public:
+    using HttpRequestClass = Class<HttpRequestProtoBuilder>;
+
+    HttpFeature() {
+        HttpRequestClass::init("HttpRequest");
+    }
+
+    void initialize() {
+        Next::initialize();
+
+        HttpRequestClass::initContext(this->context());
+
+        FunctionFactory ff(this->context());
+        auto& mdl = this->newModule("http");
+
+        mdl.addExport("serve", ff.newFunction([this](ValueWeak options, Function function) {
+            SocketAddress address = Next::parseAddress(options);
+
+            HttpLimits limits;
+            Value maxBodySize = options.to<Object>().get<Value>("maxBodySize");
+            if (!maxBodySize.isUndefined()) {
+                int size = maxBodySize.to<int>();
+                if (size < 0) {
+                    throw Exception::create(Exception::Type::RangeError, "maxBodySize must not be negative");
+                }
+                limits.maxBodySize = static_cast<size_t>(size);
+            }
+
+            auto handler = std::make_shared<Handler>();
+            handler->function = function;
+            _handlers.push_back(handler);
+
+            std::shared_ptr<SocketServer> server;
+            try {
+                server = SocketServer::listen(this->socketRegistry(), address, [this, handler, limits](std::shared_ptr<Socket> socket) {
+                    auto connection = std::make_shared<HttpConnection>(std::move(socket), [this, handler](HttpRequest request, HttpResponder responder) {
+                        try {
+                            handle(*handler, std::move(request), responder);
+                        }
+                        catch (...) {
+                            // the handler threw, the server keeps running
+                            responder.send(errorResponse());
+                        }
+                    }, limits);
+                    connection->start();
+                });
+            }
+            catch (std::system_error& e) {
+                throw Exception::create(Exception::Type::Error, e.what());
+            }
+
+            return Next::wrapServer(std::move(server));
+        }));
+    }
+
+    ~HttpFeature() {
+        for (auto& handler : _handlers) {
+            handler->function.reset();
+        }
+    }
+};
+
+#endif
+
+
+} // namespace jac
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <jac/machine/machine.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <optional>
+
+#include "util/ioReactor.h"
+
+
+namespace jac {
+
+
+#ifdef __linux__
+
+/**
+ * @brief Makes the event loop wait in epoll_wait instead of on the condition
+ * variable of the event queue. The event queue is watched through its
+ * eventfd (see EventQueueFeature::eventFd), so events scheduled from other
+ * threads still wake the loop up, and native features can watch their own
+ * file descriptors through ioReactor(). The callbacks of ready descriptors
+ * are dispatched as events on the event loop thread.
+ *
+ * @note The IoReactorFeature must be placed between the EventQueueFeature
+ * and the EventLoopFeature in the Machine stack.
+ */
+template<class Next>
+class IoReactorFeature : public Next {
+    EpollReactor _reactor;
+    bool _wakeFdWatched = false;
+    // alternate between the event queue and the descriptors, so that neither starves the other
+    bool _ioFirst = false;
+
+    std::optional<std::function<void()>> getEventOrIo(int timeoutMs) {
+        if (!_wakeFdWatched) {
+            _reactor.setWakeFd(this->eventFd());
+            _wakeFdWatched = true;
+        }
+
+        bool polled = false;
+        _ioFirst = !_ioFirst;
+        if (_ioFirst && !_reactor.empty()) {
+            polled = true;
+            if (auto io = _reactor.wait(0)) {
+                return io;
+            }
+        }
+        if (auto event = Next::getEvent(false)) {
+            return event;
+        }
+        if (timeoutMs == 0 && (polled || _reactor.empty())) {
+            return std::nullopt;
+        }
+        if (auto io = _reactor.wait(timeoutMs)) {
+            return io;
+        }
+        return Next::getEvent(false);
+    }
+
+public:
+    /**
+     * @brief Get the reactor used to watch file descriptors
+     * @note The watchers must be managed from the thread running the event
+     * loop, other threads can schedule an event which does so
+     *
+     * @return The reactor
+     */
+    EpollReactor& ioReactor() {
+        return _reactor;
+    }
+
+    std::optional<std::function<void()>> getEvent(bool wait) {
+        return getEventOrIo(wait ? -1 : 0);
+    }
+
+    std::optional<std::function<void()>> getEvent(std::chrono::steady_clock::time_point until) {
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(until - std::chrono::steady_clock::now());
+        auto timeoutMs = std::clamp<std::chrono::milliseconds::rep>(remaining.count(), 0, std::numeric_limits<int>::max());
+        return getEventOrIo(static_cast<int>(timeoutMs));
+    }
+};
+
+#endif
+
+
+} // namespace jac
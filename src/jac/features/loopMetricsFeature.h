@@ -0,0 +1,32 @@
+#pragma once
+
+#include "util/loopMetrics.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief Enables collection of event loop metrics by EventQueueFeature,
+ * EventLoopFeature and TimersFeature. Machines without this MFeature do not
+ * measure anything.
+ *
+ * @note The LoopMetricsFeature must be placed below the EventQueueFeature
+ * in the Machine stack.
+ */
+template<class Next>
+class LoopMetricsFeature : public Next {
+    LoopMetrics _loopMetrics;
+public:
+    /**
+     * @brief Get the event loop metrics. The metrics can be read from any thread.
+     *
+     * @return The metrics
+     */
+    LoopMetrics& loopMetrics() {
+        return _loopMetrics;
+    }
+};
+
+
+} // namespace jac
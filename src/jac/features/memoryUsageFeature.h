@@ -0,0 +1,116 @@
+#pragma once
+
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/heapSnapshot.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/memoryStats.h>
+#include <jac/machine/values.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <optional>
+
+
+namespace jac {
+
+
+/**
+ * @brief Provides `process.memoryUsage()`, `process.heapSnapshot()` and
+ * periodic sampling of the machine memory usage on the event loop.
+ *
+ * @note The MemoryUsageFeature must be placed above the EventLoopFeature
+ * in the Machine stack.
+ */
+template<class Next>
+class MemoryUsageFeature : public Next {
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex _samplerMutex;
+    std::chrono::milliseconds _sampleInterval = std::chrono::milliseconds(0);
+    std::function<void(const MemoryStats&)> _sampleSink;
+    Clock::time_point _nextSample;
+
+public:
+    /**
+     * @brief Periodically compute the memory usage of the machine and pass it
+     * to the sink. The sink is called on the event loop thread, the first
+     * sample is taken immediately.
+     *
+     * @note May be called from any thread, a waiting event loop is woken up
+     *
+     * @param interval interval between samples, zero disables sampling
+     * @param sink the function receiving the samples
+     */
+    void setMemorySampler(std::chrono::milliseconds interval, std::function<void(const MemoryStats&)> sink) {
+        {
+            std::lock_guard<std::mutex> lock(_samplerMutex);
+            _sampleInterval = interval;
+            _sampleSink = interval.count() > 0 ? std::move(sink) : nullptr;
+            _nextSample = Clock::now();
+        }
+        this->notifyEventLoop();
+    }
+
+    void initialize() {
+        Next::initialize();
+
+        FunctionFactory ff(this->context());
+        Object global = this->context().getGlobalObject();
+
+        Object process = global.hasProperty("process") ? global.get<Object>("process") : Object::create(this->context());
+        process.set("memoryUsage", ff.newFunction([this]() {
+            MemoryStats stats = this->memoryStats();
+
+            Object usage = Object::create(this->context());
+            usage.set("heapTotal", static_cast<double>(stats.mallocSize));
+            usage.set("heapUsed", static_cast<double>(stats.memoryUsedSize));
+            usage.set("external", static_cast<double>(stats.binaryObjectSize));
+            usage.set("arrayBuffers", static_cast<double>(stats.binaryObjectSize));
+            usage.set("objects", static_cast<double>(stats.objectCount));
+            usage.set("strings", static_cast<double>(stats.stringCount));
+            usage.set("functions", static_cast<double>(stats.functionCount));
+            return usage;
+        }));
+        process.set("heapSnapshot", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            std::vector<std::pair<std::string, ValueWeak>> roots;
+            if (!args.empty() && args[0].isObject()) {
+                roots.emplace_back("roots", args[0]);
+            }
+            return HeapSnapshot::take(this->context(), roots).toJson();
+        }));
+        global.defineProperty("process", process, PropFlags::Enumerable);
+    }
+
+    void onEventLoop() {
+        std::function<void(const MemoryStats&)> sink;
+        {
+            std::lock_guard<std::mutex> lock(_samplerMutex);
+            auto now = Clock::now();
+            if (_sampleSink && now >= _nextSample) {
+                _nextSample = now + _sampleInterval;
+                // called without the lock, so the sink may replace the sampler
+                sink = _sampleSink;
+            }
+        }
+        if (sink) {
+            sink(this->memoryStats());
+        }
+        Next::onEventLoop();
+    }
+
+    std::optional<Clock::time_point> nextDeadline() {
+        auto deadline = Next::nextDeadline();
+        std::lock_guard<std::mutex> lock(_samplerMutex);
+        if (!_sampleSink) {
+            return deadline;
+        }
+        if (!deadline || _nextSample < *deadline) {
+            return _nextSample;
+        }
+        return deadline;
+    }
+};
+
+
+} // namespace jac
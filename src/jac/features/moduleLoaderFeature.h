@@ -13,6 +13,7 @@ private:
         auto &self = *static_cast<ModuleLoaderFeature<Next>*>(_self);
 
         std::string filename = module_name;
+        TraceSpan span(self.tracer(), "module", filename);
 
         std::string buffer;
         try {
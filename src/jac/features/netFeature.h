@@ -0,0 +1,163 @@
+#pragma once
+
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include "util/socket.h"
+
+
+namespace jac {
+
+
+#ifdef __linux__
+
+/**
+ * @brief Adds the "net" module with non-blocking TCP and Unix domain
+ * sockets driven by the I/O reactor of the event loop.
+ *
+ * The sockets are exposed as objects with a `readable` and a `writable`
+ * stream, so all operations of the streams (including backpressure and
+ * binary reads) are available on them.
+ *
+ * @note Requires the IoReactorFeature and the BasicStreamFeature.
+ */
+template<class Next>
+class NetFeature : public Next {
+    std::shared_ptr<SocketRegistry> _sockets;
+
+protected:
+    /**
+     * @brief Parse an address object with a `path`, or a `port` and an optional `host`
+     */
+    static SocketAddress parseAddress(ValueWeak options) {
+        Object options_ = options.to<Object>();
+        Value path = options_.get<Value>("path");
+        if (!path.isUndefined()) {
+            return SocketAddress::local(path.to<std::string>());
+        }
+
+        Value port = options_.get<Value>("port");
+        if (port.isUndefined()) {
+            throw Exception::create(Exception::Type::TypeError, "Expected a port or a path");
+        }
+        Value host = options_.get<Value>("host");
+        try {
+            return SocketAddress::tcp(host.isUndefined() ? "127.0.0.1" : host.to<std::string>(), port.to<int>());
+        }
+        catch (std::invalid_argument& e) {
+            throw Exception::create(Exception::Type::RangeError, e.what());
+        }
+    }
+
+    /**
+     * @brief Create the JavaScript object of a listening server. Errors of
+     * accepting connections are passed to its `onerror` property, if set.
+     */
+    Object wrapServer(std::shared_ptr<SocketServer> server) {
+        FunctionFactory ff(this->context());
+        Object result = Object::create(this->context());
+        result.set("port", server->port());
+        result.set("close", ff.newFunction([server]() {
+            server->close();
+        }));
+        // the callback is released when the server is closed
+        server->onError([result](const std::system_error& e) mutable {
+            Value onError = result.get<Value>("onerror");
+            if (onError.isFunction()) {
+                onError.to<Function>().call<void>(Exception::create(Exception::Type::Error, e.what()));
+            }
+        });
+        return result;
+    }
+
+private:
+    Object wrapSocket(std::shared_ptr<Socket> socket) {
+        FunctionFactory ff(this->context());
+        Object result = Object::create(this->context());
+        result.set("readable", Next::ReadableClass::createInstance(this->context(), new SocketReadable(socket)));
+        result.set("writable", Next::WritableClass::createInstance(this->context(), new SocketWritable(socket)));
+        result.set("end", ff.newFunction([socket]() {
+            socket->end();
+        }));
+        result.set("close", ff.newFunction([socket]() {
+            socket->close();
+        }));
+        return result;
+    }
+
+public:
+    void initialize() {
+        Next::initialize();
+
+        _sockets = std::make_shared<SocketRegistry>(this->ioReactor());
+
+        FunctionFactory ff(this->context());
+        auto& mdl = this->newModule("net");
+
+        mdl.addExport("connect", ff.newFunction([this](ValueWeak options) {
+            SocketAddress address = parseAddress(options);
+            ContextRef ctx = this->context();
+            auto [promise, resolve, reject] = Promise::create(ctx);
+
+            Socket::connect(_sockets, address, [this, resolve_ = resolve, reject_ = reject](std::shared_ptr<Socket> socket, std::string error) mutable {
+                if (!socket) {
+                    reject_.call<void>(Exception::create(Exception::Type::Error, "Cannot connect: " + error));
+                    return;
+                }
+                resolve_.call<void>(wrapSocket(std::move(socket)));
+            });
+
+            return promise;
+        }));
+
+        // the server keeps accepting connections until it is closed, even if its object is collected
+        mdl.addExport("listen", ff.newFunction([this](ValueWeak options, Function onConnection) {
+            SocketAddress address = parseAddress(options);
+
+            std::shared_ptr<SocketServer> server;
+            try {
+                server = SocketServer::listen(_sockets, address, [this, onConnection](std::shared_ptr<Socket> socket) mutable {
+                    onConnection.call<void>(wrapSocket(std::move(socket)));
+                });
+            }
+            catch (std::system_error& e) {
+                throw Exception::create(Exception::Type::Error, e.what());
+            }
+
+            return wrapServer(std::move(server));
+        }));
+    }
+
+    /**
+     * @brief Get the registry of the machine's sockets, used by features
+     * built on top of the sockets
+     */
+    std::shared_ptr<SocketRegistry> socketRegistry() {
+        return _sockets;
+    }
+
+    /**
+     * @brief Get the number of open sockets and listening servers
+     */
+    size_t openSockets() {
+        return _sockets ? _sockets->size() : 0;
+    }
+
+    ~NetFeature() {
+        // the sockets hold JavaScript callbacks and are registered with the reactor,
+        // both are destroyed after this feature
+        if (_sockets) {
+            _sockets->detachAll();
+        }
+    }
+};
+
+#endif
+
+
+} // namespace jac
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace jac {
+
+
+/**
+ * @brief Provides promises which can be completed from any thread.
+ *
+ * The resolving functions of the promise stay in the machine, the native
+ * code only holds a PendingPromise handle. Completions are converted to
+ * JavaScript values and applied on the event loop thread. Completions
+ * from many handles are applied in a single event loop wakeup.
+ *
+ * @note The PendingPromiseFeature must be placed above the EventLoopFeature
+ * in the Machine stack.
+ */
+template<class Next>
+class PendingPromiseFeature : public Next {
+    using Completion = std::function<void(ContextRef ctx, Function& resolve, Function& reject)>;
+
+    struct Batch {
+        std::mutex mutex;
+        std::vector<std::pair<uint64_t, Completion>> completions;
+        std::function<void()> notify;
+    };
+
+public:
+    /**
+     * @brief A handle to a pending promise. Can be moved between threads
+     * and completed from any of them. The handle can outlive the machine,
+     * the completion is then ignored.
+     *
+     * If the handle is destroyed without being completed, the promise is
+     * rejected.
+     */
+    class PendingPromise {
+        std::shared_ptr<Batch> _batch;
+        uint64_t _id = 0;
+
+        void complete(Completion completion) {
+            if (!_batch) {
+                return;
+            }
+            auto batch = std::move(_batch);
+
+            std::function<void()> notify;
+            {
+                std::scoped_lock lock(batch->mutex);
+                if (!batch->notify) {
+                    // the machine was destroyed
+                    return;
+                }
+                if (batch->completions.empty()) {
+                    notify = batch->notify;
+                }
+                batch->completions.emplace_back(_id, std::move(completion));
+            }
+
+            if (notify) {
+                notify();
+            }
+        }
+
+    public:
+        PendingPromise() = default;
+        PendingPromise(std::shared_ptr<Batch> batch, uint64_t id) : _batch(std::move(batch)), _id(id) {}
+
+        PendingPromise(const PendingPromise&) = delete;
+        PendingPromise& operator=(const PendingPromise&) = delete;
+
+        PendingPromise(PendingPromise&& other) noexcept : _batch(std::move(other._batch)), _id(other._id) {}
+        PendingPromise& operator=(PendingPromise&& other) noexcept {
+            if (this != &other) {
+                abandon();
+                _batch = std::move(other._batch);
+                _id = other._id;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Resolve the promise with the given value. The value is
+         * converted to a JavaScript value on the event loop thread.
+         *
+         * @tparam T type of the value, must be convertible using ConvTraits
+         * @param value the value
+         */
+        template<typename T>
+        void resolve(T value) {
+            complete([value = std::move(value)](ContextRef ctx, Function& resolve_, Function&) mutable {
+                resolve_.call<void>(Value::from(ctx, std::move(value)));
+            });
+        }
+
+        /**
+         * @brief Resolve the promise with undefined
+         */
+        void resolve() {
+            complete([](ContextRef, Function& resolve_, Function&) {
+                resolve_.call<void>();
+            });
+        }
+
+        /**
+         * @brief Reject the promise with a new error
+         *
+         * @param message the error message
+         * @param type the error type
+         */
+        void reject(std::string message, Exception::Type type = Exception::Type::Error) {
+            complete([message = std::move(message), type](ContextRef ctx, Function&, Function& reject_) {
+                Exception::create(type, message).throwJS(ctx);
+                Exception error = ctx.getException();
+                reject_.call<void>(static_cast<Value&>(error));
+            });
+        }
+
+        /**
+         * @brief Check if the promise has not been completed yet
+         *
+         * @return true if the promise can be completed using this handle
+         */
+        bool pending() const {
+            return static_cast<bool>(_batch);
+        }
+
+        void abandon() {
+            if (_batch) {
+                reject("Pending promise was abandoned");
+            }
+        }
+
+        ~PendingPromise() {
+            abandon();
+        }
+    };
+
+private:
+    std::shared_ptr<Batch> _batch = std::make_shared<Batch>();
+    std::unordered_map<uint64_t, std::pair<Function, Function>> _pendingPromises;
+    uint64_t _nextPromiseId = 1;
+
+    void completePending() {
+        std::vector<std::pair<uint64_t, Completion>> completions;
+        {
+            std::scoped_lock lock(_batch->mutex);
+            completions.swap(_batch->completions);
+        }
+
+        for (auto& [id, completion] : completions) {
+            auto it = _pendingPromises.find(id);
+            if (it == _pendingPromises.end()) {
+                continue;
+            }
+            auto [resolve, reject] = std::move(it->second);
+            _pendingPromises.erase(it);
+
+            completion(this->context(), resolve, reject);
+        }
+    }
+
+public:
+    /**
+     * @brief Create a new promise which can be completed from any thread
+     * @note Must be called from the event loop thread
+     *
+     * @return The promise to be returned to JavaScript and its handle
+     */
+    std::pair<Promise, PendingPromise> createPendingPromise() {
+        auto [promise, resolve, reject] = Promise::create(this->context());
+
+        uint64_t id = _nextPromiseId++;
+        _pendingPromises.emplace(id, std::make_pair(std::move(resolve), std::move(reject)));
+
+        return { std::move(promise), PendingPromise(_batch, id) };
+    }
+
+    /**
+     * @brief Get the number of promises which have not been completed yet
+     * @note Must be called from the event loop thread
+     *
+     * @return The number of promises
+     */
+    size_t pendingPromiseCount() const {
+        return _pendingPromises.size();
+    }
+
+    void initialize() {
+        Next::initialize();
+
+        std::scoped_lock lock(_batch->mutex);
+        _batch->notify = [this]() {
+            this->notifyEventLoop();
+        };
+    }
+
+    void onEventLoop() {
+        completePending();
+        Next::onEventLoop();
+    }
+
+    ~PendingPromiseFeature() {
+        {
+            std::scoped_lock lock(_batch->mutex);
+            _batch->notify = nullptr;
+            _batch->completions.clear();
+        }
+        _pendingPromises.clear();
+    }
+};
+
+
+} // namespace jac
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace jac {
+
+
+/**
+ * @brief Provides the `performance` object with a monotonic high-resolution
+ * clock and user timing marks and measures.
+ *
+ * Measures recorded by `performance.measure` are also stored in a bounded
+ * buffer, which can be drained from native code from any thread.
+ */
+template<class Next>
+class PerformanceFeature : public Next {
+public:
+    /**
+     * @brief A measure recorded by `performance.measure`
+     */
+    struct PerformanceMeasure {
+        std::string name;
+        /** @brief Start relative to the time origin in milliseconds */
+        double startTime;
+        /** @brief Duration in milliseconds */
+        double duration;
+    };
+
+private:
+    std::chrono::steady_clock::time_point _timeOrigin = std::chrono::steady_clock::now();
+    double _wallTimeOrigin = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    std::unordered_map<std::string, double> _marks;
+
+    std::deque<PerformanceMeasure> _measures;
+    size_t _measureBufferSize = 1024;
+    size_t _droppedMeasures = 0;
+    std::mutex _measuresMutex;
+
+    double markTime(ValueWeak value, double defaultTime) {
+        if (value.isUndefined()) {
+            return defaultTime;
+        }
+        if (JS_IsNumber(value.getVal())) {
+            return value.to<double>();
+        }
+
+        auto name = value.to<std::string>();
+        auto it = _marks.find(name);
+        if (it == _marks.end()) {
+            throw Exception::create(Exception::Type::SyntaxError, "performance.measure: mark '" + name + "' does not exist");
+        }
+        return it->second;
+    }
+
+public:
+    /**
+     * @brief Get the time elapsed since the machine was created
+     *
+     * @return The time in milliseconds, with sub-microsecond resolution
+     */
+    double now() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _timeOrigin).count();
+    }
+
+    /**
+     * @brief Take all recorded measures out of the buffer
+     * @note Can be called from any thread
+     *
+     * @return The measures in the order they were recorded
+     */
+    std::vector<PerformanceMeasure> drainMeasures() {
+        std::scoped_lock lock(_measuresMutex);
+        std::vector<PerformanceMeasure> result(std::make_move_iterator(_measures.begin()), std::make_move_iterator(_measures.end()));
+        _measures.clear();
+        return result;
+    }
+
+    /**
+     * @brief Set the maximum number of measures kept in the buffer. When the
+     * buffer is full, the oldest measures are discarded.
+     *
+     * @param size the maximum number of measures
+     */
+    void setMeasureBufferSize(size_t size) {
+        std::scoped_lock lock(_measuresMutex);
+        _measureBufferSize = size;
+        while (_measures.size() > _measureBufferSize) {
+            _measures.pop_front();
+            _droppedMeasures++;
+        }
+    }
+
+    /**
+     * @brief Get the number of measures discarded because the buffer was full
+     *
+     * @return The number of measures
+     */
+    size_t droppedMeasures() {
+        std::scoped_lock lock(_measuresMutex);
+        return _droppedMeasures;
+    }
+
+    void initialize() {
+        Next::initialize();
+
+        FunctionFactory ff(this->context());
+
+        Object performance = Object::create(this->context());
+        performance.set("timeOrigin", _wallTimeOrigin);
+        performance.set("now", ff.newFunction([this]() {
+            return now();
+        }));
+        performance.set("mark", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            if (args.empty()) {
+                throw Exception::create(Exception::Type::TypeError, "performance.mark: name is required");
+            }
+            auto name = args[0].to<std::string>();
+            double time = now();
+            _marks[name] = time;
+
+            Object mark = Object::create(this->context());
+            mark.set("name", name);
+            mark.set("entryType", std::string("mark"));
+            mark.set("startTime", time);
+            mark.set("duration", 0.0);
+            return mark;
+        }));
+        performance.set("measure", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            if (args.empty()) {
+                throw Exception::create(Exception::Type::TypeError, "performance.measure: name is required");
+            }
+            auto name = args[0].to<std::string>();
+            double end = now();
+            double start = args.size() > 1 ? markTime(args[1], 0) : 0;
+            if (args.size() > 2) {
+                end = markTime(args[2], end);
+            }
+
+            {
+                std::scoped_lock lock(_measuresMutex);
+                if (_measureBufferSize > 0) {
+                    if (_measures.size() >= _measureBufferSize) {
+                        _measures.pop_front();
+                        _droppedMeasures++;
+                    }
+                    _measures.push_back({ name, start, end - start });
+                }
+            }
+
+            Object measure = Object::create(this->context());
+            measure.set("name", name);
+            measure.set("entryType", std::string("measure"));
+            measure.set("startTime", start);
+            measure.set("duration", end - start);
+            return measure;
+        }));
+        performance.set("clearMarks", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            if (args.empty() || args[0].isUndefined()) {
+                _marks.clear();
+            }
+            else {
+                _marks.erase(args[0].to<std::string>());
+            }
+        }));
+
+        Object global = this->context().getGlobalObject();
+        global.defineProperty("performance", performance, PropFlags::Enumerable);
+    }
+};
+
+
+} // namespace jac
@@ -4,10 +4,15 @@
 #include <jac/machine/machine.h>
 #include <jac/machine/values.h>
 
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "types/streams.h"
+#include "util/bufferedWritable.h"
+#include "util/inspect.h"
 
 namespace jac {
 
@@ -21,8 +26,31 @@ private:
         std::unique_ptr<Writable> err;
         std::unique_ptr<Readable> in;
     };
+
+    std::string formatConsole(std::vector<ValueWeak>& args) {
+        std::string line;
+        Inspector(this->context(), line, this->consoleOptions).format(args);
+        return line;
+    }
+
+    void writeError(std::string str) {
+        // keep the order of buffered output and errors
+        if (this->stdio.out) {
+            this->stdio.out->flush();
+        }
+        this->stdio.err->writeLine(std::move(str));
+        this->stdio.err->flush();
+    }
+
+    static BufferedWritable* buffered(Writable* writable) {
+        return dynamic_cast<BufferedWritable*>(writable);
+    }
 public:
     Stdio stdio;
+    /**
+     * @brief Options of formatting the arguments of the console functions
+     */
+    InspectOptions consoleOptions;
 
     void initialize() {
         Next::initialize();
@@ -37,20 +65,20 @@ public:
         }
 
         Object console = Object::create(this->context());
-        console.set("debug", ff.newFunction([this](std::string str) {
-            this->stdio.out->write(str + "\n");
+        console.set("debug", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            this->stdio.out->writeLine(this->formatConsole(args));
         }));
-        console.set("log", ff.newFunction([this](std::string str) {
-            this->stdio.out->write(str + "\n");
+        console.set("log", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            this->stdio.out->writeLine(this->formatConsole(args));
         }));
-        console.set("info", ff.newFunction([this](std::string str) {
-            this->stdio.out->write(str + "\n");
+        console.set("info", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            this->stdio.out->writeLine(this->formatConsole(args));
         }));
-        console.set("warn", ff.newFunction([this](std::string str) {
-            this->stdio.err->write(str + "\n");
+        console.set("warn", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            this->writeError(this->formatConsole(args));
         }));
-        console.set("error", ff.newFunction([this](std::string str) {
-            this->stdio.err->write(str + "\n");
+        console.set("error", ff.newFunctionVariadic([this](std::vector<ValueWeak> args) {
+            this->writeError(this->formatConsole(args));
         }));
         Object global = this->context().getGlobalObject();
         global.defineProperty("console", console);
@@ -62,6 +90,28 @@ public:
             mdl.addExport("stdin", Next::ReadableClass::createInstance(this->context(), new ReadableRef(stdio.in.get())));
         }
     }
+
+    // buffered output is flushed by the event loop once it reaches the flush interval
+    void onEventLoop() {
+        for (Writable* writable : { stdio.out.get(), stdio.err.get() }) {
+            if (auto output = buffered(writable)) {
+                output->flushIfDue();
+            }
+        }
+        Next::onEventLoop();
+    }
+
+    std::optional<std::chrono::steady_clock::time_point> nextDeadline() {
+        auto deadline = Next::nextDeadline();
+        for (Writable* writable : { stdio.out.get(), stdio.err.get() }) {
+            auto output = buffered(writable);
+            auto flush = output ? output->flushDeadline() : std::nullopt;
+            if (flush && (!deadline || *flush < *deadline)) {
+                deadline = flush;
+            }
+        }
+        return deadline;
+    }
 };
 
 
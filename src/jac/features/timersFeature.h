@@ -3,13 +3,16 @@
 #include <jac/machine/functionFactory.h>
 #include <jac/machine/machine.h>
 
-#include <atomic>
 #include <chrono>
-#include <condition_variable>
 #include <mutex>
+#include <optional>
 #include <queue>
-#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "util/eventPriority.h"
+#include "util/loopMetrics.h"
 
 
 namespace jac {
@@ -26,26 +29,54 @@ struct ConvTraits<std::chrono::milliseconds> {
     }
 };
 
+/**
+ * @brief Scheduling mode of repeating timers
+ */
+enum class IntervalMode {
+    /**
+     * @brief The next period starts after the callback finishes (default)
+     */
+    FixedDelay,
+    /**
+     * @brief The next deadline is computed from the previous deadline,
+     * missed periods are fired back-to-back to catch up
+     */
+    FixedRate,
+    /**
+     * @brief The next deadline is computed from the previous deadline,
+     * missed periods are skipped
+     */
+    FixedRateSkip
+};
+
+
+/**
+ * @note Timers are dispatched by the event loop, the TimersFeature must be
+ * placed above the EventLoopFeature in the Machine stack.
+ */
 template<class Next>
 class TimersFeature : public Next {
 private:
     class Timer {
     private:
-        std::chrono::time_point<std::chrono::steady_clock> _startTime;
+        std::chrono::time_point<std::chrono::steady_clock> _endTime;
         std::chrono::milliseconds _duration;
         std::function<void()> _callback;
         int _id;
         bool _isRepeating = false;
+        IntervalMode _mode = IntervalMode::FixedDelay;
         bool cancelled = false;
 
     public:
-        Timer(std::function<void()> callback, std::chrono::milliseconds duration, int id, bool isRepeating = false):
+        Timer(std::function<void()> callback, std::chrono::milliseconds duration, int id, bool isRepeating = false,
+              IntervalMode mode = IntervalMode::FixedDelay):
             _duration(duration),
             _callback(callback),
             _id(id),
-            _isRepeating(isRepeating)
+            _isRepeating(isRepeating),
+            _mode(mode)
         {
-            _startTime = std::chrono::steady_clock::now();
+            _endTime = std::chrono::steady_clock::now() + _duration;
         }
 
         bool operator<(const Timer& other) const {
@@ -53,8 +84,19 @@ private:
         }
 
         void update() {
-            if (_isRepeating) {
-                _startTime = std::chrono::steady_clock::now();
+            if (!_isRepeating) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (_mode == IntervalMode::FixedDelay || _duration.count() <= 0) {
+                _endTime = now + _duration;
+                return;
+            }
+
+            _endTime += _duration;
+            if (_mode == IntervalMode::FixedRateSkip && _endTime <= now) {
+                auto missed = (now - _endTime) / _duration + 1;
+                _endTime += missed * _duration;
             }
         }
 
@@ -63,7 +105,7 @@ private:
         }
 
         std::chrono::time_point<std::chrono::steady_clock> getEndTime() const {
-            return _startTime + _duration;
+            return _endTime;
         }
 
         bool isRepeating() const {
@@ -93,20 +135,33 @@ private:
     std::priority_queue<std::shared_ptr<Timer>, std::vector<std::shared_ptr<Timer>>, CompareTimer> _timers;
     std::unordered_map<int, std::shared_ptr<Timer>> _timersById;
     std::mutex _timersMutex;
-    std::condition_variable _timersCondition;
-    std::thread _timerThread;
-    std::atomic<bool> _stop = false;
+
+    IntervalMode _intervalMode = IntervalMode::FixedDelay;
+    std::chrono::microseconds _coalescingWindow = std::chrono::microseconds(0);
+    EventPriority _priority = EventPriority::Normal;
 
     int nextId = 1;
 
+    std::unordered_set<int> _immediates;
+    int _nextImmediateId = 1;
+
+    static JSValue runMicrotask(JSContext* ctx, int, JSValueConst* argv) {
+        return JS_Call(ctx, argv[0], JS_UNDEFINED, 0, nullptr);
+    }
+
     int createTimer(std::function<void()> func, std::chrono::milliseconds millis, bool isRepeating) {
-        std::lock_guard<std::mutex> lock(_timersMutex);
-        auto timer = std::make_shared<Timer>(func, millis, nextId++, isRepeating);
-        _timers.emplace(timer);
-        _timersById[nextId - 1] = std::move(timer);
+        int id;
+        {
+            std::lock_guard<std::mutex> lock(_timersMutex);
+            id = nextId++;
+            auto timer = std::make_shared<Timer>(func, millis, id, isRepeating, _intervalMode);
+            _timers.emplace(timer);
+            _timersById[id] = std::move(timer);
+        }
 
-        _timersCondition.notify_one();
-        return nextId - 1;
+        // the event loop has to recompute its deadline
+        this->notifyEventLoop();
+        return id;
     }
 
     void clearTimer(int id) {
@@ -116,6 +171,103 @@ private:
             it->second->cancel();
         }
     }
+
+    void fireTimer(const std::shared_ptr<Timer>& timer) {
+        if (timer->isCancelled()) {
+            std::lock_guard<std::mutex> lock(_timersMutex);
+            _timersById.erase(timer->getId());
+            return;
+        }
+        TraceSpan span(this->tracer(), "timer", timer->isRepeating() ? "interval" : "timeout");
+        if constexpr (HasLoopMetrics<Next>) {
+            this->loopMetrics().loopLag.record(LoopMetrics::micros(std::chrono::steady_clock::now() - timer->getEndTime()));
+        }
+        try {
+            timer->getCallback()();
+        }
+        catch (...) {
+            // an interval keeps running even if its callback throws
+            reschedule(timer);
+            throw;
+        }
+        reschedule(timer);
+    }
+
+    void reschedule(const std::shared_ptr<Timer>& timer) {
+        std::lock_guard<std::mutex> lock(_timersMutex);
+        if (timer->isRepeating() && !timer->isCancelled()) {
+            timer->update();
+            _timers.push(timer);
+        }
+        else {
+            _timersById.erase(timer->getId());
+        }
+    }
+
+    /**
+     * @brief Get the time at which the expired timers should be dispatched.
+     * Timers expiring within the coalescing window after the earliest one
+     * form a group which is dispatched at the deadline of its last timer.
+     * @note Must be called with the timers mutex locked
+     */
+    std::optional<std::chrono::steady_clock::time_point> wakeupTime() {
+        while (!_timers.empty() && _timers.top()->isCancelled()) {
+            _timersById.erase(_timers.top()->getId());
+            _timers.pop();
+        }
+        if (_timers.empty()) {
+            return std::nullopt;
+        }
+        auto wakeup = _timers.top()->getEndTime();
+        if (_coalescingWindow.count() <= 0) {
+            return wakeup;
+        }
+
+        auto limit = wakeup + _coalescingWindow;
+        std::vector<std::shared_ptr<Timer>> group;
+        while (!_timers.empty() && _timers.top()->getEndTime() <= limit) {
+            wakeup = _timers.top()->getEndTime();
+            group.push_back(_timers.top());
+            _timers.pop();
+        }
+        for (auto& timer : group) {
+            _timers.push(std::move(timer));
+        }
+        return wakeup;
+    }
+
+    void dispatchExpired() {
+        std::vector<std::shared_ptr<Timer>> expired;
+        EventPriority priority;
+        {
+            std::lock_guard<std::mutex> lock(_timersMutex);
+            priority = _priority;
+            auto now = std::chrono::steady_clock::now();
+            auto wakeup = wakeupTime();
+            if (!wakeup || *wakeup > now) {
+                return;
+            }
+
+            while (!_timers.empty() && _timers.top()->getEndTime() <= now) {
+                auto timer = _timers.top();
+                _timers.pop();
+
+                if (timer->isCancelled()) {
+                    _timersById.erase(timer->getId());
+                    continue;
+                }
+                expired.push_back(std::move(timer));
+            }
+        }
+
+        // every timer is a separate event, so that jobs run between the callbacks
+        // and an exception thrown by one callback does not drop the others
+        for (auto& timer : expired) {
+            this->scheduleEvent([this, timer = std::move(timer)]() {
+                fireTimer(timer);
+            }, priority);
+        }
+    }
 public:
     int setInterval(std::function<void()> func, std::chrono::milliseconds millis) {
         return createTimer(func, millis, true);
@@ -133,59 +285,89 @@ public:
         clearTimer(id);
     }
 
-    void initialize() {
-        Next::initialize();
+    /**
+     * @brief Schedule a function to run in a future turn of the event loop,
+     * after the pending jobs, without going through the timers
+     * @note Must be called from the event loop thread
+     *
+     * @param func the function
+     * @return id of the immediate
+     */
+    int setImmediate(std::function<void()> func) {
+        int id = _nextImmediateId++;
+        _immediates.insert(id);
+        this->scheduleEvent([this, id, func = std::move(func)]() {
+            if (_immediates.erase(id) > 0) {
+                func();
+            }
+        });
+        return id;
+    }
 
-        _stop = false;
-        _timerThread = std::thread([this]() {
-            while (!_stop) {
-                std::unique_lock<std::mutex> lock(_timersMutex);
-                if (_timers.empty()) {
-                    _timersCondition.wait(lock);
-                    if (_timers.empty()) {
-                        continue;
-                    }
-                }
+    /**
+     * @brief Cancel an immediate created by setImmediate
+     * @note Must be called from the event loop thread
+     *
+     * @param id id of the immediate
+     */
+    void clearImmediate(int id) {
+        _immediates.erase(id);
+    }
 
-                auto timer = _timers.top();
+    /**
+     * @brief Set the scheduling mode of intervals created after this call
+     *
+     * @param mode the interval mode
+     */
+    void setIntervalMode(IntervalMode mode) {
+        std::lock_guard<std::mutex> lock(_timersMutex);
+        _intervalMode = mode;
+    }
 
-                if (timer->getEndTime() > std::chrono::steady_clock::now()) {
-                    _timersCondition.wait_until(lock, timer->getEndTime());
-                    continue;
-                }
+    /**
+     * @brief Set the timer coalescing window. Timers expiring within the window
+     * after the earliest one are dispatched in the same event loop wakeup at
+     * the deadline of the last of them, so timers may fire up to the window
+     * late, but never early. Zero disables coalescing.
+     *
+     * @param window the coalescing window
+     */
+    void setTimerCoalescing(std::chrono::microseconds window) {
+        {
+            std::lock_guard<std::mutex> lock(_timersMutex);
+            _coalescingWindow = window;
+        }
+        this->notifyEventLoop();
+    }
 
-                _timers.pop();
+    /**
+     * @brief Set the priority of events which dispatch expired timers
+     *
+     * @param priority the event priority
+     */
+    void setTimerPriority(EventPriority priority) {
+        std::lock_guard<std::mutex> lock(_timersMutex);
+        _priority = priority;
+    }
 
-                if (timer->isCancelled()) {
-                    int id = timer->getId();
-                    _timersById.erase(id);
-                    continue;
-                }
+    void onEventLoop() {
+        dispatchExpired();
+        Next::onEventLoop();
+    }
 
-                lock.unlock();
-
-                this->scheduleEvent([timer, this]() mutable {
-                    if (timer->isCancelled()) {
-                        std::lock_guard<std::mutex> lock_(_timersMutex);
-                        int id = timer->getId();
-                        _timersById.erase(id);
-                        return;
-                    }
-                    timer->getCallback()();
-
-                    std::lock_guard<std::mutex> lock_(_timersMutex);
-                    if (timer->isRepeating()) {
-                        timer->update();
-                        _timers.push(timer);
-                        _timersCondition.notify_one();
-                    }
-                    else {
-                        int id = timer->getId();
-                        _timersById.erase(id);
-                    }
-                });
-            }
-        });
+    std::optional<std::chrono::steady_clock::time_point> nextDeadline() {
+        auto deadline = Next::nextDeadline();
+
+        std::lock_guard<std::mutex> lock(_timersMutex);
+        auto wakeup = wakeupTime();
+        if (wakeup && (!deadline || *wakeup < *deadline)) {
+            deadline = wakeup;
+        }
+        return deadline;
+    }
+
+    void initialize() {
+        Next::initialize();
 
         FunctionFactory ff(this->context());
         Object global = this->context().getGlobalObject();
@@ -210,6 +392,26 @@ public:
             clearTimeout(id);
         }), PropFlags::Enumerable);
 
+        global.defineProperty("setImmediate", ff.newFunction([this](Function func) {
+            return setImmediate([func]() mutable {
+                func.call<void>();
+            });
+        }), PropFlags::Enumerable);
+
+        global.defineProperty("clearImmediate", ff.newFunction([this](int id) {
+            clearImmediate(id);
+        }), PropFlags::Enumerable);
+
+        global.defineProperty("queueMicrotask", ff.newFunction([this](ValueWeak callback) {
+            ContextRef ctx = this->context();
+            if (!JS_IsFunction(ctx, callback.getVal())) {
+                throw Exception::create(Exception::Type::TypeError, "queueMicrotask: callback is not a function");
+            }
+            if (JS_EnqueueJob(ctx, &runMicrotask, 1, &callback.getVal()) < 0) {
+                throw ctx.getException();
+            }
+        }), PropFlags::Enumerable);
+
         global.defineProperty("sleep", ff.newFunction([this](int millis) {
             auto [promise, resolve, _] = Promise::create(this->context());
             setTimeout([resolve_ = resolve]() mutable {
@@ -220,16 +422,9 @@ public:
     }
 
     ~TimersFeature() {
-        {
-            std::scoped_lock lock(_timersMutex);
-            _timers = {};
-        }
-        _stop = true;
-        _timersCondition.notify_one();
-
-        if (_timerThread.joinable()) {
-            _timerThread.join();
-        }
+        std::scoped_lock lock(_timersMutex);
+        _timers = {};
+        _timersById.clear();
     }
 };
 
@@ -1,24 +1,283 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <exception>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <vector>
 
 
 namespace jac {
 
 
 class Writable {
+    size_t _highWaterMark = 16 * 1024;
 public:
     virtual void write(std::string data) = 0;
 
+    /**
+     * @brief Write binary data. The data is only borrowed for the duration
+     * of the call, implementations should override this to avoid copying it
+     * into a string.
+     */
+    virtual void write(std::span<const uint8_t> data) {
+        write(std::string(reinterpret_cast<const char*>(data.data()), data.size()));
+    }
+
+    /**
+     * @brief Write the data followed by a newline
+     */
+    virtual void writeLine(std::string data) {
+        data.push_back('\n');
+        write(std::move(data));
+    }
+
+    /**
+     * @brief Write out any buffered data
+     */
+    virtual void flush() {}
+
+    /**
+     * @brief Get the number of bytes accepted by write but not yet written out
+     */
+    virtual size_t writableLength() {
+        return 0;
+    }
+
+    /**
+     * @brief Get the number of pending bytes above which the producer should
+     * stop writing and wait for the drain
+     */
+    virtual size_t highWaterMark() {
+        return _highWaterMark;
+    }
+
+    virtual void setHighWaterMark(size_t bytes) {
+        _highWaterMark = bytes;
+    }
+
+    /**
+     * @brief Check if the producer should wait for the drain before writing more
+     */
+    bool needsDrain() {
+        return writableLength() >= highWaterMark();
+    }
+
+    /**
+     * @brief Call the callback once the pending data drop below the high-water
+     * mark. The callback must be called on the thread running the machine.
+     */
+    virtual void onDrain(std::function<void()> callback) {
+        callback();
+    }
+
     virtual ~Writable() = default;
 };
 
 
 class Readable {
+    // data read from the stream but not yet consumed by readSome or readLine
+    std::string _readAhead;
+    size_t _readAheadPos = 0;
+    // the stream ended after readLine returned the rest of the data as the last line
+    bool _endPending = false;
+
+    bool hasReadAhead() const {
+        return _readAheadPos < _readAhead.size();
+    }
+
+    std::string takeReadAhead(size_t maxBytes) {
+        size_t size = std::min(maxBytes, _readAhead.size() - _readAheadPos);
+        std::string result = _readAhead.substr(_readAheadPos, size);
+        _readAheadPos += size;
+        if (_readAheadPos == _readAhead.size()) {
+            _readAhead.clear();
+            _readAheadPos = 0;
+        }
+        return result;
+    }
+
+    void appendReadAhead(const std::string& data, size_t offset = 0) {
+        if (_readAheadPos > 0) {
+            _readAhead.erase(0, _readAheadPos);
+            _readAheadPos = 0;
+        }
+        _readAhead.append(data, offset);
+    }
+
+    /**
+     * @brief Complete a read from the read-ahead buffer or report the pending end
+     * @return true if the callback was called
+     */
+    bool readBuffered(size_t maxBytes, std::function<void(std::optional<std::string>)>& callback) {
+        if (hasReadAhead()) {
+            callback(takeReadAhead(maxBytes));
+            return true;
+        }
+        if (_endPending) {
+            _endPending = false;
+            callback(std::nullopt);
+            return true;
+        }
+        return false;
+    }
+
+protected:
+    /**
+     * @brief Read the next chunk from the underlying source. The end of the
+     * stream is reported as std::nullopt, any chunk (even an empty one, e.g. a
+     * blank line of LineSplitter) is data.
+     *
+     * @return false if the stream is not readable
+     */
+    virtual bool doRead(std::function<void(std::optional<std::string>)> callback) = 0;
+
+    /**
+     * @brief Read the next chunk of binary data from the underlying source,
+     * see doRead. The ownership of the chunk is passed to the callback, so it
+     * can be exposed to JavaScript as an ArrayBuffer without copying.
+     * Implementations should override this to avoid the conversion from a
+     * string.
+     */
+    virtual bool doReadBytes(std::function<void(std::optional<std::vector<uint8_t>>)> callback) {
+        return doRead([callback_ = std::move(callback)](std::optional<std::string> data) {
+            if (!data) {
+                callback_(std::nullopt);
+                return;
+            }
+            callback_(std::vector<uint8_t>(data->begin(), data->end()));
+        });
+    }
+
 public:
-    virtual bool get(std::function<void(char)> callback) = 0;
-    virtual bool read(std::function<void(std::string)> callback) = 0;
+    /**
+     * @brief Read the next chunk, std::nullopt at the end of the stream.
+     * Data kept by readSome and readLine are returned first.
+     *
+     * @return false if the stream is not readable
+     */
+    bool read(std::function<void(std::optional<std::string>)> callback) {
+        return readSome(std::string::npos, std::move(callback));
+    }
+
+    /**
+     * @brief Read the next chunk of binary data, see read
+     */
+    bool readBytes(std::function<void(std::optional<std::vector<uint8_t>>)> callback) {
+        std::function<void(std::optional<std::string>)> fromBuffer = [&callback](std::optional<std::string> data) {
+            if (!data) {
+                callback(std::nullopt);
+                return;
+            }
+            callback(std::vector<uint8_t>(data->begin(), data->end()));
+        };
+        if (readBuffered(std::string::npos, fromBuffer)) {
+            return true;
+        }
+        return doReadBytes(std::move(callback));
+    }
+
+    /**
+     * @brief Read the next character, std::nullopt at the end of the stream.
+     * Empty chunks are skipped.
+     */
+    bool get(std::function<void(std::optional<char>)> callback) {
+        return readSome(1, [this, callback](std::optional<std::string> data) {
+            if (!data) {
+                callback(std::nullopt);
+            }
+            else if (data->empty()) {
+                if (!get(callback)) {
+                    callback(std::nullopt);
+                }
+            }
+            else {
+                callback((*data)[0]);
+            }
+        });
+    }
+
+    /**
+     * @brief Read at most maxBytes bytes. The rest of a larger chunk is kept
+     * and returned by the following reads.
+     * @note Virtual, so that wrappers can forward it to the stream owning the
+     * read-ahead buffer (see ReadableRef).
+     */
+    virtual bool readSome(size_t maxBytes, std::function<void(std::optional<std::string>)> callback) {
+        if (readBuffered(maxBytes, callback)) {
+            return true;
+        }
+        return doRead([this, maxBytes, callback_ = std::move(callback)](std::optional<std::string> data) {
+            if (data && data->size() > maxBytes) {
+                appendReadAhead(*data, maxBytes);
+                data->resize(maxBytes);
+            }
+            callback_(std::move(data));
+        });
+    }
+
+    /**
+     * @brief Read a line without the line terminator, std::nullopt at the end
+     * of the stream. If the stream ends without a terminator, the rest of the
+     * data is returned as the last line and the end is reported by the next
+     * read.
+     * @note Virtual, see readSome.
+     */
+    virtual bool readLine(std::function<void(std::optional<std::string>)> callback) {
+        size_t end = _readAhead.find('\n', _readAheadPos);
+        if (end != std::string::npos) {
+            std::string line = takeReadAhead(end + 1 - _readAheadPos);
+            line.pop_back();
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            callback(std::move(line));
+            return true;
+        }
+        if (_endPending && !hasReadAhead()) {
+            _endPending = false;
+            callback(std::nullopt);
+            return true;
+        }
+
+        auto callbackPtr = std::make_shared<std::function<void(std::optional<std::string>)>>(std::move(callback));
+        auto finishLine = [this, callbackPtr]() {
+            if (hasReadAhead()) {
+                _endPending = true;
+                (*callbackPtr)(takeReadAhead(std::string::npos));
+            }
+            else {
+                (*callbackPtr)(std::nullopt);
+            }
+        };
+        bool res = doRead([this, callbackPtr, finishLine](std::optional<std::string> data) {
+            if (!data) {
+                finishLine();
+                return;
+            }
+            appendReadAhead(*data);
+            if (!readLine(*callbackPtr)) {
+                (*callbackPtr)(std::nullopt);
+            }
+        });
+        if (!res && hasReadAhead()) {
+            finishLine();
+            return true;
+        }
+        return res;
+    }
+
+    /**
+     * @brief Get the error which ended the stream, if any. Valid after the
+     * end of the stream was reported.
+     */
+    virtual std::exception_ptr error() {
+        return nullptr;
+    }
 
     virtual ~Readable() = default;
 };
@@ -32,22 +291,144 @@ public:
     void write(std::string data) override {
         _ptr->write(std::move(data));
     }
+
+    void write(std::span<const uint8_t> data) override {
+        _ptr->write(data);
+    }
+
+    void writeLine(std::string data) override {
+        _ptr->writeLine(std::move(data));
+    }
+
+    void flush() override {
+        _ptr->flush();
+    }
+
+    size_t writableLength() override {
+        return _ptr->writableLength();
+    }
+
+    size_t highWaterMark() override {
+        return _ptr->highWaterMark();
+    }
+
+    void setHighWaterMark(size_t bytes) override {
+        _ptr->setHighWaterMark(bytes);
+    }
+
+    void onDrain(std::function<void()> callback) override {
+        _ptr->onDrain(std::move(callback));
+    }
 };
 
 class ReadableRef : public Readable {
 private:
     Readable* _ptr;
+protected:
+    bool doRead(std::function<void(std::optional<std::string>)> callback) override {
+        return _ptr->read(std::move(callback));
+    }
+
+    bool doReadBytes(std::function<void(std::optional<std::vector<uint8_t>>)> callback) override {
+        return _ptr->readBytes(std::move(callback));
+    }
 public:
     ReadableRef(Readable* ptr): _ptr(ptr) {}
 
-    bool read(std::function<void(std::string)> callback) override {
-        return _ptr->read(std::move(callback));
+    // the read-ahead buffer is kept by the referenced stream
+    bool readSome(size_t maxBytes, std::function<void(std::optional<std::string>)> callback) override {
+        return _ptr->readSome(maxBytes, std::move(callback));
     }
 
-    bool get(std::function<void(char)> callback) override {
-        return _ptr->get(std::move(callback));
+    bool readLine(std::function<void(std::optional<std::string>)> callback) override {
+        return _ptr->readLine(std::move(callback));
+    }
+
+    std::exception_ptr error() override {
+        return _ptr->error();
     }
 };
 
 
+/**
+ * @brief Move all data from a Readable to a Writable without leaving C++.
+ * Reading is paused while the Writable needs a drain. The transfer ends when
+ * the Readable reaches the end of the stream or is not readable anymore, or
+ * when writing throws an exception. Empty chunks are written as well.
+ *
+ * @param from the source stream
+ * @param to the destination stream
+ * @param done called with the number of transferred bytes and the exception
+ * which ended the transfer (including the error of the Readable), if any
+ */
+inline void pipeStreams(Readable& from, Writable& to, std::function<void(size_t, std::exception_ptr)> done) {
+    class Pipe : public std::enable_shared_from_this<Pipe> {
+        Readable& _from;
+        Writable& _to;
+        std::function<void(size_t, std::exception_ptr)> _done;
+        size_t _transferred = 0;
+        bool _running = false;
+        bool _again = false;
+        bool _finished = false;
+
+        void finish(std::exception_ptr error = nullptr) {
+            if (!_finished) {
+                _finished = true;
+                _done(_transferred, error);
+            }
+        }
+
+        void step() {
+            auto self = shared_from_this();
+            bool res = _from.readSome(std::string::npos, [self](std::optional<std::string> data) {
+                if (!data) {
+                    self->finish(self->_from.error());
+                    return;
+                }
+                size_t size = data->size();
+                try {
+                    self->_to.write(std::move(*data));
+                }
+                catch (...) {
+                    self->finish(std::current_exception());
+                    return;
+                }
+                self->_transferred += size;
+                if (self->_to.needsDrain()) {
+                    self->_to.onDrain([self]() { self->pump(); });
+                }
+                else {
+                    self->pump();
+                }
+            });
+            if (!res) {
+                finish(_from.error());
+            }
+        }
+    public:
+        Pipe(Readable& from_, Writable& to_, std::function<void(size_t, std::exception_ptr)> done_):
+            _from(from_), _to(to_), _done(std::move(done_))
+        {}
+
+        void pump() {
+            // callbacks called synchronously continue in the running loop instead of recursing
+            if (_running) {
+                _again = true;
+                return;
+            }
+            _running = true;
+            do {
+                _again = false;
+                if (!_finished) {
+                    step();
+                }
+            } while (_again);
+            _running = false;
+        }
+    };
+
+    std::make_shared<Pipe>(from, to, std::move(done))->pump();
+}
+
+
 } // namespace jac
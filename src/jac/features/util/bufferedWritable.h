@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if __has_include(<sys/uio.h>) && __has_include(<unistd.h>) && __has_include(<poll.h>)
+    #include <cerrno>
+    #include <poll.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+    #define JAC_HAS_WRITEV 1
+#endif
+
+#include "../types/streams.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief A Writable which collects the written data in a ring buffer and
+ * writes it to the underlying file descriptor or Writable in batches.
+ *
+ * The buffer is flushed when it cannot fit the next write, when flush() is
+ * called, on destruction and at process exit. Data older than the flush
+ * interval are flushed by flushIfDue, which StdioFeature calls from the event
+ * loop. Writes larger than the buffer bypass it.
+ *
+ * A non-blocking file descriptor which cannot accept more data keeps the rest
+ * buffered; flushIfDue retries it later, the other flushes wait until the
+ * descriptor is writable. The data are dropped only on other write errors.
+ *
+ * onDrain does not wait either. If the buffered data stay above the
+ * high-water mark, the callback is called by flushIfDue once they drop below
+ * it; flushIfDue then retries the flush even if the flush interval is
+ * disabled.
+ *
+ * @note Can be used from multiple threads
+ */
+class BufferedWritable : public Writable {
+    using Clock = std::chrono::steady_clock;
+
+    std::unique_ptr<Writable> _sink;
+    int _fd = -1;
+
+    std::unique_ptr<char[]> _data;
+    size_t _capacity;
+    // total number of bytes appended and flushed, the positions in the buffer are modulo capacity
+    size_t _head = 0;
+    size_t _tail = 0;
+    size_t _flushes = 0;
+
+    std::chrono::milliseconds _flushInterval;
+    std::optional<Clock::time_point> _dirtySince;
+    std::vector<std::function<void()>> _drainCallbacks;
+
+    std::mutex _mutex;
+
+    static std::mutex& registryMutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static std::vector<BufferedWritable*>& registry() {
+        static std::vector<BufferedWritable*> instances;
+        return instances;
+    }
+
+    static void flushAll() {
+        std::scoped_lock lock(registryMutex());
+        for (auto instance : registry()) {
+            instance->flush();
+        }
+    }
+
+    void start() {
+        registry();
+        [[maybe_unused]] static const bool registered = (std::atexit(flushAll), true);
+        std::scoped_lock lock(registryMutex());
+        registry().push_back(this);
+    }
+
+    size_t used() const {
+        return _head - _tail;
+    }
+
+    bool drained() {
+        return used() == 0 || used() < highWaterMark();
+    }
+
+    /**
+     * @brief Get the age of buffered data at which flushIfDue flushes them
+     */
+    std::optional<Clock::duration> dueAfter() const {
+        if (!_drainCallbacks.empty()) {
+            return std::max<Clock::duration>(_flushInterval, std::chrono::milliseconds(1));
+        }
+        if (_flushInterval.count() <= 0) {
+            return std::nullopt;
+        }
+        return _flushInterval;
+    }
+
+    void append(const char* data, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        if (used() == 0) {
+            _dirtySince = Clock::now();
+        }
+        size_t start = _head % _capacity;
+        size_t first = std::min(size, _capacity - start);
+        std::memcpy(_data.get() + start, data, first);
+        std::memcpy(_data.get(), data + first, size - first);
+        _head += size;
+    }
+
+    /**
+     * @brief Write the data to the output
+     * @param wait wait until a non-blocking descriptor accepts all data
+     * @return number of bytes consumed (written or dropped because of an error)
+     */
+    size_t output(std::string_view first, std::string_view second, bool wait) {
+        _flushes++;
+#ifdef JAC_HAS_WRITEV
+        if (_fd >= 0) {
+            iovec iov[2] = {
+                { const_cast<char*>(first.data()), first.size() },
+                { const_cast<char*>(second.data()), second.size() }
+            };
+            iovec* current = iov;
+            int count = second.empty() ? 1 : 2;
+            size_t total = 0;
+            while (count > 0) {
+                ssize_t written = ::writev(_fd, current, count);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        if (!wait) {
+                            return total;
+                        }
+                        pollfd pfd = { _fd, POLLOUT, 0 };
+                        ::poll(&pfd, 1, -1);
+                        continue;
+                    }
+                    // the data cannot be written, drop it
+                    return first.size() + second.size();
+                }
+                total += static_cast<size_t>(written);
+                while (count > 0 && static_cast<size_t>(written) >= current->iov_len) {
+                    written -= static_cast<ssize_t>(current->iov_len);
+                    current++;
+                    count--;
+                }
+                if (count > 0) {
+                    current->iov_base = static_cast<char*>(current->iov_base) + written;
+                    current->iov_len -= static_cast<size_t>(written);
+                }
+            }
+            return total;
+        }
+#endif
+        if (!second.empty()) {
+            std::string data;
+            data.reserve(first.size() + second.size());
+            data.append(first).append(second);
+            _sink->write(std::move(data));
+        }
+        else if (!first.empty()) {
+            _sink->write(std::string(first));
+        }
+        return first.size() + second.size();
+    }
+
+    void flushLocked(bool wait) {
+        if (used() == 0) {
+            return;
+        }
+        size_t start = _tail % _capacity;
+        size_t first = std::min(used(), _capacity - start);
+        _tail += output({ _data.get() + start, first }, { _data.get(), used() - first }, wait);
+        // the rest is retried after another interval
+        _dirtySince = used() == 0 ? std::nullopt : std::optional(Clock::now());
+    }
+
+    void writeParts(std::string_view data, std::string_view suffix) {
+        std::scoped_lock lock(_mutex);
+        size_t size = data.size() + suffix.size();
+        if (size > _capacity - used()) {
+            flushLocked(true);
+        }
+        if (size > _capacity) {
+            output(data, suffix, true);
+            return;
+        }
+        append(data.data(), data.size());
+        append(suffix.data(), suffix.size());
+    }
+
+public:
+#ifdef JAC_HAS_WRITEV
+    /**
+     * @brief Create a buffer writing to a file descriptor using writev
+     *
+     * @param fd the file descriptor, not closed by the buffer
+     * @param capacity size of the buffer in bytes
+     * @param flushInterval maximum age of buffered data flushed by flushIfDue, zero disables it
+     */
+    BufferedWritable(int fd, size_t capacity = 64 * 1024, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(50)) :
+        _fd(fd), _data(std::make_unique<char[]>(std::max<size_t>(capacity, 1))), _capacity(std::max<size_t>(capacity, 1)),
+        _flushInterval(flushInterval)
+    {
+        start();
+    }
+#endif
+
+    /**
+     * @brief Create a buffer writing to another Writable
+     *
+     * @param sink the Writable receiving the batches
+     * @param capacity size of the buffer in bytes
+     * @param flushInterval maximum age of buffered data flushed by flushIfDue, zero disables it
+     */
+    BufferedWritable(std::unique_ptr<Writable> sink, size_t capacity = 64 * 1024, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(50)) :
+        _sink(std::move(sink)), _data(std::make_unique<char[]>(std::max<size_t>(capacity, 1))), _capacity(std::max<size_t>(capacity, 1)),
+        _flushInterval(flushInterval)
+    {
+        start();
+    }
+
+    BufferedWritable(const BufferedWritable&) = delete;
+    BufferedWritable& operator=(const BufferedWritable&) = delete;
+
+    void write(std::string data) override {
+        writeParts(data, {});
+    }
+
+    void write(std::span<const uint8_t> data) override {
+        writeParts({ reinterpret_cast<const char*>(data.data()), data.size() }, {});
+    }
+
+    void writeLine(std::string data) override {
+        writeParts(data, "\n");
+    }
+
+    void flush() override {
+        std::scoped_lock lock(_mutex);
+        flushLocked(true);
+    }
+
+    /**
+     * @brief Get the time at which the buffered data reach the flush interval
+     *
+     * @return The time point or std::nullopt if there is nothing to flush
+     * or the interval is disabled
+     */
+    std::optional<Clock::time_point> flushDeadline() {
+        std::scoped_lock lock(_mutex);
+        if (!_drainCallbacks.empty() && drained()) {
+            return Clock::now();
+        }
+        auto interval = dueAfter();
+        if (!_dirtySince || !interval) {
+            return std::nullopt;
+        }
+        return *_dirtySince + *interval;
+    }
+
+    /**
+     * @brief Flush the buffer if its data reached the flush interval and call
+     * the drain callbacks once the data drop below the high-water mark. Does
+     * not wait for a non-blocking file descriptor, the rest is retried later.
+     */
+    void flushIfDue() {
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::scoped_lock lock(_mutex);
+            auto interval = dueAfter();
+            if (_dirtySince && interval && Clock::now() >= *_dirtySince + *interval) {
+                flushLocked(false);
+            }
+            if (drained()) {
+                callbacks.swap(_drainCallbacks);
+            }
+        }
+        for (auto& callback : callbacks) {
+            callback();
+        }
+    }
+
+    size_t writableLength() override {
+        std::scoped_lock lock(_mutex);
+        return used();
+    }
+
+    void onDrain(std::function<void()> callback) override {
+        {
+            std::scoped_lock lock(_mutex);
+            if (!drained()) {
+                flushLocked(false);
+            }
+            if (!drained()) {
+                _drainCallbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+    /**
+     * @brief Get the number of batches written to the underlying output
+     *
+     * @return The number of batches
+     */
+    size_t flushes() {
+        std::scoped_lock lock(_mutex);
+        return _flushes;
+    }
+
+    ~BufferedWritable() {
+        {
+            std::scoped_lock lock(registryMutex());
+            auto& instances = registry();
+            instances.erase(std::remove(instances.begin(), instances.end(), this), instances.end());
+        }
+        flush();
+    }
+};
+
+
+} // namespace jac
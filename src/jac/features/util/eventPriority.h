@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+
+namespace jac {
+
+
+/**
+ * @brief Priority class of an event in the event queue
+ */
+enum class EventPriority {
+    /**
+     * @brief Time-critical events, e.g. control messages
+     */
+    Urgent,
+    /**
+     * @brief Regular events (default)
+     */
+    Normal,
+    /**
+     * @brief Events which may be delayed, e.g. log flushes
+     */
+    Background
+};
+
+inline constexpr size_t eventPriorityCount = 3;
+
+inline constexpr std::string_view eventPriorityName(EventPriority priority) {
+    switch (priority) {
+        case EventPriority::Urgent:
+            return "urgent";
+        case EventPriority::Normal:
+            return "normal";
+        case EventPriority::Background:
+            return "background";
+    }
+    return "unknown";
+}
+
+
+} // namespace jac
@@ -0,0 +1,167 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "../types/streams.h"
+#include "ioReactor.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief A Readable reading from a file descriptor (e.g. stdin or a pipe)
+ * without blocking. While a read is pending, the descriptor is watched by
+ * the IoReactor, so the event loop wakes up only when data arrive and no
+ * thread is blocked in read().
+ *
+ * The end of the stream is reported as std::nullopt, after which the
+ * stream is not readable anymore.
+ *
+ * @note The flags of the descriptor are left untouched, because O_NONBLOCK
+ * is shared by all descriptors of the same open file (e.g. stdin, stdout
+ * and stderr of a terminal) and would make writes to them fail with EAGAIN.
+ * The descriptor is only read once poll() reports it as readable.
+ */
+class FdReadable : public Readable {
+    IoReactor& _reactor;
+    int _fd;
+    size_t _chunkSize;
+    bool _ended = false;
+    bool _watching = false;
+    std::deque<std::function<void(std::optional<std::string>)>> _pending;
+
+    enum class Result { Data, End, WouldBlock };
+
+    bool ready() {
+        pollfd pfd{ _fd, POLLIN, 0 };
+        int res;
+        do {
+            res = ::poll(&pfd, 1, 0);
+        } while (res < 0 && errno == EINTR);
+        // errors and hang-ups are reported by read()
+        return res != 0;
+    }
+
+    Result tryRead(std::string& data) {
+        if (!ready()) {
+            return Result::WouldBlock;
+        }
+        data.resize(_chunkSize);
+        ssize_t count;
+        do {
+            count = ::read(_fd, data.data(), data.size());
+        } while (count < 0 && errno == EINTR);
+
+        // the descriptor may have been switched to non-blocking mode by someone else
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return Result::WouldBlock;
+        }
+        if (count <= 0) {
+            // errors end the stream as well
+            data.clear();
+            return Result::End;
+        }
+        data.resize(static_cast<size_t>(count));
+        return Result::Data;
+    }
+
+    void onReadable() {
+        while (!_pending.empty()) {
+            std::string data;
+            Result result = tryRead(data);
+            if (result == Result::WouldBlock) {
+                return;
+            }
+            auto callback = std::move(_pending.front());
+            _pending.pop_front();
+            if (result == Result::End) {
+                _ended = true;
+                stopWatching();
+                callback(std::nullopt);
+                failPending();
+                return;
+            }
+            if (_pending.empty()) {
+                stopWatching();
+            }
+            callback(std::move(data));
+        }
+    }
+
+    void failPending() {
+        // the reads queued after the end of the stream see the end as well
+        auto pending = std::move(_pending);
+        _pending.clear();
+        for (auto& callback : pending) {
+            callback(std::nullopt);
+        }
+    }
+
+    void stopWatching() {
+        if (_watching) {
+            _watching = false;
+            _reactor.unwatchReadable(_fd);
+        }
+    }
+
+protected:
+    bool doRead(std::function<void(std::optional<std::string>)> callback) override {
+        if (_ended) {
+            return false;
+        }
+        if (_pending.empty()) {
+            std::string data;
+            Result result = tryRead(data);
+            if (result != Result::WouldBlock) {
+                _ended = result == Result::End;
+                if (_ended) {
+                    callback(std::nullopt);
+                }
+                else {
+                    callback(std::move(data));
+                }
+                return true;
+            }
+        }
+
+        _pending.push_back(std::move(callback));
+        if (!_watching) {
+            _watching = true;
+            _reactor.watchReadable(_fd, [this]() { onReadable(); });
+        }
+        return true;
+    }
+
+public:
+    /**
+     * @param reactor the reactor notifying about readiness of the descriptor
+     * @param fd the file descriptor, not closed by the stream
+     * @param chunkSize maximum size of a chunk
+     */
+    FdReadable(IoReactor& reactor, int fd, size_t chunkSize = 64 * 1024) :
+        _reactor(reactor), _fd(fd), _chunkSize(chunkSize)
+    {}
+
+    FdReadable(const FdReadable&) = delete;
+    FdReadable& operator=(const FdReadable&) = delete;
+
+    ~FdReadable() {
+        stopWatching();
+    }
+};
+
+
+} // namespace jac
+
+#endif
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace jac {
+
+
+/**
+ * @brief An error in a received HTTP message, answered with the status code
+ */
+class HttpError : public std::runtime_error {
+    int _status;
+public:
+    HttpError(int status, const std::string& message) : std::runtime_error(message), _status(status) {}
+
+    int status() const {
+        return _status;
+    }
+};
+
+
+/**
+ * @brief A parsed HTTP request. The header lines are kept in a single buffer
+ * and only split into names and values on access.
+ */
+struct HttpRequest {
+    struct Header {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t valueOffset;
+        uint32_t valueLength;
+    };
+
+    std::string method;
+    std::string target;
+    int versionMinor = 1;
+    bool keepAlive = true;
+    std::string head;
+    std::vector<Header> headers;
+    std::vector<uint8_t> body;
+
+    std::string_view headerName(size_t index) const {
+        return std::string_view(head).substr(headers[index].nameOffset, headers[index].nameLength);
+    }
+
+    std::string_view headerValue(size_t index) const {
+        return std::string_view(head).substr(headers[index].valueOffset, headers[index].valueLength);
+    }
+
+    /**
+     * @brief Find the first header with the name, ignoring case
+     */
+    std::optional<std::string_view> header(std::string_view name) const {
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (equalsIgnoreCase(headerName(i), name)) {
+                return headerValue(i);
+            }
+        }
+        return std::nullopt;
+    }
+
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+            return toLower(x) == toLower(y);
+        });
+    }
+
+    static char toLower(char c) {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+};
+
+
+/**
+ * @brief Limits of the size of received HTTP requests
+ */
+struct HttpLimits {
+    size_t maxHeadSize = 64 * 1024;
+    size_t maxBodySize = 16 * 1024 * 1024;
+};
+
+
+/**
+ * @brief Incremental parser of HTTP/1.x requests
+ *
+ * Data are appended with feed() as they arrive, complete requests are taken
+ * with next(). Pipelined requests are parsed one after another from the
+ * buffered data. Request bodies are read according to Content-Length or the
+ * chunked transfer coding, chunk extensions and trailers are ignored.
+ */
+class HttpRequestParser {
+    enum class State { Head, Body, ChunkSize, ChunkData, Trailers };
+
+    HttpLimits _limits;
+    std::string _buffer;
+    size_t _pos = 0;
+    // position from which the end of the head is searched for
+    size_t _scanPos = 0;
+    State _state = State::Head;
+    size_t _remaining = 0;
+    HttpRequest _request;
+
+    static bool isToken(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+            || std::strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+    }
+
+    static std::string_view trim(std::string_view value) {
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        return value;
+    }
+
+    static bool hasToken(std::string_view list, std::string_view token) {
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            if (HttpRequest::equalsIgnoreCase(trim(list.substr(0, comma)), token)) {
+                return true;
+            }
+            if (comma == std::string_view::npos) {
+                break;
+            }
+            list.remove_prefix(comma + 1);
+        }
+        return false;
+    }
+
+    std::string_view buffered() const {
+        return std::string_view(_buffer).substr(_pos);
+    }
+
+    void consume(size_t size) {
+        _pos += size;
+        if (_pos == _buffer.size()) {
+            _buffer.clear();
+            _pos = 0;
+        }
+    }
+
+    void parseRequestLine(std::string_view line) {
+        size_t methodEnd = line.find(' ');
+        size_t targetEnd = methodEnd == std::string_view::npos ? methodEnd : line.find(' ', methodEnd + 1);
+        if (targetEnd == std::string_view::npos || methodEnd == 0 || targetEnd == methodEnd + 1) {
+            throw HttpError(400, "Malformed request line");
+        }
+        std::string_view method = line.substr(0, methodEnd);
+        if (!std::all_of(method.begin(), method.end(), isToken)) {
+            throw HttpError(400, "Malformed method");
+        }
+        std::string_view version = line.substr(targetEnd + 1);
+        if (version.size() != 8 || version.substr(0, 7) != "HTTP/1." || (version[7] != '0' && version[7] != '1')) {
+            throw HttpError(505, "HTTP version not supported");
+        }
+
+        _request.method.assign(method);
+        _request.target.assign(line.substr(methodEnd + 1, targetEnd - methodEnd - 1));
+        _request.versionMinor = version[7] - '0';
+    }
+
+    void parseHead(std::string_view head) {
+        _request = HttpRequest();
+        size_t lineEnd = head.find("\r\n");
+        parseRequestLine(head.substr(0, lineEnd));
+
+        _request.head.assign(head.substr(lineEnd + 2));
+        std::string_view lines = _request.head;
+        size_t offset = 0;
+        while (offset < lines.size()) {
+            size_t end = lines.find("\r\n", offset);
+            if (end == std::string_view::npos) {
+                end = lines.size();
+            }
+            std::string_view line = lines.substr(offset, end - offset);
+            size_t colon = line.find(':');
+            if (colon == 0 || colon == std::string_view::npos
+             || !std::all_of(line.begin(), line.begin() + static_cast<std::ptrdiff_t>(colon), isToken)) {
+                // also rejects the obsolete line folding
+                throw HttpError(400, "Malformed header");
+            }
+            std::string_view value = trim(line.substr(colon + 1));
+            _request.headers.push_back({
+                static_cast<uint32_t>(offset),
+                static_cast<uint32_t>(colon),
+                static_cast<uint32_t>(value.data() - lines.data()),
+                static_cast<uint32_t>(value.size())
+            });
+            offset = end + 2;
+        }
+
+        auto connection = _request.header("connection");
+        if (_request.versionMinor == 0) {
+            _request.keepAlive = connection && hasToken(*connection, "keep-alive");
+        }
+        else {
+            _request.keepAlive = !connection || !hasToken(*connection, "close");
+        }
+
+        // repeated framing headers could be interpreted differently by a proxy
+        std::optional<std::string_view> transferEncoding;
+        std::optional<std::string_view> contentLength;
+        for (size_t i = 0; i < _request.headers.size(); i++) {
+            std::string_view name = _request.headerName(i);
+            if (HttpRequest::equalsIgnoreCase(name, "transfer-encoding")) {
+                if (transferEncoding) {
+                    throw HttpError(400, "Repeated Transfer-Encoding");
+                }
+                transferEncoding = _request.headerValue(i);
+            }
+            else if (HttpRequest::equalsIgnoreCase(name, "content-length")) {
+                if (contentLength && *contentLength != _request.headerValue(i)) {
+                    throw HttpError(400, "Conflicting Content-Length");
+                }
+                contentLength = _request.headerValue(i);
+            }
+        }
+        if (transferEncoding) {
+            // a message with both could be framed differently by a proxy
+            if (contentLength) {
+                throw HttpError(400, "Both Transfer-Encoding and Content-Length");
+            }
+            if (!HttpRequest::equalsIgnoreCase(trim(*transferEncoding), "chunked")) {
+                throw HttpError(501, "Unsupported transfer coding");
+            }
+            _state = State::ChunkSize;
+            return;
+        }
+        if (contentLength) {
+            size_t length = 0;
+            if (contentLength->empty() || contentLength->size() > 15
+             || !std::all_of(contentLength->begin(), contentLength->end(), [](char c) { return c >= '0' && c <= '9'; })) {
+                throw HttpError(400, "Invalid Content-Length");
+            }
+            for (char c : *contentLength) {
+                length = length * 10 + static_cast<size_t>(c - '0');
+            }
+            if (length > _limits.maxBodySize) {
+                throw HttpError(413, "Request body too large");
+            }
+            _remaining = length;
+            _request.body.reserve(length);
+            _state = State::Body;
+            return;
+        }
+        _remaining = 0;
+        _state = State::Body;
+    }
+
+    void appendBody(std::string_view data) {
+        if (_request.body.size() + data.size() > _limits.maxBodySize) {
+            throw HttpError(413, "Request body too large");
+        }
+        _request.body.insert(_request.body.end(), data.begin(), data.end());
+    }
+
+    bool parseChunkSize() {
+        std::string_view data = buffered();
+        size_t end = data.find("\r\n");
+        if (end == std::string_view::npos) {
+            if (data.size() > 1024) {
+                throw HttpError(400, "Malformed chunk size");
+            }
+            return false;
+        }
+        std::string_view line = data.substr(0, std::min(end, data.find(';')));
+        line = trim(line);
+        if (line.empty() || line.size() > 15) {
+            throw HttpError(400, "Malformed chunk size");
+        }
+        size_t size = 0;
+        for (char c : line) {
+            int digit = c >= '0' && c <= '9' ? c - '0'
+                      : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                      : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) {
+                throw HttpError(400, "Malformed chunk size");
+            }
+            size = size * 16 + static_cast<size_t>(digit);
+        }
+        consume(end + 2);
+        _remaining = size;
+        _state = size == 0 ? State::Trailers : State::ChunkData;
+        return true;
+    }
+
+public:
+    HttpRequestParser(HttpLimits limits = {}) : _limits(limits) {}
+
+    /**
+     * @brief Append received data
+     */
+    void feed(std::string_view data) {
+        if (_pos > 0 && _pos >= _buffer.size() / 2) {
+            _scanPos -= std::min(_scanPos, _pos);
+            _buffer.erase(0, _pos);
+            _pos = 0;
+        }
+        _buffer.append(data);
+    }
+
+    /**
+     * @brief Check if any received data were not consumed by a complete request
+     */
+    bool hasBuffered() const {
+        return _pos < _buffer.size();
+    }
+
+    /**
+     * @brief Take the next complete request from the received data
+     *
+     * @param request the output request
+     * @return true if a request was complete
+     * @throws HttpError if the data are not a valid request
+     */
+    bool next(HttpRequest& request) {
+        while (true) {
+            switch (_state) {
+                case State::Head: {
+                    std::string_view data = buffered();
+                    size_t from = _scanPos > _pos + 3 ? _scanPos - _pos - 3 : 0;
+                    size_t end = data.find("\r\n\r\n", from);
+                    if (end == std::string_view::npos) {
+                        if (data.size() > _limits.maxHeadSize) {
+                            throw HttpError(431, "Request head too large");
+                        }
+                        _scanPos = _pos + data.size();
+                        return false;
+                    }
+                    if (end > _limits.maxHeadSize) {
+                        throw HttpError(431, "Request head too large");
+                    }
+                    parseHead(data.substr(0, end + 2));
+                    consume(end + 4);
+                    _scanPos = _pos;
+                    break;
+                }
+                case State::Body: {
+                    std::string_view data = buffered();
+                    size_t size = std::min(data.size(), _remaining);
+                    appendBody(data.substr(0, size));
+                    consume(size);
+                    _remaining -= size;
+                    if (_remaining > 0) {
+                        return false;
+                    }
+                    request = std::move(_request);
+                    _request = HttpRequest();
+                    _state = State::Head;
+                    _scanPos = _pos;
+                    return true;
+                }
+                case State::ChunkSize:
+                    if (!parseChunkSize()) {
+                        return false;
+                    }
+                    break;
+                case State::ChunkData: {
+                    std::string_view data = buffered();
+                    if (data.size() < _remaining + 2) {
+                        // keep the partial chunk in the body, so the buffer does not grow
+                        size_t size = std::min(data.size(), _remaining);
+                        appendBody(data.substr(0, size));
+                        consume(size);
+                        _remaining -= size;
+                        return false;
+                    }
+                    if (data.substr(_remaining, 2) != "\r\n") {
+                        throw HttpError(400, "Malformed chunk");
+                    }
+                    appendBody(data.substr(0, _remaining));
+                    consume(_remaining + 2);
+                    _state = State::ChunkSize;
+                    break;
+                }
+                case State::Trailers: {
+                    std::string_view data = buffered();
+                    size_t end = data.find("\r\n");
+                    if (end == std::string_view::npos) {
+                        if (data.size() > _limits.maxHeadSize) {
+                            throw HttpError(431, "Trailers too large");
+                        }
+                        return false;
+                    }
+                    consume(end + 2);
+                    if (end == 0) {
+                        _remaining = 0;
+                        _state = State::Body;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+};
+
+
+/**
+ * @brief Get the reason phrase of a status code
+ */
+inline std::string_view httpStatusText(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 411: return "Length Required";
+        case 413: return "Content Too Large";
+        case 415: return "Unsupported Media Type";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        case 505: return "HTTP Version Not Supported";
+        default: return "Unknown";
+    }
+}
+
+
+/**
+ * @brief An HTTP response to be serialized by the server
+ *
+ * The body is either owned in bodyString, or borrowed from memory kept
+ * alive by bodyOwner (e.g. a JavaScript ArrayBuffer).
+ */
+struct HttpResponse {
+    int status = 200;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string bodyString;
+    std::span<const uint8_t> bodyView;
+    std::shared_ptr<void> bodyOwner;
+
+    std::span<const uint8_t> body() const {
+        if (bodyOwner) {
+            return bodyView;
+        }
+        return std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(bodyString.data()), bodyString.size());
+    }
+
+    /**
+     * @brief Serialize the status line and the headers. Content-Length is
+     * added unless the handler set it, Connection: close is added if the
+     * connection is not kept alive.
+     *
+     * @param out the output
+     * @param keepAlive whether the connection is kept alive
+     * @throws std::invalid_argument if a header contains a line break
+     */
+    void serializeHead(std::string& out, bool keepAlive) const {
+        if (status < 100 || status > 999) {
+            throw std::invalid_argument("Invalid status code " + std::to_string(status));
+        }
+        out.append("HTTP/1.1 ").append(std::to_string(status)).append(" ").append(httpStatusText(status)).append("\r\n");
+
+        bool hasLength = false;
+        for (auto& [name, value] : headers) {
+            if (name.empty() || name.find_first_of(":\r\n") != std::string::npos || value.find_first_of("\r\n") != std::string::npos) {
+                throw std::invalid_argument("Invalid header " + name);
+            }
+            if (HttpRequest::equalsIgnoreCase(name, "content-length")) {
+                hasLength = true;
+            }
+            out.append(name).append(": ").append(value).append("\r\n");
+        }
+        if (!hasLength && status >= 200 && status != 204 && status != 304) {
+            out.append("Content-Length: ").append(std::to_string(body().size())).append("\r\n");
+        }
+        if (!keepAlive) {
+            out.append("Connection: close\r\n");
+        }
+        out.append("\r\n");
+    }
+};
+
+
+} // namespace jac
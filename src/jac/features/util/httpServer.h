@@ -0,0 +1,279 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+
+#include "http.h"
+#include "socket.h"
+
+
+namespace jac {
+
+
+class HttpConnection;
+
+
+/**
+ * @brief Sends the response to one request of an HttpConnection. Only the
+ * first response is sent, the rest are ignored.
+ */
+class HttpResponder {
+    std::shared_ptr<HttpConnection> _connection;
+    uint64_t _sequence;
+public:
+    HttpResponder(std::shared_ptr<HttpConnection> connection, uint64_t sequence) :
+        _connection(std::move(connection)), _sequence(sequence)
+    {}
+
+    inline void send(HttpResponse response);
+};
+
+
+/**
+ * @brief Serves HTTP/1.1 requests received on a Socket
+ *
+ * Requests are parsed incrementally and passed to the handler as soon as
+ * they are complete, also when they are pipelined. The responses may be sent
+ * in any order, they are written out in the order of the requests. Reading
+ * pauses while too many responses are pending or the socket needs a drain.
+ * The response head and body are written with a single sendmsg.
+ *
+ * @note Must be used from the thread running the event loop.
+ */
+class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
+public:
+    using Handler = std::function<void(HttpRequest, HttpResponder)>;
+
+private:
+    struct Slot {
+        bool head;
+        bool keepAlive;
+        std::optional<HttpResponse> response;
+    };
+
+    std::shared_ptr<Socket> _socket;
+    Handler _handler;
+    HttpRequestParser _parser;
+    size_t _maxPipelined;
+
+    std::deque<Slot> _slots;
+    uint64_t _firstSequence = 0;
+    uint64_t _nextSequence = 0;
+
+    // no more requests are read, after a request without keep-alive or a malformed one
+    bool _closing = false;
+    bool _peerEnded = false;
+    bool _reading = false;
+    bool _waitingDrain = false;
+    bool _processing = false;
+    bool _processAgain = false;
+    bool _readLoop = false;
+    bool _readAgain = false;
+
+    void readOnce() {
+        if (_reading || _closing || _peerEnded || !_socket->isOpen()
+         || _slots.size() >= _maxPipelined || _socket->needsDrain()) {
+            return;
+        }
+        _reading = true;
+        bool res = _socket->read([self = shared_from_this()](std::optional<std::string> data) {
+            self->_reading = false;
+            self->onData(std::move(data));
+        });
+        if (!res) {
+            _reading = false;
+        }
+    }
+
+    void readMore() {
+        // reads completed synchronously continue in the running loop instead of recursing
+        if (_readLoop) {
+            _readAgain = true;
+            return;
+        }
+        _readLoop = true;
+        do {
+            _readAgain = false;
+            readOnce();
+        } while (_readAgain);
+        _readLoop = false;
+    }
+
+    void onData(std::optional<std::string> data) {
+        if (!data) {
+            _peerEnded = true;
+            finishIfDone();
+            return;
+        }
+        _parser.feed(*data);
+        process();
+    }
+
+    void process() {
+        // responses sent synchronously by the handler continue in the running loop instead of recursing
+        if (_processing) {
+            _processAgain = true;
+            return;
+        }
+        _processing = true;
+        do {
+            _processAgain = false;
+            try {
+                while (!_closing && _socket->isOpen() && _slots.size() < _maxPipelined) {
+                    HttpRequest request;
+                    if (!_parser.next(request)) {
+                        break;
+                    }
+                    dispatch(std::move(request));
+                }
+            }
+            catch (HttpError& e) {
+                _closing = true;
+                HttpResponse response;
+                response.status = e.status();
+                response.bodyString = e.what();
+                _slots.push_back({ false, false, std::move(response) });
+                _nextSequence++;
+            }
+            writeResponses();
+        } while (_processAgain);
+        _processing = false;
+        readMore();
+    }
+
+    void dispatch(HttpRequest request) {
+        uint64_t sequence = _nextSequence++;
+        _slots.push_back({ request.method == "HEAD", request.keepAlive, std::nullopt });
+        if (!request.keepAlive) {
+            _closing = true;
+        }
+        try {
+            _handler(std::move(request), HttpResponder(shared_from_this(), sequence));
+        }
+        catch (...) {
+            HttpResponse response;
+            response.status = 500;
+            respond(sequence, std::move(response));
+        }
+    }
+
+    void finishIfDone() {
+        if (_slots.empty() && (_peerEnded || _closing) && _socket->isOpen()) {
+            _socket->end();
+        }
+    }
+
+    void writeResponses() {
+        while (!_slots.empty() && _slots.front().response) {
+            Slot slot = std::move(_slots.front());
+            _slots.pop_front();
+            _firstSequence++;
+
+            std::string head;
+            try {
+                slot.response->serializeHead(head, slot.keepAlive);
+            }
+            catch (std::invalid_argument&) {
+                head.clear();
+                HttpResponse error;
+                error.status = 500;
+                error.serializeHead(head, slot.keepAlive);
+                slot.head = true;
+            }
+
+            std::span<const uint8_t> buffers[2] = {
+                std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(head.data()), head.size()),
+                slot.head ? std::span<const uint8_t>() : slot.response->body()
+            };
+            try {
+                _socket->writeVector(buffers);
+            }
+            catch (std::exception&) {
+                // the peer is gone, the pending responses cannot be delivered
+                _socket->close();
+                _slots.clear();
+                return;
+            }
+
+            if (!slot.keepAlive) {
+                _closing = true;
+                _slots.clear();
+                break;
+            }
+        }
+
+        finishIfDone();
+        if (!_closing && _socket->isOpen() && _socket->needsDrain() && !_waitingDrain) {
+            _waitingDrain = true;
+            _socket->onDrain([self = shared_from_this()]() {
+                self->_waitingDrain = false;
+                self->process();
+            });
+        }
+    }
+
+public:
+    /**
+     * @param socket the connected socket
+     * @param handler called with every request and the responder for it
+     * @param limits limits of the request size
+     * @param maxPipelined maximum number of requests waiting for a response
+     */
+    HttpConnection(std::shared_ptr<Socket> socket, Handler handler, HttpLimits limits = {}, size_t maxPipelined = 16) :
+        _socket(std::move(socket)), _handler(std::move(handler)), _parser(limits), _maxPipelined(maxPipelined)
+    {}
+
+    /**
+     * @brief Start reading requests
+     */
+    void start() {
+        readMore();
+    }
+
+    /**
+     * @brief Send the response to the request with the sequence number
+     */
+    void respond(uint64_t sequence, HttpResponse response) {
+        if (sequence < _firstSequence || sequence - _firstSequence >= _slots.size()) {
+            return;
+        }
+        Slot& slot = _slots[sequence - _firstSequence];
+        if (slot.response) {
+            return;
+        }
+        if (sequence != _firstSequence && response.bodyOwner) {
+            // the borrowed memory may change before the previous responses are sent
+            auto body = response.body();
+            response.bodyString.assign(reinterpret_cast<const char*>(body.data()), body.size());
+            response.bodyView = {};
+            response.bodyOwner = nullptr;
+        }
+        slot.response = std::move(response);
+        if (sequence == _firstSequence) {
+            process();
+        }
+    }
+
+    Socket& socket() {
+        return *_socket;
+    }
+};
+
+
+inline void HttpResponder::send(HttpResponse response) {
+    _connection->respond(_sequence, std::move(response));
+}
+
+
+} // namespace jac
+
+#endif
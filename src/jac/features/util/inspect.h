@@ -0,0 +1,599 @@
+#pragma once
+
+#include <quickjs.h>
+
+#include <jac/machine/context.h>
+#include <jac/machine/internal/proxy.h>
+#include <jac/machine/values.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace jac {
+
+
+struct InspectOptions {
+    /**
+     * @brief Maximum nesting depth of printed objects, deeper objects are
+     * printed as `[Object]` or `[Array]`
+     */
+    int depth = 2;
+    /**
+     * @brief Maximum number of printed array elements and object properties
+     */
+    size_t maxItems = 100;
+    /**
+     * @brief Maximum length of printed nested strings
+     */
+    size_t maxStringLength = 10000;
+};
+
+
+/**
+ * @brief Formats JavaScript values into a native string, similarly to
+ * `util.format` and `util.inspect` in Node.js.
+ *
+ * The values are read directly using the QuickJS API, no JavaScript strings
+ * are created for objects and arrays. Own enumerable string-keyed properties
+ * are printed. Getters are not invoked and Proxy objects are printed as
+ * `[Proxy]` without running their traps - the only JavaScript code called is
+ * `toISOString` of Date objects and `JSON.stringify` for `%j`. Nested values
+ * are printed on a single line.
+ */
+class Inspector {
+    JSContext* _ctx;
+    std::string& _out;
+    InspectOptions _options;
+    std::vector<void*> _stack;
+
+    void clearException() {
+        JS_FreeValue(_ctx, JS_GetException(_ctx));
+    }
+
+    /**
+     * @brief Get the value of a data property of the object or its
+     * prototypes without invoking getters or Proxy traps
+     *
+     * @return The value, or undefined if the property is missing or is an
+     * accessor
+     */
+    JSValue dataProperty(JSValueConst obj, const char* name) {
+        JSAtom atom = JS_NewAtom(_ctx, name);
+        JSValue result = JS_UNDEFINED;
+        JSValue current = JS_DupValue(_ctx, obj);
+        while (JS_IsObject(current) && !isProxy(_ctx, current)) {
+            JSPropertyDescriptor desc;
+            int res = JS_GetOwnProperty(_ctx, &desc, current, atom);
+            if (res < 0) {
+                clearException();
+                break;
+            }
+            if (res > 0) {
+                JS_FreeValue(_ctx, desc.getter);
+                JS_FreeValue(_ctx, desc.setter);
+                result = desc.value;
+                break;
+            }
+            JSValue proto = JS_GetPrototype(_ctx, current);
+            if (JS_IsException(proto)) {
+                clearException();
+            }
+            JS_FreeValue(_ctx, current);
+            current = proto;
+        }
+        JS_FreeValue(_ctx, current);
+        JS_FreeAtom(_ctx, atom);
+        return result;
+    }
+
+    void appendString(JSValueConst val) {
+        size_t len;
+        const char* str = JS_ToCStringLen(_ctx, &len, val);
+        if (!str) {
+            clearException();
+            return;
+        }
+        _out.append(str, len);
+        JS_FreeCString(_ctx, str);
+    }
+
+    void appendQuoted(JSValueConst val) {
+        size_t len;
+        const char* str = JS_ToCStringLen(_ctx, &len, val);
+        if (!str) {
+            clearException();
+            return;
+        }
+        _out.push_back('\'');
+        for (size_t i = 0; i < std::min(len, _options.maxStringLength); i++) {
+            switch (str[i]) {
+                case '\'': _out.append("\\'"); break;
+                case '\\': _out.append("\\\\"); break;
+                case '\n': _out.append("\\n"); break;
+                case '\r': _out.append("\\r"); break;
+                case '\t': _out.append("\\t"); break;
+                default: _out.push_back(str[i]);
+            }
+        }
+        _out.push_back('\'');
+        if (len > _options.maxStringLength) {
+            _out.append("... ").append(std::to_string(len - _options.maxStringLength)).append(" more characters");
+        }
+        JS_FreeCString(_ctx, str);
+    }
+
+    void appendInteger(int64_t value) {
+        char buffer[24];
+        auto res = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        _out.append(buffer, res.ptr);
+    }
+
+    void appendNumber(JSValueConst val) {
+        if (JS_VALUE_GET_TAG(val) == JS_TAG_INT) {
+            appendInteger(JS_VALUE_GET_INT(val));
+            return;
+        }
+        double value = JS_VALUE_GET_FLOAT64(val);
+        if (std::isnan(value)) {
+            _out.append("NaN");
+        }
+        else if (std::isinf(value)) {
+            _out.append(value > 0 ? "Infinity" : "-Infinity");
+        }
+        else if (value == 0) {
+            _out.append(std::signbit(value) ? "-0" : "0");
+        }
+        else if (std::trunc(value) == value && std::abs(value) < 9007199254740992.0) {
+            appendInteger(static_cast<int64_t>(value));
+        }
+        else {
+            // QuickJS produces the shortest representation in the JavaScript format
+            appendString(val);
+        }
+    }
+
+    void appendKey(const char* key) {
+        std::string_view name(key);
+        bool identifier = !name.empty() && !(name[0] >= '0' && name[0] <= '9');
+        for (char c : name) {
+            if (!(std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$')) {
+                identifier = false;
+                break;
+            }
+        }
+        if (identifier) {
+            _out.append(name);
+            return;
+        }
+        _out.push_back('\'');
+        _out.append(name);
+        _out.push_back('\'');
+    }
+
+    std::string constructorName(JSValueConst obj) {
+        std::string result;
+        JSValue proto = JS_GetPrototype(_ctx, obj);
+        if (JS_IsObject(proto)) {
+            JSValue ctor = dataProperty(proto, "constructor");
+            if (JS_IsFunction(_ctx, ctor)) {
+                JSValue name = dataProperty(ctor, "name");
+                if (JS_IsString(name)) {
+                    const char* str = JS_ToCString(_ctx, name);
+                    if (str) {
+                        result = str;
+                        JS_FreeCString(_ctx, str);
+                    }
+                    else {
+                        clearException();
+                    }
+                }
+                JS_FreeValue(_ctx, name);
+            }
+            JS_FreeValue(_ctx, ctor);
+        }
+        else if (JS_IsNull(proto)) {
+            result = "[Object: null prototype]";
+        }
+        else if (JS_IsException(proto)) {
+            clearException();
+        }
+        JS_FreeValue(_ctx, proto);
+        return result;
+    }
+
+    void appendError(JSValueConst obj) {
+        JSValue stack = dataProperty(obj, "stack");
+        JSValue message = dataProperty(obj, "message");
+        JSValue name = dataProperty(obj, "name");
+        if (JS_IsString(name)) {
+            appendString(name);
+        }
+        else {
+            _out.append("Error");
+        }
+        if (JS_IsString(message)) {
+            size_t len;
+            const char* str = JS_ToCStringLen(_ctx, &len, message);
+            if (!str) {
+                clearException();
+            }
+            else if (len > 0) {
+                _out.append(": ").append(str, len);
+            }
+            JS_FreeCString(_ctx, str);
+        }
+        if (JS_IsString(stack)) {
+            _out.push_back('\n');
+            appendString(stack);
+            // the stack ends with a newline
+            if (!_out.empty() && _out.back() == '\n') {
+                _out.pop_back();
+            }
+        }
+        JS_FreeValue(_ctx, stack);
+        JS_FreeValue(_ctx, message);
+        JS_FreeValue(_ctx, name);
+    }
+
+    void appendFunction(JSValueConst obj) {
+        JSValue name = dataProperty(obj, "name");
+        size_t len = 0;
+        const char* str = JS_IsString(name) ? JS_ToCStringLen(_ctx, &len, name) : nullptr;
+        if (!str) {
+            clearException();
+        }
+        if (str && len > 0) {
+            _out.append("[Function: ").append(str, len).append("]");
+        }
+        else {
+            _out.append("[Function (anonymous)]");
+        }
+        JS_FreeCString(_ctx, str);
+        JS_FreeValue(_ctx, name);
+    }
+
+    void appendOwnProperty(JSValueConst obj, JSAtom atom, int depth) {
+        JSPropertyDescriptor desc;
+        int res = JS_GetOwnProperty(_ctx, &desc, obj, atom);
+        if (res < 0) {
+            clearException();
+        }
+        if (res <= 0) {
+            _out.append("undefined");
+            return;
+        }
+        if (desc.flags & JS_PROP_GETSET) {
+            bool getter = JS_IsFunction(_ctx, desc.getter);
+            bool setter = JS_IsFunction(_ctx, desc.setter);
+            _out.append(getter && setter ? "[Getter/Setter]" : getter ? "[Getter]" : "[Setter]");
+        }
+        else {
+            inspect(desc.value, depth + 1);
+        }
+        JS_FreeValue(_ctx, desc.value);
+        JS_FreeValue(_ctx, desc.getter);
+        JS_FreeValue(_ctx, desc.setter);
+    }
+
+    void appendElements(JSValueConst obj, uint32_t length, int depth) {
+        if (length == 0) {
+            _out.append("[]");
+            return;
+        }
+        _out.append("[ ");
+        uint32_t count = static_cast<uint32_t>(std::min<size_t>(length, _options.maxItems));
+        for (uint32_t i = 0; i < count; i++) {
+            if (i > 0) {
+                _out.append(", ");
+            }
+            JSAtom atom = JS_NewAtomUInt32(_ctx, i);
+            appendOwnProperty(obj, atom, depth);
+            JS_FreeAtom(_ctx, atom);
+        }
+        if (length > count) {
+            _out.append(", ... ").append(std::to_string(length - count)).append(" more items");
+        }
+        _out.append(" ]");
+    }
+
+    void appendProperties(JSValueConst obj, int depth) {
+        JSPropertyEnum* props;
+        uint32_t count;
+        if (JS_GetOwnPropertyNames(_ctx, &props, &count, obj, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) < 0) {
+            clearException();
+            _out.append("{}");
+            return;
+        }
+
+        size_t printed = 0;
+        size_t skipped = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            const char* key = JS_AtomToCString(_ctx, props[i].atom);
+            if (!key) {
+                clearException();
+                continue;
+            }
+            if (printed == _options.maxItems) {
+                skipped++;
+                JS_FreeCString(_ctx, key);
+                continue;
+            }
+
+            _out.append(printed == 0 ? "{ " : ", ");
+            printed++;
+            appendKey(key);
+            JS_FreeCString(_ctx, key);
+            _out.append(": ");
+            appendOwnProperty(obj, props[i].atom, depth);
+        }
+        JS_FreePropertyEnum(_ctx, props, count);
+
+        if (skipped > 0) {
+            _out.append(", ... ").append(std::to_string(skipped)).append(" more items");
+        }
+        _out.append(printed == 0 ? "{}" : " }");
+    }
+
+    void appendObject(JSValueConst obj, int depth) {
+        if (isProxy(_ctx, obj)) {
+            _out.append("[Proxy]");
+            return;
+        }
+        if (JS_IsFunction(_ctx, obj)) {
+            appendFunction(obj);
+            return;
+        }
+        if (JS_IsError(_ctx, obj)) {
+            appendError(obj);
+            return;
+        }
+
+        void* ptr = JS_VALUE_GET_PTR(obj);
+        for (void* seen : _stack) {
+            if (seen == ptr) {
+                _out.append("[Circular]");
+                return;
+            }
+        }
+
+        int isArray = JS_IsArray(_ctx, obj);
+        if (isArray < 0) {
+            clearException();
+            isArray = 0;
+        }
+        if (depth > _options.depth) {
+            _out.append(isArray ? "[Array]" : "[Object]");
+            return;
+        }
+
+        _stack.push_back(ptr);
+        if (isArray) {
+            JSValue lengthVal = dataProperty(obj, "length");
+            int64_t length = 0;
+            if (JS_ToInt64(_ctx, &length, lengthVal) < 0) {
+                clearException();
+            }
+            JS_FreeValue(_ctx, lengthVal);
+            appendElements(obj, static_cast<uint32_t>(length), depth);
+        }
+        else {
+            appendPlainObject(obj, depth);
+        }
+        _stack.pop_back();
+    }
+
+    void appendPlainObject(JSValueConst obj, int depth) {
+        std::string name = constructorName(obj);
+
+        size_t size;
+        if (JS_GetArrayBuffer(_ctx, &size, obj)) {
+            _out.append(name).append(" { byteLength: ");
+            appendInteger(static_cast<int64_t>(size));
+            _out.append(" }");
+            return;
+        }
+        clearException();
+
+        size_t bytesPerElement;
+        size_t byteLength;
+        JSValue buffer = JS_GetTypedArrayBuffer(_ctx, obj, nullptr, &byteLength, &bytesPerElement);
+        if (!JS_IsException(buffer)) {
+            JS_FreeValue(_ctx, buffer);
+            uint32_t length = static_cast<uint32_t>(byteLength / bytesPerElement);
+            _out.append(name).append("(").append(std::to_string(length)).append(") ");
+            appendElements(obj, length, depth);
+            return;
+        }
+        clearException();
+
+        if (name == "Date") {
+            JSValue iso = dataProperty(obj, "toISOString");
+            JSValue str = JS_IsFunction(_ctx, iso) ? JS_Call(_ctx, iso, obj, 0, nullptr) : JS_UNDEFINED;
+            if (JS_IsString(str)) {
+                appendString(str);
+            }
+            else {
+                clearException();
+                _out.append("Invalid Date");
+            }
+            JS_FreeValue(_ctx, str);
+            JS_FreeValue(_ctx, iso);
+            return;
+        }
+
+        if (!name.empty() && name != "Object") {
+            _out.append(name).push_back(' ');
+        }
+        appendProperties(obj, depth);
+    }
+
+    void inspect(JSValueConst val, int depth) {
+        switch (JS_VALUE_GET_TAG(val)) {
+            case JS_TAG_UNDEFINED:
+                _out.append("undefined");
+                break;
+            case JS_TAG_NULL:
+                _out.append("null");
+                break;
+            case JS_TAG_BOOL:
+                _out.append(JS_VALUE_GET_BOOL(val) ? "true" : "false");
+                break;
+            case JS_TAG_INT:
+            case JS_TAG_FLOAT64:
+                appendNumber(val);
+                break;
+            case JS_TAG_STRING:
+                if (depth == 0) {
+                    appendString(val);
+                }
+                else {
+                    appendQuoted(val);
+                }
+                break;
+            case JS_TAG_SYMBOL: {
+                // the description getter of Symbol.prototype could be replaced
+                JSAtom atom = JS_ValueToAtom(_ctx, val);
+                const char* description = atom == JS_ATOM_NULL ? nullptr : JS_AtomToCString(_ctx, atom);
+                if (!description) {
+                    clearException();
+                }
+                _out.append("Symbol(").append(description ? description : "").append(")");
+                JS_FreeCString(_ctx, description);
+                JS_FreeAtom(_ctx, atom);
+                break;
+            }
+            case JS_TAG_OBJECT:
+                appendObject(val, depth);
+                break;
+            default:
+                // the remaining primitive tags are BigInt representations
+                appendString(val);
+                _out.push_back('n');
+        }
+    }
+
+    void appendFormatted(char specifier, JSValueConst val) {
+        switch (specifier) {
+            case 's':
+                if (JS_IsString(val)) {
+                    appendString(val);
+                }
+                else {
+                    inspect(val, JS_IsObject(val) ? _options.depth : 0);
+                }
+                break;
+            case 'd':
+            case 'i':
+            case 'f': {
+                double value;
+                if (JS_IsObject(val) || JS_IsSymbol(val) || JS_ToFloat64(_ctx, &value, val) < 0) {
+                    clearException();
+                    _out.append("NaN");
+                    break;
+                }
+                if (specifier != 'f') {
+                    value = std::trunc(value);
+                }
+                JSValue number = JS_NewFloat64(_ctx, value);
+                appendNumber(number);
+                break;
+            }
+            case 'j': {
+                JSValue json = JS_JSONStringify(_ctx, val, JS_UNDEFINED, JS_UNDEFINED);
+                if (JS_IsException(json)) {
+                    clearException();
+                    _out.append("[Circular]");
+                }
+                else {
+                    appendString(json);
+                }
+                JS_FreeValue(_ctx, json);
+                break;
+            }
+            case 'o':
+            case 'O':
+                if (JS_IsString(val)) {
+                    appendQuoted(val);
+                }
+                else {
+                    inspect(val, 0);
+                }
+                break;
+            case 'c':
+                break;
+        }
+    }
+
+public:
+    Inspector(ContextRef ctx, std::string& out, InspectOptions options = {}) :
+        _ctx(ctx), _out(out), _options(options)
+    {}
+
+    /**
+     * @brief Append the representation of a value to the output. Top-level
+     * strings are appended as they are, nested strings are quoted.
+     *
+     * @param val the value
+     */
+    void inspect(JSValueConst val) {
+        inspect(val, 0);
+    }
+
+    /**
+     * @brief Append the values to the output separated by spaces. If the
+     * first value is a string, it is used as a format string with the
+     * substitutions `%s`, `%d`, `%i`, `%f`, `%j`, `%o`, `%O`, `%c` and `%%`.
+     *
+     * @param args the values
+     */
+    void format(std::span<ValueWeak> args) {
+        size_t next = 0;
+        if (!args.empty() && JS_IsString(args[0].getVal())) {
+            next = 1;
+            size_t len;
+            const char* str = JS_ToCStringLen(_ctx, &len, args[0].getVal());
+            if (!str) {
+                clearException();
+                len = 0;
+            }
+            for (size_t i = 0; i < len; i++) {
+                if (str[i] != '%' || i + 1 == len) {
+                    _out.push_back(str[i]);
+                    continue;
+                }
+                char specifier = str[i + 1];
+                if (specifier == '%') {
+                    _out.push_back('%');
+                    i++;
+                }
+                else if (std::string_view("sdifjoOc").find(specifier) != std::string_view::npos && next < args.size()) {
+                    appendFormatted(specifier, args[next].getVal());
+                    next++;
+                    i++;
+                }
+                else {
+                    _out.push_back('%');
+                }
+            }
+            JS_FreeCString(_ctx, str);
+        }
+
+        for (; next < args.size(); next++) {
+            if (next > 0) {
+                _out.push_back(' ');
+            }
+            inspect(args[next].getVal(), 0);
+        }
+    }
+};
+
+
+} // namespace jac
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cerrno>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+
+namespace jac {
+
+
+/**
+ * @brief Notifies about readiness of file descriptors. The callbacks are
+ * called on the thread running the event loop.
+ *
+ * A descriptor can have one readable and one writable watcher. Errors and
+ * hang-ups are reported to both, the callback finds out the cause from the
+ * result of the following read or write.
+ */
+class IoReactor {
+public:
+    /**
+     * @brief Call the callback whenever the file descriptor is readable,
+     * until unwatchReadable() or unwatch() is called. Replaces a previous
+     * readable watcher of the descriptor.
+     *
+     * @param fd the file descriptor
+     * @param callback the function
+     */
+    virtual void watchReadable(int fd, std::function<void()> callback) = 0;
+
+    /**
+     * @brief Call the callback whenever the file descriptor is writable,
+     * until unwatchWritable() or unwatch() is called. Replaces a previous
+     * writable watcher of the descriptor.
+     *
+     * @param fd the file descriptor
+     * @param callback the function
+     */
+    virtual void watchWritable(int fd, std::function<void()> callback) = 0;
+
+    /**
+     * @brief Remove the readable watcher of the file descriptor
+     *
+     * @param fd the file descriptor
+     */
+    virtual void unwatchReadable(int fd) = 0;
+
+    /**
+     * @brief Remove the writable watcher of the file descriptor
+     *
+     * @param fd the file descriptor
+     */
+    virtual void unwatchWritable(int fd) = 0;
+
+    /**
+     * @brief Remove all watchers of the file descriptor. Must be called
+     * before the descriptor is closed.
+     *
+     * @param fd the file descriptor
+     */
+    virtual void unwatch(int fd) {
+        unwatchReadable(fd);
+        unwatchWritable(fd);
+    }
+
+    virtual ~IoReactor() = default;
+};
+
+
+#ifdef __linux__
+
+/**
+ * @brief IoReactor based on epoll. Watchers are level-triggered.
+ *
+ * @note Not thread-safe, the watchers must be managed from the thread
+ * running the event loop. Other threads wake up the wait through the wake
+ * up descriptor (see setWakeFd).
+ */
+class EpollReactor : public IoReactor {
+    struct Watcher {
+        std::function<void()> onReadable;
+        std::function<void()> onWritable;
+    };
+
+    int _epollFd = -1;
+    int _wakeFd = -1;
+    std::unordered_map<int, Watcher> _watchers;
+
+    void update(int fd, bool registered) {
+        auto it = _watchers.find(fd);
+        uint32_t events = 0;
+        if (it->second.onReadable) {
+            events |= EPOLLIN | EPOLLRDHUP;
+        }
+        if (it->second.onWritable) {
+            events |= EPOLLOUT;
+        }
+
+        if (events == 0) {
+            _watchers.erase(it);
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+            return;
+        }
+
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        if (epoll_ctl(_epollFd, registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) < 0) {
+            int error = errno;
+            if (!registered) {
+                _watchers.erase(it);
+            }
+            throw std::system_error(error, std::generic_category(), "EpollReactor: cannot watch file descriptor " + std::to_string(fd));
+        }
+    }
+
+    void dispatch(int fd, std::function<void()> Watcher::* callback) {
+        // a watcher may remove itself or other watchers
+        auto it = _watchers.find(fd);
+        if (it != _watchers.end() && it->second.*callback) {
+            auto callback_ = it->second.*callback;
+            callback_();
+        }
+    }
+
+public:
+    EpollReactor() {
+        _epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (_epollFd < 0) {
+            throw std::runtime_error("EpollReactor: epoll_create1 failed");
+        }
+    }
+
+    EpollReactor(const EpollReactor&) = delete;
+    EpollReactor& operator=(const EpollReactor&) = delete;
+
+    /**
+     * @brief Set a file descriptor which interrupts wait() when readable,
+     * without any watcher being called
+     *
+     * @param fd the file descriptor
+     */
+    void setWakeFd(int fd) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            throw std::runtime_error("EpollReactor: cannot watch the wake up descriptor");
+        }
+        _wakeFd = fd;
+    }
+
+    /**
+     * @brief Get the epoll file descriptor, which is readable whenever
+     * wait() would not block
+     */
+    int fd() const {
+        return _epollFd;
+    }
+
+    void watchReadable(int fd, std::function<void()> callback) override {
+        auto [it, inserted] = _watchers.try_emplace(fd);
+        auto previous = std::exchange(it->second.onReadable, std::move(callback));
+        try {
+            update(fd, !inserted);
+        }
+        catch (...) {
+            if (!inserted) {
+                it->second.onReadable = std::move(previous);
+            }
+            throw;
+        }
+    }
+
+    void watchWritable(int fd, std::function<void()> callback) override {
+        auto [it, inserted] = _watchers.try_emplace(fd);
+        auto previous = std::exchange(it->second.onWritable, std::move(callback));
+        try {
+            update(fd, !inserted);
+        }
+        catch (...) {
+            if (!inserted) {
+                it->second.onWritable = std::move(previous);
+            }
+            throw;
+        }
+    }
+
+    void unwatchReadable(int fd) override {
+        auto it = _watchers.find(fd);
+        if (it != _watchers.end() && it->second.onReadable) {
+            it->second.onReadable = nullptr;
+            update(fd, true);
+        }
+    }
+
+    void unwatchWritable(int fd) override {
+        auto it = _watchers.find(fd);
+        if (it != _watchers.end() && it->second.onWritable) {
+            it->second.onWritable = nullptr;
+            update(fd, true);
+        }
+    }
+
+    void unwatch(int fd) override {
+        if (_watchers.erase(fd) > 0) {
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        }
+    }
+
+    /**
+     * @brief Check if any file descriptor is watched
+     */
+    bool empty() const {
+        return _watchers.empty();
+    }
+
+    /**
+     * @brief Wait until a watched file descriptor is ready
+     *
+     * @param timeoutMs maximum time to wait, -1 to wait indefinitely
+     * @return A function calling the watchers of the ready descriptors, or
+     * std::nullopt if none is ready
+     */
+    std::optional<std::function<void()>> wait(int timeoutMs) {
+        epoll_event received[64];
+        int count;
+        do {
+            count = epoll_wait(_epollFd, received, 64, timeoutMs);
+        } while (count < 0 && errno == EINTR);
+
+        std::vector<std::pair<int, uint32_t>> ready;
+        for (int i = 0; i < count; i++) {
+            int fd = received[i].data.fd;
+            uint32_t events = received[i].events;
+            if (fd != _wakeFd) {
+                ready.emplace_back(fd, events);
+            }
+        }
+        if (ready.empty()) {
+            return std::nullopt;
+        }
+
+        return [this, ready = std::move(ready)]() {
+            for (auto [fd, events] : ready) {
+                if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    dispatch(fd, &Watcher::onReadable);
+                }
+                if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                    dispatch(fd, &Watcher::onWritable);
+                }
+            }
+        };
+    }
+
+    ~EpollReactor() {
+        close(_epollFd);
+    }
+};
+
+#endif
+
+
+} // namespace jac
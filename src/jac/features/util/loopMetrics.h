@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <jac/machine/histogram.h>
+
+#include "eventPriority.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief Metrics of a single event loop. Updated by the event loop thread,
+ * can be read from any thread without locking.
+ *
+ * Durations are recorded in microseconds.
+ */
+struct LoopMetrics {
+    /** @brief Number of events waiting in the event queue */
+    std::atomic<uint64_t> queueDepth = 0;
+    /** @brief Total number of scheduled events */
+    std::atomic<uint64_t> eventsScheduled = 0;
+    /** @brief Total number of dispatched events */
+    std::atomic<uint64_t> eventsDispatched = 0;
+    /** @brief Number of events discarded because the bounded queue was full */
+    std::atomic<uint64_t> eventsDropped = 0;
+    /** @brief Number of events rejected because the bounded queue was full */
+    std::atomic<uint64_t> eventsRejected = 0;
+    /** @brief Time spent dispatching events and executing jobs */
+    std::atomic<uint64_t> busyTime = 0;
+    /** @brief Time spent waiting for events */
+    std::atomic<uint64_t> idleTime = 0;
+
+    /** @brief Time from scheduling an event to its dispatch */
+    Histogram dispatchLatency;
+    /** @brief Time from scheduling an event to its dispatch, per priority lane */
+    std::array<Histogram, eventPriorityCount> laneLatency;
+    /** @brief Execution time of events */
+    Histogram executionTime;
+    /** @brief Number of jobs (microtasks) executed after an event */
+    Histogram jobsPerTurn;
+    /** @brief Time from the deadline of a timer to the start of its callback */
+    Histogram loopLag;
+
+    static uint64_t micros(std::chrono::steady_clock::duration duration) {
+        auto count = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        return count > 0 ? static_cast<uint64_t>(count) : 0;
+    }
+
+    static void writeJson(std::ostream& os, const Histogram& hist) {
+        auto snap = hist.snapshot();
+        os << "{\"count\":" << snap.count << ",\"sum\":" << snap.sum
+           << ",\"p50\":" << snap.percentile(0.5) << ",\"p99\":" << snap.percentile(0.99) << ",\"buckets\":[";
+        for (size_t i = 0; i < Histogram::bucketCount; i++) {
+            os << (i == 0 ? "" : ",") << snap.buckets[i];
+        }
+        os << "]}";
+    }
+
+    /**
+     * @brief Export the metrics as a JSON object
+     *
+     * @return The JSON string
+     */
+    std::string toJson() const {
+        std::ostringstream os;
+        auto histogram = [&os](std::string_view name, const Histogram& hist) {
+            os << ",\"" << name << "\":";
+            writeJson(os, hist);
+        };
+
+        os << "{\"queueDepth\":" << queueDepth.load(std::memory_order_relaxed)
+           << ",\"eventsScheduled\":" << eventsScheduled.load(std::memory_order_relaxed)
+           << ",\"eventsDispatched\":" << eventsDispatched.load(std::memory_order_relaxed)
+           << ",\"eventsDropped\":" << eventsDropped.load(std::memory_order_relaxed)
+           << ",\"eventsRejected\":" << eventsRejected.load(std::memory_order_relaxed)
+           << ",\"busyTimeUs\":" << busyTime.load(std::memory_order_relaxed)
+           << ",\"idleTimeUs\":" << idleTime.load(std::memory_order_relaxed);
+        histogram("dispatchLatencyUs", dispatchLatency);
+        os << ",\"laneLatencyUs\":{";
+        for (size_t lane = 0; lane < eventPriorityCount; lane++) {
+            if (lane > 0) {
+                os << ",";
+            }
+            os << "\"" << eventPriorityName(static_cast<EventPriority>(lane)) << "\":";
+            writeJson(os, laneLatency[lane]);
+        }
+        os << "}";
+        histogram("executionTimeUs", executionTime);
+        histogram("jobsPerTurn", jobsPerTurn);
+        histogram("loopLagUs", loopLag);
+        os << "}";
+
+        return os.str();
+    }
+
+    /**
+     * @brief Write the metrics of multiple event loops in the Prometheus text
+     * exposition format. Samples of each metric family are grouped together.
+     *
+     * @param os the output stream
+     * @param loops pairs of label sets (e.g. `machine="a"`, may be empty) and metrics
+     * @param prefix the prefix of metric names
+     */
+    static void writePrometheus(std::ostream& os, const std::vector<std::pair<std::string, const LoopMetrics*>>& loops,
+                                std::string_view prefix = "jac_event_loop") {
+        auto labels = [](const std::string& base, std::string_view extra = "") {
+            if (base.empty() && extra.empty()) {
+                return std::string();
+            }
+            std::string result = "{" + base;
+            if (!base.empty() && !extra.empty()) {
+                result += ",";
+            }
+            return result + std::string(extra) + "}";
+        };
+
+        auto scalar = [&](std::string_view name, std::string_view type, double scale, auto member) {
+            os << "# TYPE " << prefix << "_" << name << " " << type << "\n";
+            for (auto& [label, metrics] : loops) {
+                os << prefix << "_" << name << labels(label) << " "
+                   << static_cast<double>((metrics->*member).load(std::memory_order_relaxed)) * scale << "\n";
+            }
+        };
+
+        auto histogramSamples = [&](std::string_view name, double scale, const Histogram& hist, const std::string& label) {
+            auto snap = hist.snapshot();
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i + 1 < Histogram::bucketCount; i++) {
+                cumulative += snap.buckets[i];
+                std::ostringstream le;
+                le << "le=\"" << static_cast<double>(Histogram::bucketBound(i)) * scale << "\"";
+                os << prefix << "_" << name << "_bucket" << labels(label, le.str()) << " " << cumulative << "\n";
+            }
+            os << prefix << "_" << name << "_bucket" << labels(label, "le=\"+Inf\"") << " " << snap.count << "\n";
+            os << prefix << "_" << name << "_sum" << labels(label) << " " << static_cast<double>(snap.sum) * scale << "\n";
+            os << prefix << "_" << name << "_count" << labels(label) << " " << snap.count << "\n";
+        };
+
+        auto histogram = [&](std::string_view name, double scale, Histogram LoopMetrics::* member) {
+            os << "# TYPE " << prefix << "_" << name << " histogram\n";
+            for (auto& [label, metrics] : loops) {
+                histogramSamples(name, scale, metrics->*member, label);
+            }
+        };
+
+        scalar("queue_depth", "gauge", 1, &LoopMetrics::queueDepth);
+        scalar("events_scheduled_total", "counter", 1, &LoopMetrics::eventsScheduled);
+        scalar("events_dispatched_total", "counter", 1, &LoopMetrics::eventsDispatched);
+        scalar("events_dropped_total", "counter", 1, &LoopMetrics::eventsDropped);
+        scalar("events_rejected_total", "counter", 1, &LoopMetrics::eventsRejected);
+        scalar("busy_seconds_total", "counter", 1e-6, &LoopMetrics::busyTime);
+        scalar("idle_seconds_total", "counter", 1e-6, &LoopMetrics::idleTime);
+        histogram("dispatch_latency_seconds", 1e-6, &LoopMetrics::dispatchLatency);
+        os << "# TYPE " << prefix << "_lane_latency_seconds histogram\n";
+        for (auto& [label, metrics] : loops) {
+            for (size_t lane = 0; lane < eventPriorityCount; lane++) {
+                std::string laneLabel = label + (label.empty() ? "" : ",") + "lane=\""
+                                      + std::string(eventPriorityName(static_cast<EventPriority>(lane))) + "\"";
+                histogramSamples("lane_latency_seconds", 1e-6, metrics->laneLatency[lane], laneLabel);
+            }
+        }
+        histogram("execution_time_seconds", 1e-6, &LoopMetrics::executionTime);
+        histogram("jobs_per_turn", 1, &LoopMetrics::jobsPerTurn);
+        histogram("lag_seconds", 1e-6, &LoopMetrics::loopLag);
+    }
+
+    /**
+     * @brief Export the metrics in the Prometheus text exposition format
+     *
+     * @param labels the label set added to all samples (e.g. `machine="a"`)
+     * @return The exported metrics
+     */
+    std::string toPrometheus(std::string labels = "") const {
+        std::ostringstream os;
+        writePrometheus(os, { { std::move(labels), this } });
+        return os.str();
+    }
+};
+
+
+/**
+ * @brief Satisfied by machines which contain LoopMetricsFeature
+ */
+template<class Machine>
+concept HasLoopMetrics = requires(Machine& machine) {
+    { machine.loopMetrics() } -> std::same_as<LoopMetrics&>;
+};
+
+
+} // namespace jac
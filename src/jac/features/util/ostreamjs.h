@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <memory>
+#include <span>
 
 #include "../types/streams.h"
 
@@ -16,6 +17,14 @@ public:
     void write(std::string data) override {
         _stream.write(data.data(), data.size());
     }
+
+    void write(std::span<const uint8_t> data) override {
+        _stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    void flush() override {
+        _stream.flush();
+    }
 };
 
 
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+namespace jac {
+
+
+/**
+ * @brief Runs many machines on a fixed pool of worker threads.
+ *
+ * A machine is run only when it has work to do - when an event is scheduled,
+ * its event loop is notified or its next deadline (e.g. of a timer) is reached.
+ * Each run is a single EventLoopFeature::runOnce step on one of the workers.
+ * Runnable machines are distributed between per-worker queues and idle workers
+ * steal from the queues of the others. A machine is never run by two workers
+ * at the same time.
+ *
+ * @note The machines must be initialized before they are added and must
+ * stay alive while the scheduler runs. When the scheduler is destroyed, the
+ * wakeup handlers of the machines are removed and the machines are no longer
+ * run. No events may be scheduled to the machines while the scheduler is
+ * being destroyed.
+ */
+class MachineScheduler {
+    using Clock = std::chrono::steady_clock;
+
+    enum State : int {
+        Idle,
+        Queued,
+        Running,
+        RunningNotified,
+        Finished
+    };
+
+    struct Entry {
+        std::function<std::optional<Clock::time_point>(int)> step;
+        std::function<bool()> hasExited;
+        std::function<void(std::exception_ptr)> onFinish;
+        std::function<void()> detach;
+        std::atomic<int> state = Idle;
+        std::optional<Clock::time_point> armedDeadline;
+    };
+
+    struct Worker {
+        std::deque<Entry*> queue;
+        std::mutex mutex;
+        std::thread thread;
+    };
+
+    struct TimerEntry {
+        Clock::time_point deadline;
+        Entry* entry;
+
+        bool operator>(const TimerEntry& other) const {
+            return deadline > other.deadline;
+        }
+    };
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    std::vector<std::unique_ptr<Entry>> _entries;
+    std::mutex _entriesMutex;
+    std::condition_variable _finishedCondition;
+    size_t _running = 0;
+
+    std::atomic<size_t> _pending = 0;
+    std::atomic<size_t> _nextWorker = 0;
+    std::mutex _sleepMutex;
+    std::condition_variable _sleepCondition;
+
+    std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<>> _timers;
+    std::mutex _timersMutex;
+    std::condition_variable _timersCondition;
+    std::thread _timerThread;
+
+    std::atomic<bool> _stop = false;
+    std::atomic<int> _eventBudget = 64;
+
+    void push(Entry* entry, size_t worker) {
+        // counted before it is published, so that pop never decrements below zero
+        {
+            std::scoped_lock lock(_sleepMutex);
+            _pending++;
+        }
+        {
+            std::scoped_lock lock(_workers[worker]->mutex);
+            _workers[worker]->queue.push_back(entry);
+        }
+        _sleepCondition.notify_one();
+    }
+
+    Entry* pop(size_t worker) {
+        for (size_t i = 0; i < _workers.size(); i++) {
+            Worker& victim = *_workers[(worker + i) % _workers.size()];
+            std::scoped_lock lock(victim.mutex);
+            if (victim.queue.empty()) {
+                continue;
+            }
+
+            Entry* entry;
+            if (i == 0) {
+                entry = victim.queue.front();
+                victim.queue.pop_front();
+            }
+            else {
+                entry = victim.queue.back();
+                victim.queue.pop_back();
+            }
+            _pending--;
+            return entry;
+        }
+        return nullptr;
+    }
+
+    void wake(Entry* entry) {
+        int state = entry->state.load();
+        while (true) {
+            if (state == Idle) {
+                if (entry->state.compare_exchange_weak(state, Queued)) {
+                    push(entry, _nextWorker++ % _workers.size());
+                    return;
+                }
+            }
+            else if (state == Running) {
+                if (entry->state.compare_exchange_weak(state, RunningNotified)) {
+                    return;
+                }
+            }
+            else {
+                return;
+            }
+        }
+    }
+
+    void arm(Entry* entry, Clock::time_point deadline) {
+        std::scoped_lock lock(_timersMutex);
+        if (entry->armedDeadline && *entry->armedDeadline <= deadline) {
+            return;
+        }
+        entry->armedDeadline = deadline;
+        _timers.push({ deadline, entry });
+        if (_timers.top().entry == entry) {
+            _timersCondition.notify_one();
+        }
+    }
+
+    void finish(Entry* entry, std::exception_ptr error) {
+        entry->state = Finished;
+        if (entry->onFinish) {
+            entry->onFinish(error);
+        }
+
+        {
+            std::scoped_lock lock(_entriesMutex);
+            _running--;
+        }
+        _finishedCondition.notify_all();
+    }
+
+    void run(Entry* entry, size_t worker) {
+        entry->state = Running;
+
+        std::optional<Clock::time_point> next;
+        std::exception_ptr error;
+        try {
+            next = entry->step(_eventBudget);
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+
+        if (error || entry->hasExited()) {
+            finish(entry, error);
+            return;
+        }
+
+        if (next && *next <= Clock::now()) {
+            entry->state = Queued;
+            push(entry, worker);
+            return;
+        }
+        if (next) {
+            arm(entry, *next);
+        }
+
+        int expected = Running;
+        if (!entry->state.compare_exchange_strong(expected, Idle)) {
+            // woken up while running
+            entry->state = Queued;
+            push(entry, worker);
+        }
+    }
+
+    void workerLoop(size_t worker) {
+        while (!_stop) {
+            Entry* entry = pop(worker);
+            if (!entry) {
+                std::unique_lock lock(_sleepMutex);
+                _sleepCondition.wait(lock, [this] { return _pending > 0 || _stop; });
+                continue;
+            }
+            run(entry, worker);
+        }
+    }
+
+    void timerLoop() {
+        std::unique_lock lock(_timersMutex);
+        while (!_stop) {
+            if (_timers.empty()) {
+                _timersCondition.wait(lock);
+                continue;
+            }
+
+            auto top = _timers.top();
+            if (top.deadline > Clock::now()) {
+                _timersCondition.wait_until(lock, top.deadline);
+                continue;
+            }
+
+            _timers.pop();
+            if (top.entry->armedDeadline == top.deadline) {
+                top.entry->armedDeadline.reset();
+            }
+
+            lock.unlock();
+            wake(top.entry);
+            lock.lock();
+        }
+    }
+public:
+    /**
+     * @brief Create the scheduler and start its worker threads
+     *
+     * @param workers number of worker threads
+     */
+    MachineScheduler(unsigned workers = std::thread::hardware_concurrency()) {
+        if (workers == 0) {
+            workers = 1;
+        }
+        for (unsigned i = 0; i < workers; i++) {
+            _workers.push_back(std::make_unique<Worker>());
+        }
+        for (unsigned i = 0; i < workers; i++) {
+            _workers[i]->thread = std::thread([this, i]() {
+                workerLoop(i);
+            });
+        }
+        _timerThread = std::thread([this]() {
+            timerLoop();
+        });
+    }
+
+    MachineScheduler(const MachineScheduler&) = delete;
+    MachineScheduler(MachineScheduler&&) = delete;
+    MachineScheduler& operator=(const MachineScheduler&) = delete;
+    MachineScheduler& operator=(MachineScheduler&&) = delete;
+
+    /**
+     * @brief Set the maximum number of events dispatched in a single run of
+     * a machine before other machines get a chance to run
+     *
+     * @param budget the number of events
+     */
+    void setEventBudget(int budget) {
+        _eventBudget = budget;
+    }
+
+    /**
+     * @brief Add a machine to the scheduler. The machine is run until it exits
+     * or its event loop throws.
+     * @note The machine must contain EventQueueFeature and EventLoopFeature.
+     *
+     * @param machine the machine
+     * @param onFinish function called from a worker thread when the machine
+     * exits, with the exception thrown from the event loop, if any
+     */
+    template<class Machine>
+    void add(Machine& machine, std::function<void(std::exception_ptr)> onFinish = nullptr) {
+        auto entry = std::make_unique<Entry>();
+        Entry* ptr = entry.get();
+
+        ptr->step = [&machine](int budget) {
+            return machine.runOnce(std::chrono::milliseconds(0), budget);
+        };
+        ptr->hasExited = [&machine]() {
+            return machine.hasExited();
+        };
+        ptr->onFinish = std::move(onFinish);
+        ptr->detach = [&machine]() {
+            machine.setWakeupHandler(nullptr);
+        };
+
+        {
+            std::scoped_lock lock(_entriesMutex);
+            _entries.push_back(std::move(entry));
+            _running++;
+        }
+
+        machine.setWakeupHandler([this, ptr]() {
+            wake(ptr);
+        });
+        wake(ptr);
+    }
+
+    /**
+     * @brief Wait until all added machines exit
+     */
+    void waitAll() {
+        std::unique_lock lock(_entriesMutex);
+        _finishedCondition.wait(lock, [this] { return _running == 0; });
+    }
+
+    ~MachineScheduler() {
+        {
+            std::scoped_lock lock(_sleepMutex, _timersMutex);
+            _stop = true;
+        }
+        _sleepCondition.notify_all();
+        _timersCondition.notify_all();
+
+        for (auto& worker : _workers) {
+            worker->thread.join();
+        }
+        _timerThread.join();
+
+        // the machines may outlive the scheduler, their handlers must not call into it
+        for (auto& entry : _entries) {
+            entry->detach();
+        }
+    }
+};
+
+
+} // namespace jac
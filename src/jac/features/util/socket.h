@@ -0,0 +1,913 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../types/streams.h"
+#include "ioReactor.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief Address of a TCP or a Unix domain socket
+ */
+struct SocketAddress {
+    sockaddr_storage storage{};
+    socklen_t length = 0;
+
+    /**
+     * @brief Create a TCP address. No name resolution is done, the host must
+     * be an IPv4 or IPv6 address or "localhost".
+     *
+     * @param host the IP address
+     * @param port the port, 0 to choose one when listening
+     */
+    static SocketAddress tcp(const std::string& host, int port) {
+        if (port < 0 || port > 65535) {
+            throw std::invalid_argument("Port must be between 0 and 65535");
+        }
+        SocketAddress address;
+        std::string ip = host == "localhost" ? "127.0.0.1" : host;
+
+        in_addr ip4;
+        in6_addr ip6;
+        if (inet_pton(AF_INET, ip.c_str(), &ip4) == 1) {
+            auto* in = reinterpret_cast<sockaddr_in*>(&address.storage);
+            in->sin_family = AF_INET;
+            in->sin_port = htons(static_cast<uint16_t>(port));
+            in->sin_addr = ip4;
+            address.length = sizeof(sockaddr_in);
+        }
+        else if (inet_pton(AF_INET6, ip.c_str(), &ip6) == 1) {
+            auto* in6 = reinterpret_cast<sockaddr_in6*>(&address.storage);
+            in6->sin6_family = AF_INET6;
+            in6->sin6_port = htons(static_cast<uint16_t>(port));
+            in6->sin6_addr = ip6;
+            address.length = sizeof(sockaddr_in6);
+        }
+        else {
+            throw std::invalid_argument("Host must be an IP address: " + host);
+        }
+        return address;
+    }
+
+    /**
+     * @brief Create a Unix domain socket address
+     *
+     * @param path the path of the socket file
+     */
+    static SocketAddress local(const std::string& path) {
+        SocketAddress address;
+        auto* un = reinterpret_cast<sockaddr_un*>(&address.storage);
+        if (path.empty() || path.size() >= sizeof(un->sun_path)) {
+            throw std::invalid_argument("Invalid socket path: " + path);
+        }
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        address.length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+        return address;
+    }
+
+    int family() const {
+        return storage.ss_family;
+    }
+
+    const sockaddr* get() const {
+        return reinterpret_cast<const sockaddr*>(&storage);
+    }
+};
+
+
+/**
+ * @brief A resource watched by an IoReactor
+ */
+class IoHandle {
+public:
+    /**
+     * @brief Stop watching and close the descriptor, without calling any
+     * pending callbacks
+     */
+    virtual void detach() = 0;
+
+    /**
+     * @brief Called when a descriptor of the registry was released after
+     * the handle waited for one (see SocketRegistry::waitForDescriptor)
+     */
+    virtual void descriptorReleased() {}
+
+    virtual ~IoHandle() = default;
+};
+
+
+/**
+ * @brief Tracks the open sockets of a machine, so that they can be closed
+ * before the reactor they are registered with is destroyed
+ */
+class SocketRegistry {
+    IoReactor& _reactor;
+    std::unordered_set<IoHandle*> _handles;
+    std::unordered_set<IoHandle*> _waiting;
+public:
+    SocketRegistry(IoReactor& reactor) : _reactor(reactor) {}
+
+    IoReactor& reactor() {
+        return _reactor;
+    }
+
+    void add(IoHandle* handle) {
+        _handles.insert(handle);
+    }
+
+    void remove(IoHandle* handle) {
+        _handles.erase(handle);
+        _waiting.erase(handle);
+        if (!_waiting.empty()) {
+            auto waiting = std::move(_waiting);
+            _waiting.clear();
+            for (IoHandle* other : waiting) {
+                other->descriptorReleased();
+            }
+        }
+    }
+
+    /**
+     * @brief Notify the handle once another handle of the registry is
+     * removed, i.e. when the process may have a free descriptor again
+     */
+    void waitForDescriptor(IoHandle* handle) {
+        _waiting.insert(handle);
+    }
+
+    size_t size() const {
+        return _handles.size();
+    }
+
+    /**
+     * @brief Detach all handles, pending callbacks are dropped without being called
+     */
+    void detachAll() {
+        while (!_handles.empty()) {
+            // detach removes the handle from the registry
+            (*_handles.begin())->detach();
+        }
+    }
+};
+
+
+/**
+ * @brief A connected non-blocking stream socket driven by an IoReactor
+ *
+ * Reads are completed immediately when data are available, otherwise the
+ * socket is watched until they arrive. The end of the stream is reported as
+ * std::nullopt. Writes are sent immediately as far as the socket accepts
+ * them, the rest is buffered and sent with a single sendmsg per wake up;
+ * writableLength() reports the buffered amount for backpressure. Data
+ * buffered before end() are sent even if the socket is released meanwhile.
+ *
+ * @note Must be used from the thread running the event loop.
+ */
+class Socket : public Readable, public Writable, public IoHandle, public std::enable_shared_from_this<Socket> {
+    struct PendingRead {
+        std::function<void(std::optional<std::string>)> text;
+        std::function<void(std::optional<std::vector<uint8_t>>)> bytes;
+    };
+
+    std::shared_ptr<SocketRegistry> _registry;
+    int _fd;
+    size_t _chunkSize;
+    bool _readEnded = false;
+    bool _ending = false;
+    // owns the socket while the data buffered before end() are sent
+    std::shared_ptr<Socket> _self;
+    bool _readWatched = false;
+    bool _writeWatched = false;
+    std::string _error;
+
+    std::deque<PendingRead> _reads;
+    std::deque<std::string> _out;
+    size_t _outPos = 0;
+    size_t _outLength = 0;
+    std::vector<std::function<void()>> _drainCallbacks;
+
+    enum class Received { Data, End, WouldBlock };
+
+    template<class Buffer>
+    Received receive(Buffer& buffer) {
+        buffer.resize(_chunkSize);
+        ssize_t count;
+        do {
+            count = ::recv(_fd, buffer.data(), buffer.size(), 0);
+        } while (count < 0 && errno == EINTR);
+
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return Received::WouldBlock;
+        }
+        if (count <= 0) {
+            // a reset connection ends the stream as well
+            buffer.clear();
+            _readEnded = true;
+            return Received::End;
+        }
+        buffer.resize(static_cast<size_t>(count));
+        if (buffer.size() < _chunkSize / 2) {
+            // the chunk may be adopted by an ArrayBuffer, do not keep the whole capacity alive
+            buffer.shrink_to_fit();
+        }
+        return Received::Data;
+    }
+
+    template<class Buffer>
+    static bool tryComplete(Socket& socket, std::function<void(std::optional<Buffer>)>& callback) {
+        Buffer data;
+        Received result = socket.receive(data);
+        if (result == Received::WouldBlock) {
+            return false;
+        }
+        if (result == Received::End) {
+            callback(std::nullopt);
+        }
+        else {
+            callback(std::move(data));
+        }
+        return true;
+    }
+
+    bool tryComplete(PendingRead& pending) {
+        if (pending.bytes) {
+            return tryComplete(*this, pending.bytes);
+        }
+        return tryComplete(*this, pending.text);
+    }
+
+    bool startRead(PendingRead pending) {
+        if (_fd < 0 || _readEnded) {
+            return false;
+        }
+        if (_reads.empty() && tryComplete(pending)) {
+            return true;
+        }
+        _reads.push_back(std::move(pending));
+        if (!_readWatched) {
+            _readWatched = true;
+            _registry->reactor().watchReadable(_fd, [this]() { onReadable(); });
+        }
+        return true;
+    }
+
+    void onReadable() {
+        auto self = shared_from_this();
+        while (!_reads.empty() && _fd >= 0) {
+            auto pending = std::move(_reads.front());
+            _reads.pop_front();
+            if (!tryComplete(pending)) {
+                _reads.push_front(std::move(pending));
+                return;
+            }
+            if (_readEnded) {
+                endReads();
+            }
+        }
+        if (_reads.empty()) {
+            stopWatchingReadable();
+        }
+    }
+
+    void endReads() {
+        // the reads queued after the end of the stream see the end as well
+        auto reads = std::move(_reads);
+        _reads.clear();
+        for (auto& pending : reads) {
+            if (pending.bytes) {
+                pending.bytes(std::nullopt);
+            }
+            else {
+                pending.text(std::nullopt);
+            }
+        }
+    }
+
+    void stopWatchingReadable() {
+        if (_readWatched && _fd >= 0) {
+            _registry->reactor().unwatchReadable(_fd);
+        }
+        _readWatched = false;
+    }
+
+    void stopWatchingWritable() {
+        if (_writeWatched && _fd >= 0) {
+            _registry->reactor().unwatchWritable(_fd);
+        }
+        _writeWatched = false;
+    }
+
+    void callDrain() {
+        auto callbacks = std::move(_drainCallbacks);
+        _drainCallbacks.clear();
+        for (auto& callback : callbacks) {
+            callback();
+        }
+    }
+
+    void checkWritable() {
+        if (!_error.empty()) {
+            throw std::runtime_error("Socket error: " + _error);
+        }
+        if (_fd < 0 || _ending) {
+            throw std::runtime_error("Socket is closed for writing");
+        }
+    }
+
+    void fail(int error) {
+        auto self = weak_from_this().lock();
+        _error = std::strerror(error);
+        _out.clear();
+        _outPos = 0;
+        _outLength = 0;
+        _self.reset();
+        stopWatchingWritable();
+        callDrain();
+    }
+
+    size_t sendDirect(std::span<const uint8_t> data) {
+        ssize_t sent;
+        do {
+            sent = ::send(_fd, data.data(), data.size(), MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+
+        if (sent >= 0) {
+            return static_cast<size_t>(sent);
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        fail(errno);
+        checkWritable();
+        return 0;
+    }
+
+    void consumeOut(size_t size) {
+        _outLength -= size;
+        while (size > 0) {
+            size_t left = _out.front().size() - _outPos;
+            if (size < left) {
+                _outPos += size;
+                return;
+            }
+            size -= left;
+            _out.pop_front();
+            _outPos = 0;
+        }
+    }
+
+    void flushOut() {
+        while (!_out.empty()) {
+            iovec iov[64];
+            size_t count = 0;
+            for (auto it = _out.begin(); it != _out.end() && count < 64; ++it, ++count) {
+                size_t offset = count == 0 ? _outPos : 0;
+                iov[count].iov_base = it->data() + offset;
+                iov[count].iov_len = it->size() - offset;
+            }
+
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            ssize_t sent;
+            do {
+                sent = ::sendmsg(_fd, &message, MSG_NOSIGNAL);
+            } while (sent < 0 && errno == EINTR);
+
+            if (sent < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    fail(errno);
+                }
+                return;
+            }
+            consumeOut(static_cast<size_t>(sent));
+        }
+    }
+
+    void queueOut() {
+        if (!_writeWatched) {
+            _writeWatched = true;
+            _registry->reactor().watchWritable(_fd, [this]() { onWritable(); });
+        }
+    }
+
+    void onWritable() {
+        auto self = shared_from_this();
+        flushOut();
+        if (_fd < 0) {
+            return;
+        }
+        if (_out.empty()) {
+            stopWatchingWritable();
+            if (_ending && _error.empty()) {
+                ::shutdown(_fd, SHUT_WR);
+            }
+            _self.reset();
+        }
+        if (!needsDrain()) {
+            callDrain();
+        }
+    }
+
+protected:
+    bool doRead(std::function<void(std::optional<std::string>)> callback) override {
+        return startRead({ std::move(callback), nullptr });
+    }
+
+    bool doReadBytes(std::function<void(std::optional<std::vector<uint8_t>>)> callback) override {
+        return startRead({ nullptr, std::move(callback) });
+    }
+
+public:
+    /**
+     * @param registry the registry of the machine's sockets
+     * @param fd a connected non-blocking socket, owned by the Socket
+     * @param chunkSize maximum size of a read chunk
+     */
+    Socket(std::shared_ptr<SocketRegistry> registry, int fd, size_t chunkSize = 64 * 1024) :
+        _registry(std::move(registry)), _fd(fd), _chunkSize(chunkSize)
+    {
+        _registry->add(this);
+
+        sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        if (getsockname(_fd, reinterpret_cast<sockaddr*>(&address), &length) == 0
+         && (address.ss_family == AF_INET || address.ss_family == AF_INET6)) {
+            // small messages of request-response protocols should not wait for more data
+            int one = 1;
+            setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    }
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    using ConnectCallback = std::function<void(std::shared_ptr<Socket>, std::string)>;
+
+    /**
+     * @brief Connect to the address without blocking
+     *
+     * @param registry the registry of the machine's sockets
+     * @param address the address to connect to
+     * @param callback called with the connected socket, or with nullptr and
+     * the error message if the connection failed
+     */
+    static void connect(std::shared_ptr<SocketRegistry> registry, const SocketAddress& address, ConnectCallback callback) {
+        int fd = ::socket(address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            callback(nullptr, std::strerror(errno));
+            return;
+        }
+        if (::connect(fd, address.get(), address.length) == 0) {
+            callback(std::make_shared<Socket>(std::move(registry), fd), "");
+            return;
+        }
+        if (errno != EINPROGRESS && errno != EINTR) {
+            int error = errno;
+            ::close(fd);
+            callback(nullptr, std::strerror(error));
+            return;
+        }
+
+        // the pending connection is kept alive by its watcher
+        auto socket = std::make_shared<Socket>(std::move(registry), fd);
+        socket->_writeWatched = true;
+        socket->_registry->reactor().watchWritable(fd, [socket, callback_ = std::move(callback)]() {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(socket->_fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0) {
+                error = errno;
+            }
+            socket->stopWatchingWritable();
+            if (error != 0) {
+                socket->detach();
+                callback_(nullptr, std::strerror(error));
+                return;
+            }
+            callback_(socket, "");
+        });
+    }
+
+    void write(std::span<const uint8_t> data) override {
+        checkWritable();
+        if (_out.empty()) {
+            data = data.subspan(sendDirect(data));
+            if (data.empty()) {
+                return;
+            }
+        }
+        _out.emplace_back(reinterpret_cast<const char*>(data.data()), data.size());
+        _outLength += data.size();
+        queueOut();
+    }
+
+    void write(std::string data) override {
+        checkWritable();
+        if (_out.empty()) {
+            size_t sent = sendDirect(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(data.data()), data.size()));
+            if (sent == data.size()) {
+                return;
+            }
+            data.erase(0, sent);
+        }
+        _outLength += data.size();
+        _out.push_back(std::move(data));
+        queueOut();
+    }
+
+    /**
+     * @brief Write several buffers with a single sendmsg. The buffers are only
+     * borrowed for the duration of the call, the part the socket does not
+     * accept immediately is copied.
+     *
+     * @param buffers the buffers
+     */
+    void writeVector(std::span<const std::span<const uint8_t>> buffers) {
+        checkWritable();
+        size_t sent = 0;
+        if (_out.empty()) {
+            iovec iov[64];
+            size_t count = 0;
+            for (; count < buffers.size() && count < 64; count++) {
+                iov[count].iov_base = const_cast<uint8_t*>(buffers[count].data());
+                iov[count].iov_len = buffers[count].size();
+            }
+
+            msghdr message{};
+            message.msg_iov = iov;
+            message.msg_iovlen = count;
+            ssize_t res;
+            do {
+                res = ::sendmsg(_fd, &message, MSG_NOSIGNAL);
+            } while (res < 0 && errno == EINTR);
+
+            if (res < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                fail(errno);
+                checkWritable();
+            }
+            sent = res > 0 ? static_cast<size_t>(res) : 0;
+        }
+
+        for (auto buffer : buffers) {
+            if (sent >= buffer.size()) {
+                sent -= buffer.size();
+                continue;
+            }
+            buffer = buffer.subspan(sent);
+            sent = 0;
+            _out.emplace_back(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            _outLength += buffer.size();
+        }
+        if (!_out.empty()) {
+            queueOut();
+        }
+    }
+
+    size_t writableLength() override {
+        return _outLength;
+    }
+
+    void onDrain(std::function<void()> callback) override {
+        if (!needsDrain() || _fd < 0 || !_error.empty()) {
+            callback();
+            return;
+        }
+        _drainCallbacks.push_back(std::move(callback));
+    }
+
+    /**
+     * @brief Shut down the writing side once the buffered data are sent,
+     * the socket can still be read
+     */
+    void end() {
+        if (_fd < 0 || _ending) {
+            return;
+        }
+        _ending = true;
+        if (_out.empty() && _error.empty()) {
+            ::shutdown(_fd, SHUT_WR);
+        }
+        else if (!_out.empty()) {
+            // the owner may release the socket right away, the rest is still sent
+            _self = shared_from_this();
+        }
+    }
+
+    /**
+     * @brief Close the socket. Pending reads see the end of the stream and
+     * buffered data are discarded.
+     */
+    void close() {
+        auto self = weak_from_this().lock();
+        if (_fd < 0) {
+            return;
+        }
+        auto drainCallbacks = std::move(_drainCallbacks);
+        _drainCallbacks.clear();
+        auto reads = std::move(_reads);
+        _reads.clear();
+        detach();
+
+        _reads = std::move(reads);
+        endReads();
+        _drainCallbacks = std::move(drainCallbacks);
+        callDrain();
+    }
+
+    void detach() override {
+        // a pending connection is owned by its watcher, keep it alive until the end
+        auto self = weak_from_this().lock();
+        if (_fd < 0) {
+            return;
+        }
+        _registry->reactor().unwatch(_fd);
+        ::close(_fd);
+        _fd = -1;
+        _readWatched = false;
+        _writeWatched = false;
+        _registry->remove(this);
+
+        _reads.clear();
+        _drainCallbacks.clear();
+        _out.clear();
+        _outPos = 0;
+        _outLength = 0;
+        _self.reset();
+    }
+
+    bool isOpen() const {
+        return _fd >= 0;
+    }
+
+    int fd() const {
+        return _fd;
+    }
+
+    ~Socket() {
+        detach();
+    }
+};
+
+
+/**
+ * @brief A listening stream socket accepting connections without blocking
+ *
+ * @note The server is kept alive by its watcher until it is closed.
+ */
+class SocketServer : public IoHandle, public std::enable_shared_from_this<SocketServer> {
+    std::shared_ptr<SocketRegistry> _registry;
+    int _fd;
+    std::string _path;
+    std::function<void(std::shared_ptr<Socket>)> _onConnection;
+    std::function<void(const std::system_error&)> _onError;
+    // kept open to accept and drop connections when the process runs out of descriptors
+    int _reserveFd = -1;
+    bool _watching = false;
+    // owns the server while it is not watched, the watcher owns it otherwise
+    std::shared_ptr<SocketServer> _self;
+
+    void watch() {
+        _watching = true;
+        _registry->reactor().watchReadable(_fd, [self = shared_from_this()]() { self->onReadable(); });
+    }
+
+    /**
+     * @brief Accept a connection from the backlog with the reserved
+     * descriptor and close it right away
+     *
+     * @return 0 if a connection was dropped, the error of accept otherwise
+     */
+    int dropConnection() {
+        if (_reserveFd < 0) {
+            return EMFILE;
+        }
+        ::close(_reserveFd);
+        int client = ::accept4(_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        int error = client < 0 ? errno : 0;
+        if (client >= 0) {
+            ::close(client);
+        }
+        _reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return error;
+    }
+
+    void onAcceptError(int error) {
+        if (error == EMFILE || error == ENFILE) {
+            // the listener stays readable while the connection is in the backlog,
+            // drop it or stop watching until a descriptor is released to avoid busy looping
+            int res = 0;
+            for (int i = 0; i < 64 && (res == 0 || res == EINTR || res == ECONNABORTED); i++) {
+                res = dropConnection();
+            }
+            if ((res == EMFILE || res == ENFILE) && _watching) {
+                _watching = false;
+                _self = shared_from_this();
+                _registry->reactor().unwatchReadable(_fd);
+                _registry->waitForDescriptor(this);
+            }
+        }
+        if (_onError) {
+            auto onError = _onError;
+            onError(std::system_error(error, std::generic_category(), "Cannot accept connection"));
+        }
+    }
+
+    void onReadable() {
+        auto self = shared_from_this();
+        // limit the connections accepted at once, so that established connections are not starved
+        for (int i = 0; i < 64 && _fd >= 0; i++) {
+            int client = ::accept4(_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client < 0) {
+                int error = errno;
+                if (error == EINTR || error == ECONNABORTED) {
+                    continue;
+                }
+                if (error != EAGAIN && error != EWOULDBLOCK) {
+                    onAcceptError(error);
+                }
+                return;
+            }
+            auto onConnection = _onConnection;
+            onConnection(std::make_shared<Socket>(_registry, client));
+        }
+    }
+
+    struct Private {};
+public:
+    SocketServer(Private, std::shared_ptr<SocketRegistry> registry, int fd, std::string path,
+                 std::function<void(std::shared_ptr<Socket>)> onConnection) :
+        _registry(std::move(registry)), _fd(fd), _path(std::move(path)), _onConnection(std::move(onConnection))
+    {
+        _registry->add(this);
+        _reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+
+    SocketServer(const SocketServer&) = delete;
+    SocketServer& operator=(const SocketServer&) = delete;
+
+    /**
+     * @brief Listen on the address. The file of a Unix domain socket is
+     * removed when the server is closed.
+     *
+     * @param registry the registry of the machine's sockets
+     * @param address the address to listen on
+     * @param onConnection called with every accepted connection
+     * @param backlog maximum number of connections waiting to be accepted
+     * @return The server
+     */
+    static std::shared_ptr<SocketServer> listen(std::shared_ptr<SocketRegistry> registry, const SocketAddress& address,
+                                                std::function<void(std::shared_ptr<Socket>)> onConnection, int backlog = SOMAXCONN) {
+        int fd = ::socket(address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot create socket");
+        }
+        if (address.family() != AF_UNIX) {
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        }
+        if (::bind(fd, address.get(), address.length) < 0 || ::listen(fd, backlog) < 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "Cannot listen");
+        }
+
+        std::string path;
+        if (address.family() == AF_UNIX) {
+            path = reinterpret_cast<const sockaddr_un*>(&address.storage)->sun_path;
+        }
+        auto server = std::make_shared<SocketServer>(Private{}, std::move(registry), fd, std::move(path), std::move(onConnection));
+        try {
+            server->watch();
+        }
+        catch (...) {
+            server->detach();
+            throw;
+        }
+        return server;
+    }
+
+    /**
+     * @brief Set the callback called when accepting a connection fails.
+     * When the process runs out of descriptors, the waiting connections are
+     * dropped using a reserved descriptor, or the server stops accepting
+     * until one of the registry's sockets is closed.
+     */
+    void onError(std::function<void(const std::system_error&)> callback) {
+        _onError = std::move(callback);
+    }
+
+    void descriptorReleased() override {
+        if (_fd >= 0 && !_watching) {
+            if (_reserveFd < 0) {
+                _reserveFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+            }
+            watch();
+            _self.reset();
+        }
+    }
+
+    /**
+     * @brief Get the port the server listens on, 0 for Unix domain sockets
+     */
+    int port() const {
+        sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        if (_fd < 0 || getsockname(_fd, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+            return 0;
+        }
+        if (address.ss_family == AF_INET) {
+            return ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+        }
+        if (address.ss_family == AF_INET6) {
+            return ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port);
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Stop accepting connections, established connections stay open
+     */
+    void close() {
+        detach();
+    }
+
+    void detach() override {
+        auto self = weak_from_this().lock();
+        if (_fd < 0) {
+            return;
+        }
+        _registry->remove(this);
+        int fd = std::exchange(_fd, -1);
+        _onConnection = nullptr;
+        _onError = nullptr;
+        _watching = false;
+        _self.reset();
+        if (_reserveFd >= 0) {
+            ::close(std::exchange(_reserveFd, -1));
+        }
+        if (!_path.empty()) {
+            ::unlink(_path.c_str());
+        }
+        // releases the watcher which may own the server
+        _registry->reactor().unwatch(fd);
+        ::close(fd);
+    }
+
+    ~SocketServer() {
+        detach();
+    }
+};
+
+
+/**
+ * @brief The readable side of a shared Socket, keeps the socket alive
+ */
+class SocketReadable : public ReadableRef {
+    std::shared_ptr<Socket> _socket;
+public:
+    SocketReadable(std::shared_ptr<Socket> socket) : ReadableRef(socket.get()), _socket(std::move(socket)) {}
+};
+
+
+/**
+ * @brief The writable side of a shared Socket, keeps the socket alive
+ */
+class SocketWritable : public WritableRef {
+    std::shared_ptr<Socket> _socket;
+public:
+    SocketWritable(std::shared_ptr<Socket> socket) : WritableRef(socket.get()), _socket(std::move(socket)) {}
+};
+
+
+} // namespace jac
+
+#endif
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "../types/streams.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief Get the length of the ASCII prefix of the data
+ *
+ * Uses SSE2 when available and falls back to scanning a word at a time.
+ */
+inline size_t asciiPrefix(const char* data, size_t size) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(chunk));
+        if (mask != 0) {
+            return i + static_cast<size_t>(std::countr_zero(mask));
+        }
+    }
+#else
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        if (word & 0x8080808080808080ull) {
+            break;
+        }
+    }
+#endif
+    while (i < size && !(static_cast<unsigned char>(data[i]) & 0x80)) {
+        i++;
+    }
+    return i;
+}
+
+
+/**
+ * @brief Validate UTF-8 data and append it to the output. Invalid sequences
+ * are replaced with U+FFFD.
+ *
+ * @param data the data
+ * @param out the output
+ * @param final whether the data end the stream; if not, an incomplete
+ * sequence at the end is left unconsumed
+ * @return The number of consumed bytes
+ */
+inline size_t decodeUtf8(std::string_view data, std::string& out, bool final) {
+    static constexpr std::string_view replacement = "\xEF\xBF\xBD";
+
+    size_t i = 0;
+    while (i < data.size()) {
+        size_t ascii = asciiPrefix(data.data() + i, data.size() - i);
+        out.append(data.data() + i, ascii);
+        i += ascii;
+        if (i == data.size()) {
+            break;
+        }
+
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        size_t length;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            length = 2;
+        }
+        else if (c == 0xE0) {
+            length = 3;
+            low = 0xA0;
+        }
+        else if ((c >= 0xE1 && c <= 0xEC) || c == 0xEE || c == 0xEF) {
+            length = 3;
+        }
+        else if (c == 0xED) {
+            // surrogates are not valid UTF-8
+            length = 3;
+            high = 0x9F;
+        }
+        else if (c == 0xF0) {
+            length = 4;
+            low = 0x90;
+        }
+        else if (c >= 0xF1 && c <= 0xF3) {
+            length = 4;
+        }
+        else if (c == 0xF4) {
+            length = 4;
+            high = 0x8F;
+        }
+        else {
+            out.append(replacement);
+            i++;
+            continue;
+        }
+
+        size_t valid = 1;
+        for (; valid < length && i + valid < data.size(); valid++) {
+            unsigned char b = static_cast<unsigned char>(data[i + valid]);
+            if (valid == 1 ? (b < low || b > high) : (b < 0x80 || b > 0xBF)) {
+                break;
+            }
+        }
+
+        if (valid == length) {
+            out.append(data.data() + i, length);
+            i += length;
+        }
+        else if (i + valid == data.size() && !final) {
+            break;
+        }
+        else {
+            out.append(replacement);
+            i += valid;
+        }
+    }
+    return i;
+}
+
+
+/**
+ * @brief Base of Readables which transform the data of another Readable
+ *
+ * Chunks are produced by transform() from the buffered input, the buffer is
+ * refilled from the source until a chunk can be produced. When the source
+ * ends, finish() may produce the last chunk from the rest of the buffer and
+ * the end of the stream is reported afterwards.
+ *
+ * An exception thrown by transform() (e.g. a malformed input) ends the stream,
+ * the pending read sees the end and the exception is returned by error().
+ */
+class ReadableTransform : public Readable {
+protected:
+    Readable& _source;
+    std::string _buffer;
+    size_t _bufferPos = 0;
+    bool _ended = false;
+    bool _endReported = false;
+    std::exception_ptr _error;
+
+    std::string_view buffered() const {
+        return std::string_view(_buffer).substr(_bufferPos);
+    }
+
+    void consume(size_t size) {
+        _bufferPos += size;
+        if (_bufferPos == _buffer.size()) {
+            _buffer.clear();
+            _bufferPos = 0;
+        }
+    }
+
+    /**
+     * @brief Produce a chunk from the buffered data
+     *
+     * @param chunk the output chunk
+     * @return true if a chunk was produced
+     */
+    virtual bool transform(std::string& chunk) = 0;
+
+    /**
+     * @brief Produce the last chunk from the rest of the buffered data after
+     * the source ended
+     *
+     * @param chunk the output chunk
+     * @return true if a chunk was produced
+     */
+    virtual bool finish(std::string& chunk) {
+        consume(buffered().size());
+        return false;
+    }
+
+    using Callback = std::function<void(std::optional<std::string>)>;
+
+    void end(Callback& callback) {
+        _ended = true;
+        std::string chunk;
+        bool produced = false;
+        if (!_error) {
+            try {
+                produced = finish(chunk);
+            }
+            catch (...) {
+                _error = std::current_exception();
+            }
+        }
+        if (produced) {
+            callback(std::move(chunk));
+            return;
+        }
+        _endReported = true;
+        callback(std::nullopt);
+    }
+
+    void append(std::optional<std::string> data) {
+        if (!data) {
+            _ended = true;
+            return;
+        }
+        if (_bufferPos > 0) {
+            _buffer.erase(0, _bufferPos);
+            _bufferPos = 0;
+        }
+        _buffer.append(*data);
+    }
+
+    /**
+     * @brief Refill the buffer until a chunk is produced or the stream ends
+     *
+     * Sources which call back synchronously are read in a loop, so a long
+     * run of chunks without a complete output does not deepen the stack.
+     */
+    void pump(std::shared_ptr<Callback> callback) {
+        struct Refill {
+            bool pending = true;
+            bool async = false;
+        };
+
+        while (true) {
+            std::string chunk;
+            bool produced;
+            try {
+                produced = !_error && transform(chunk);
+            }
+            catch (...) {
+                _error = std::current_exception();
+                produced = false;
+            }
+            if (produced) {
+                (*callback)(std::move(chunk));
+                return;
+            }
+            if (_ended || _error) {
+                end(*callback);
+                return;
+            }
+
+            auto refill = std::make_shared<Refill>();
+            bool res = _source.readSome(std::string::npos, [this, callback, refill](std::optional<std::string> data) {
+                append(std::move(data));
+                refill->pending = false;
+                if (refill->async) {
+                    pump(callback);
+                }
+            });
+            if (!res) {
+                end(*callback);
+                return;
+            }
+            if (refill->pending) {
+                refill->async = true;
+                return;
+            }
+        }
+    }
+
+    bool doRead(Callback callback) override {
+        if (_endReported) {
+            return false;
+        }
+        pump(std::make_shared<Callback>(std::move(callback)));
+        return true;
+    }
+
+public:
+    ReadableTransform(Readable& source) : _source(source) {}
+
+    std::exception_ptr error() override {
+        return _error ? _error : _source.error();
+    }
+};
+
+
+/**
+ * @brief Splits the data of a Readable into lines, each chunk is one line
+ * without the line terminator. A line exceeding the maximum length ends the
+ * stream with an error.
+ */
+class LineSplitter : public ReadableTransform {
+    size_t _maxLineLength;
+
+    void checkLength(size_t length) const {
+        if (length > _maxLineLength) {
+            throw std::runtime_error("Line length exceeds the limit of " + std::to_string(_maxLineLength));
+        }
+    }
+protected:
+    bool transform(std::string& chunk) override {
+        std::string_view data = buffered();
+        auto end = static_cast<const char*>(std::memchr(data.data(), '\n', data.size()));
+        if (!end) {
+            // a terminating "\r" may still be followed by the "\n"
+            checkLength(data.ends_with('\r') ? data.size() - 1 : data.size());
+            return false;
+        }
+        size_t length = static_cast<size_t>(end - data.data());
+        checkLength(length > 0 && data[length - 1] == '\r' ? length - 1 : length);
+        chunk.assign(data.data(), length > 0 && data[length - 1] == '\r' ? length - 1 : length);
+        consume(length + 1);
+        return true;
+    }
+
+    bool finish(std::string& chunk) override {
+        if (buffered().empty()) {
+            return false;
+        }
+        chunk.assign(buffered());
+        consume(chunk.size());
+        return true;
+    }
+public:
+    /**
+     * @param source the source stream
+     * @param maxLineLength maximum accepted length of a line in bytes
+     */
+    LineSplitter(Readable& source, size_t maxLineLength = 1024 * 1024) :
+        ReadableTransform(source), _maxLineLength(maxLineLength)
+    {}
+};
+
+
+/**
+ * @brief Decodes frames prefixed with their length in big-endian byte order,
+ * each chunk is the payload of one frame. An incomplete frame at the end of
+ * the source is dropped, a frame exceeding the maximum size ends the stream
+ * with an error.
+ */
+class FrameDecoder : public ReadableTransform {
+    size_t _headerSize;
+    size_t _maxFrameSize;
+protected:
+    bool transform(std::string& chunk) override {
+        std::string_view data = buffered();
+        if (data.size() < _headerSize) {
+            return false;
+        }
+        size_t length = 0;
+        for (size_t i = 0; i < _headerSize; i++) {
+            length = (length << 8) | static_cast<unsigned char>(data[i]);
+        }
+        if (length > _maxFrameSize) {
+            throw std::runtime_error("Frame size " + std::to_string(length) + " exceeds the limit");
+        }
+        if (data.size() < _headerSize + length) {
+            return false;
+        }
+        chunk.assign(data.substr(_headerSize, length));
+        consume(_headerSize + length);
+        return true;
+    }
+public:
+    /**
+     * @param source the source stream
+     * @param headerSize size of the length prefix in bytes (1, 2 or 4)
+     * @param maxFrameSize maximum accepted payload size
+     */
+    FrameDecoder(Readable& source, size_t headerSize = 4, size_t maxFrameSize = 16 * 1024 * 1024) :
+        ReadableTransform(source), _headerSize(headerSize), _maxFrameSize(maxFrameSize)
+    {
+        if (headerSize != 1 && headerSize != 2 && headerSize != 4) {
+            throw std::invalid_argument("Header size must be 1, 2 or 4");
+        }
+    }
+};
+
+
+/**
+ * @brief Validates and decodes UTF-8 data, sequences split between chunks
+ * are joined and invalid sequences are replaced with U+FFFD
+ */
+class Utf8Decoder : public ReadableTransform {
+protected:
+    bool transform(std::string& chunk) override {
+        chunk.clear();
+        consume(decodeUtf8(buffered(), chunk, false));
+        return !chunk.empty();
+    }
+
+    bool finish(std::string& chunk) override {
+        chunk.clear();
+        consume(decodeUtf8(buffered(), chunk, true));
+        return !chunk.empty();
+    }
+public:
+    using ReadableTransform::ReadableTransform;
+};
+
+
+/**
+ * @brief Prefixes every written chunk with its length in big-endian byte
+ * order and writes it to another Writable with a single write
+ */
+class FrameEncoder : public Writable {
+    Writable& _sink;
+    size_t _headerSize;
+public:
+    /**
+     * @param sink the destination stream
+     * @param headerSize size of the length prefix in bytes (1, 2 or 4)
+     */
+    FrameEncoder(Writable& sink, size_t headerSize = 4) : _sink(sink), _headerSize(headerSize) {
+        if (headerSize != 1 && headerSize != 2 && headerSize != 4) {
+            throw std::invalid_argument("Header size must be 1, 2 or 4");
+        }
+    }
+
+    void write(std::span<const uint8_t> data) override {
+        if (_headerSize < sizeof(size_t) && data.size() >> (_headerSize * 8) != 0) {
+            throw std::length_error("Frame is too large for the header size");
+        }
+        std::string frame;
+        frame.reserve(_headerSize + data.size());
+        for (size_t i = _headerSize; i > 0; i--) {
+            frame.push_back(static_cast<char>((data.size() >> ((i - 1) * 8)) & 0xFF));
+        }
+        frame.append(reinterpret_cast<const char*>(data.data()), data.size());
+        _sink.write(std::move(frame));
+    }
+
+    void write(std::string data) override {
+        write(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(data.data()), data.size()));
+    }
+
+    void flush() override {
+        _sink.flush();
+    }
+
+    size_t writableLength() override {
+        return _sink.writableLength();
+    }
+
+    size_t highWaterMark() override {
+        return _sink.highWaterMark();
+    }
+
+    void setHighWaterMark(size_t bytes) override {
+        _sink.setHighWaterMark(bytes);
+    }
+
+    void onDrain(std::function<void()> callback) override {
+        _sink.onDrain(std::move(callback));
+    }
+};
+
+
+} // namespace jac
@@ -139,6 +139,16 @@ public:
         return create(ctx, value.c_str());
     }
 
+    /**
+     * @brief Create an atom from an existing atom
+     *
+     * @param value the atom
+     * @return A copy of the atom
+     */
+    static Atom create(ContextRef, Atom value) {
+        return value;
+    }
+
     friend std::ostream& operator<<(std::ostream& os, Atom& val) {
         os << val.toString().c_str();
         return os;
@@ -196,6 +196,8 @@ namespace ProtoBuilder {
             const SgnUnwrap Unwrap_(member);
 
             [&]<typename Res, typename... Args>(SgnUnwrap<Res(Args...)>) {
+                static FfiStatsRef stats = FfiStatsRef::create(name);
+
                 MethodRaw func = [](JSContext* ctx_, JSValueConst thisVal, int argc, JSValueConst* argv) -> JSValue {
                     T* ptr = static_cast<T*>(JS_GetOpaque(thisVal, classId));
 
@@ -204,7 +206,7 @@ namespace ProtoBuilder {
                     };
 
                     return propagateExceptions(ctx_, [&]() -> JSValue {
-                        return processCallRaw<decltype(f), Res, Args...>(ctx_, thisVal, argc, argv, f);
+                        return processCallRaw<decltype(f), Res, Args...>(ctx_, thisVal, argc, argv, f, stats);
                     });
                 };
 
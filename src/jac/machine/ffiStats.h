@@ -0,0 +1,272 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "histogram.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief Statistics of calls of a single native function. Durations are
+ * recorded in nanoseconds.
+ */
+struct FfiFunctionStats {
+    std::atomic<uint64_t> calls = 0;
+    /** @brief Time spent converting the arguments from JavaScript values */
+    std::atomic<uint64_t> argumentTime = 0;
+    /** @brief Time spent executing the native function */
+    std::atomic<uint64_t> executionTime = 0;
+    /** @brief Time spent converting the result to a JavaScript value */
+    std::atomic<uint64_t> resultTime = 0;
+    /** @brief Total time of the calls (conversions and execution) */
+    Histogram latency;
+};
+
+
+/**
+ * @brief Process-wide registry of native function call statistics.
+ *
+ * The statistics are only collected when the library is compiled with
+ * JAC_FFI_STATS defined (CMake option JAC_ENABLE_FFI_STATS). Otherwise,
+ * the instrumentation is compiled out and the registry stays empty.
+ *
+ * Functions created by FunctionFactory are identified by the source location
+ * of their creation, member functions added by ProtoBuilder::Opaque::addMethodMember
+ * by their property name. Functions with the same name share the statistics.
+ */
+class FfiStats {
+public:
+    struct Entry {
+        std::string name;
+        uint64_t calls;
+        uint64_t argumentTime;
+        uint64_t executionTime;
+        uint64_t resultTime;
+        Histogram::Snapshot latency;
+
+        uint64_t totalTime() const {
+            return argumentTime + executionTime + resultTime;
+        }
+    };
+
+    enum class SortBy {
+        Calls,
+        TotalTime,
+        ExecutionTime,
+        ConversionTime
+    };
+
+private:
+    struct Registry {
+        std::mutex mutex;
+        std::map<std::string, std::unique_ptr<FfiFunctionStats>, std::less<>> functions;
+    };
+
+    static Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+
+public:
+    /**
+     * @brief Get the statistics of the function with the given name, creating
+     * them if necessary. The returned reference is valid until the end of the program.
+     *
+     * @param name name of the function
+     * @return The statistics
+     */
+    static FfiFunctionStats& function(std::string_view name) {
+        auto& reg = registry();
+        std::scoped_lock lock(reg.mutex);
+        auto it = reg.functions.find(name);
+        if (it == reg.functions.end()) {
+            it = reg.functions.emplace(std::string(name), std::make_unique<FfiFunctionStats>()).first;
+        }
+        return *it->second;
+    }
+
+    /**
+     * @brief Get the statistics of all functions which were called at least once
+     *
+     * @param sortBy the sorting criterion, in descending order
+     * @return The statistics
+     */
+    static std::vector<Entry> snapshot(SortBy sortBy = SortBy::TotalTime) {
+        std::vector<Entry> result;
+        {
+            auto& reg = registry();
+            std::scoped_lock lock(reg.mutex);
+            for (auto& [name, stats] : reg.functions) {
+                uint64_t calls = stats->calls.load(std::memory_order_relaxed);
+                if (calls == 0) {
+                    continue;
+                }
+                result.push_back({
+                    name,
+                    calls,
+                    stats->argumentTime.load(std::memory_order_relaxed),
+                    stats->executionTime.load(std::memory_order_relaxed),
+                    stats->resultTime.load(std::memory_order_relaxed),
+                    stats->latency.snapshot()
+                });
+            }
+        }
+
+        auto key = [sortBy](const Entry& entry) -> uint64_t {
+            switch (sortBy) {
+                case SortBy::Calls:
+                    return entry.calls;
+                case SortBy::ExecutionTime:
+                    return entry.executionTime;
+                case SortBy::ConversionTime:
+                    return entry.argumentTime + entry.resultTime;
+                case SortBy::TotalTime:
+                    break;
+            }
+            return entry.totalTime();
+        };
+        std::stable_sort(result.begin(), result.end(), [&key](const Entry& a, const Entry& b) {
+            return key(a) > key(b);
+        });
+        return result;
+    }
+
+    /**
+     * @brief Format the statistics as a human-readable table
+     *
+     * @param sortBy the sorting criterion, in descending order
+     * @return The report
+     */
+    static std::string report(SortBy sortBy = SortBy::TotalTime) {
+        std::ostringstream os;
+        os << std::left << std::setw(40) << "function" << std::right
+           << std::setw(12) << "calls" << std::setw(14) << "total [us]" << std::setw(12) << "args [us]"
+           << std::setw(12) << "exec [us]" << std::setw(12) << "result [us]" << std::setw(12) << "p99 [ns]" << "\n";
+
+        for (auto& entry : snapshot(sortBy)) {
+            os << std::left << std::setw(40) << entry.name << std::right
+               << std::setw(12) << entry.calls
+               << std::setw(14) << entry.totalTime() / 1000
+               << std::setw(12) << entry.argumentTime / 1000
+               << std::setw(12) << entry.executionTime / 1000
+               << std::setw(12) << entry.resultTime / 1000
+               << std::setw(12) << entry.latency.percentile(0.99) << "\n";
+        }
+        return os.str();
+    }
+
+    /**
+     * @brief Reset the statistics of all functions
+     */
+    static void reset() {
+        auto& reg = registry();
+        std::scoped_lock lock(reg.mutex);
+        for (auto& [_, stats] : reg.functions) {
+            stats->calls.store(0, std::memory_order_relaxed);
+            stats->argumentTime.store(0, std::memory_order_relaxed);
+            stats->executionTime.store(0, std::memory_order_relaxed);
+            stats->resultTime.store(0, std::memory_order_relaxed);
+            stats->latency.reset();
+        }
+    }
+};
+
+
+#ifdef JAC_FFI_STATS
+
+/**
+ * @brief Measures the phases of a single native function call
+ */
+class FfiCall {
+    using Clock = std::chrono::steady_clock;
+
+    FfiFunctionStats* _stats;
+    Clock::time_point _start;
+    Clock::time_point _last;
+
+    void lap(std::atomic<uint64_t>& total) {
+        auto now = Clock::now();
+        total.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count(), std::memory_order_relaxed);
+        _last = now;
+    }
+public:
+    FfiCall(FfiFunctionStats* stats) : _stats(stats) {
+        if (_stats) {
+            _start = _last = Clock::now();
+        }
+    }
+
+    void argumentsConverted() {
+        if (_stats) {
+            lap(_stats->argumentTime);
+        }
+    }
+
+    void executed() {
+        if (_stats) {
+            lap(_stats->executionTime);
+        }
+    }
+
+    void resultConverted() {
+        if (!_stats) {
+            return;
+        }
+        lap(_stats->resultTime);
+        _stats->calls.fetch_add(1, std::memory_order_relaxed);
+        _stats->latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(_last - _start).count());
+    }
+};
+
+/**
+ * @brief Reference to the statistics of a native function. Empty when
+ * the statistics are disabled.
+ */
+struct FfiStatsRef {
+    FfiFunctionStats* stats = nullptr;
+
+    static FfiStatsRef create(std::string_view name) {
+        return { &FfiStats::function(name) };
+    }
+
+    FfiCall start() const {
+        return FfiCall(stats);
+    }
+};
+
+#else
+
+class FfiCall {
+public:
+    void argumentsConverted() {}
+    void executed() {}
+    void resultConverted() {}
+};
+
+struct FfiStatsRef {
+    static FfiStatsRef create(std::string_view) {
+        return {};
+    }
+
+    FfiCall start() const {
+        return {};
+    }
+};
+
+#endif
+
+
+} // namespace jac
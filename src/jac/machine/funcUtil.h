@@ -3,6 +3,7 @@
 #include <exception>
 #include <quickjs.h>
 
+#include "ffiStats.h"
 #include "values.h"
 
 namespace jac {
@@ -13,6 +14,9 @@ namespace jac {
  * Arguments and return value of the functions are automatically converted to
  * and from javascript values. Exceptions thrown within the functions are
  * caught and propagated to the javascript side.
+ *
+ * The phases of the call are recorded into the given FfiStatsRef, which
+ * is a no-op unless JAC_FFI_STATS is defined.
  */
 
 template<typename Func>
@@ -37,80 +41,129 @@ inline JSValue propagateExceptions(ContextRef ctx, Func&& f) noexcept {
 }
 
 template<typename Func, typename Res, typename... Args>
-inline JSValue processCallRaw(ContextRef ctx, JSValueConst, int argc, JSValueConst* argv, Func& f) {
+inline JSValue processCallRaw(ContextRef ctx, JSValueConst, int argc, JSValueConst* argv, Func& f, FfiStatsRef stats = {}) {
+    auto call = stats.start();
     std::tuple<Args...> args = convertArgs<Args...>(ctx, argv, argc, std::make_index_sequence<sizeof...(Args)>());
+    call.argumentsConverted();
 
     if constexpr (std::is_same_v<Res, void>) {
         std::apply(f, args);
+        call.executed();
+        call.resultConverted();
         return JS_UNDEFINED;
     }
     else {
-        return Value::from(ctx, std::apply(f, args)).loot().second;
+        Res result = std::apply(f, args);
+        call.executed();
+        JSValue val = Value::from(ctx, std::move(result)).loot().second;
+        call.resultConverted();
+        return val;
     }
 }
 
 template<typename Func, typename Res, typename... Args>
-inline Value processCall(ContextRef ctx, ValueWeak, std::vector<ValueWeak> argv, Func& f) {
+inline Value processCall(ContextRef ctx, ValueWeak, std::vector<ValueWeak> argv, Func& f, FfiStatsRef stats = {}) {
+    auto call = stats.start();
     std::tuple<Args...> args = convertArgs<Args...>(ctx, argv, std::make_index_sequence<sizeof...(Args)>());
+    call.argumentsConverted();
 
     if constexpr (std::is_same_v<Res, void>) {
         std::apply(f, args);
+        call.executed();
+        call.resultConverted();
         return Value::undefined(ctx);
     }
     else {
-        return Value::from(ctx, std::apply(f, args));
+        Res result = std::apply(f, args);
+        call.executed();
+        Value val = Value::from(ctx, std::move(result));
+        call.resultConverted();
+        return val;
     }
 }
 
 template<typename Func, typename Res>
-inline JSValue processCallVariadicRaw(ContextRef ctx, JSValueConst, int argc, JSValueConst* argv, Func& f) {
+inline JSValue processCallVariadicRaw(ContextRef ctx, JSValueConst, int argc, JSValueConst* argv, Func& f, FfiStatsRef stats = {}) {
+    auto call = stats.start();
     std::vector<ValueWeak> args;
     for (int i = 0; i < argc; i++) {
         args.emplace_back(ctx, argv[i]);
     }
+    call.argumentsConverted();
 
     if constexpr (std::is_same_v<Res, void>) {
         f(args);
+        call.executed();
+        call.resultConverted();
         return JS_UNDEFINED;
     }
     else {
-        return Value::from(ctx, f(args)).loot().second;
+        Res result = f(args);
+        call.executed();
+        JSValue val = Value::from(ctx, std::move(result)).loot().second;
+        call.resultConverted();
+        return val;
     }
 }
 
 template<typename Func, typename Res>
-inline Value processCallVariadic(ContextRef ctx, ValueWeak, std::vector<ValueWeak> argv, Func& f) {
+inline Value processCallVariadic(ContextRef ctx, ValueWeak, std::vector<ValueWeak> argv, Func& f, FfiStatsRef stats = {}) {
+    auto call = stats.start();
+    call.argumentsConverted();
+
     if constexpr (std::is_same_v<Res, void>) {
         f(argv);
+        call.executed();
+        call.resultConverted();
         return Value::undefined(ctx);
     }
     else {
-        return Value::from(ctx, f(argv));
+        Res result = f(argv);
+        call.executed();
+        Value val = Value::from(ctx, std::move(result));
+        call.resultConverted();
+        return val;
     }
 }
 
 template<typename Func, typename Res, typename... Args>
-inline Value processCallThis(ContextRef ctx, ValueWeak thisVal, std::vector<ValueWeak> argv, Func& f) {
+inline Value processCallThis(ContextRef ctx, ValueWeak thisVal, std::vector<ValueWeak> argv, Func& f, FfiStatsRef stats = {}) {
+    auto call = stats.start();
     std::tuple<Args...> args = convertArgs<Args...>(ctx, argv, std::make_index_sequence<sizeof...(Args)>());
+    call.argumentsConverted();
 
     if constexpr (std::is_same_v<Res, void>) {
         std::apply(f, std::tuple_cat(std::make_tuple(ctx, thisVal), args));
+        call.executed();
+        call.resultConverted();
         return Value::undefined(ctx);
     }
     else {
-        return Value::from(ctx, std::apply(f, std::tuple_cat(std::make_tuple(ctx, thisVal), args)));
+        Res result = std::apply(f, std::tuple_cat(std::make_tuple(ctx, thisVal), args));
+        call.executed();
+        Value val = Value::from(ctx, std::move(result));
+        call.resultConverted();
+        return val;
     }
 }
 
 template<typename Func, typename Res>
-inline Value processCallThisVariadic(ContextRef ctx, ValueWeak thisVal, std::vector<ValueWeak> argv, Func& f) {
+inline Value processCallThisVariadic(ContextRef ctx, ValueWeak thisVal, std::vector<ValueWeak> argv, Func& f, FfiStatsRef stats = {}) {
+    auto call = stats.start();
+    call.argumentsConverted();
 
     if constexpr (std::is_same_v<Res, void>) {
         f(ctx, thisVal, argv);
+        call.executed();
+        call.resultConverted();
         return Value::undefined(ctx);
     }
     else {
-        return Value::from(ctx, f(ctx, thisVal, argv));
+        Res result = f(ctx, thisVal, argv);
+        call.executed();
+        Value val = Value::from(ctx, std::move(result));
+        call.resultConverted();
+        return val;
     }
 }
 
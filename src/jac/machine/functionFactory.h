@@ -1,9 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <functional>
+#include <source_location>
+#include <string>
+#include <string_view>
 
 #include "class.h"
+#include "ffiStats.h"
 #include "funcUtil.h"
+#include "machine.h"
 #include "values.h"
 
 
@@ -23,17 +31,74 @@ class FunctionFactory {
 
     ContextRef _context;
 
+    /**
+     * @brief The wrapped function together with the location where it was created
+     */
+    template<typename Func>
+    struct NativeFunction {
+        Func func;
+        std::source_location location;
+        FfiStatsRef stats;
+
+        NativeFunction(Func func_, std::source_location location_) : func(std::move(func_)), location(location_), stats(statsFor(location_)) {}
+    };
+
+    static std::string_view locationName(const std::source_location& location) {
+        std::string_view file = location.file_name();
+        auto slash = file.find_last_of("/\\");
+        return slash == std::string_view::npos ? file : file.substr(slash + 1);
+    }
+
+    static FfiStatsRef statsFor([[maybe_unused]] const std::source_location& location) {
+#ifdef JAC_FFI_STATS
+        return FfiStatsRef::create(std::string(locationName(location)) + ":" + std::to_string(location.line()));
+#else
+        return {};
+#endif
+    }
+
     template<typename Func, typename Res, typename... Args>
-    inline Function newFunctionHelper(Func& func, std::function<Res(Args...)>);
+    inline Function newFunctionHelper(Func& func, std::source_location location, std::function<Res(Args...)>);
 
     template<typename Func, typename Res>
-    inline Function newFunctionVariadicHelper(Func& func, std::function<Res(std::vector<ValueWeak>)>);
+    inline Function newFunctionVariadicHelper(Func& func, std::source_location location, std::function<Res(std::vector<ValueWeak>)>);
 
     template<typename Func, typename Res, typename... Args>
-    inline Function newFunctionThisHelper(Func& func, std::function<Res(ContextRef, ValueWeak, Args...)>);
+    inline Function newFunctionThisHelper(Func& func, std::source_location location, std::function<Res(ContextRef, ValueWeak, Args...)>);
 
     template<typename Func, typename Res>
-    inline Function newFunctionThisVariadicHelper(Func& func, std::function<Res(ContextRef, ValueWeak, std::vector<ValueWeak>)>);
+    inline Function newFunctionThisVariadicHelper(Func& func, std::source_location location, std::function<Res(ContextRef, ValueWeak, std::vector<ValueWeak>)>);
+
+    template<typename Func>
+    static void traceCall(ContextRef ctx, NativeFunction<Func>& native, std::chrono::steady_clock::time_point start) {
+        if (Tracer* tracer = MachineBase::tracer(ctx)) {
+            char name[Tracer::maxNameLength + 1];
+            auto file = locationName(native.location);
+            int length = std::snprintf(name, sizeof(name), "%.*s:%u", static_cast<int>(file.size()), file.data(), native.location.line());
+            tracer->record("native", std::string_view(name, std::clamp(length, 0, static_cast<int>(Tracer::maxNameLength))), start, std::chrono::steady_clock::now());
+        }
+    }
+
+    /**
+     * @brief Invoke the call of a native function, recording a span if any tracer is attached
+     */
+    template<typename Func, typename Call>
+    static Value tracedCall(ContextRef ctx, NativeFunction<Func>& native, Call call) {
+        if (!Tracer::anyAttached()) {
+            return call();
+        }
+
+        // the span is recorded even if the call throws
+        struct Trace {
+            ContextRef ctx;
+            NativeFunction<Func>& native;
+            std::chrono::steady_clock::time_point start;
+            ~Trace() {
+                traceCall(ctx, native, start);
+            }
+        } trace{ ctx, native, std::chrono::steady_clock::now() };
+        return call();
+    }
 public:
     FunctionFactory(ContextRef context) : _context(context) {}
 
@@ -47,11 +112,12 @@ public:
      *
      * @tparam Func type of the function to be wrapped
      * @param func the function object to be wrapped
+     * @param location where the function is created, used to identify the function in traces and call statistics
      * @return The created function object
      */
     template<class Func>
-    Function newFunction(Func func) {
-        return newFunctionHelper(func, std::function(func));
+    Function newFunction(Func func, std::source_location location = std::source_location::current()) {
+        return newFunctionHelper(func, location, std::function(func));
     }
 
     /**
@@ -65,11 +131,12 @@ public:
      *
      * @tparam Func type of the function to be wrapped
      * @param func the function object to be wrapped
+     * @param location where the function is created, used to identify the function in traces and call statistics
      * @return The created function object
      */
     template<class Func>
-    Function newFunctionVariadic(Func func) {
-        return newFunctionVariadicHelper(func, std::function(func));
+    Function newFunctionVariadic(Func func, std::source_location location = std::source_location::current()) {
+        return newFunctionVariadicHelper(func, location, std::function(func));
     }
 
     /**
@@ -83,11 +150,12 @@ public:
      *
      * @tparam Func type of the function to be wrapped
      * @param func the function object to be wrapped
+     * @param location where the function is created, used to identify the function in traces and call statistics
      * @return The created function object
      */
     template<class Func>
-    Function newFunctionThis(Func func) {
-        return newFunctionThisHelper(func, std::function(func));
+    Function newFunctionThis(Func func, std::source_location location = std::source_location::current()) {
+        return newFunctionThisHelper(func, location, std::function(func));
     }
 
     /**
@@ -101,23 +169,26 @@ public:
      *
      * @tparam Func type of the function to be wrapped
      * @param func the function object to be wrapped
+     * @param location where the function is created, used to identify the function in traces and call statistics
      * @return The created function object
      */
     template<class Func>
-    Function newFunctionThisVariadic(Func func) {
-        return newFunctionThisVariadicHelper(func, std::function(func));
+    Function newFunctionThisVariadic(Func func, std::source_location location = std::source_location::current()) {
+        return newFunctionThisVariadicHelper(func, location, std::function(func));
     }
 };
 
 
 template<typename Func, typename Res, typename... Args>
-inline Function FunctionFactory::newFunctionHelper(Func& func, std::function<Res(Args...)>) {
-    Func* funcPtr = new Func(std::move(func));
+inline Function FunctionFactory::newFunctionHelper(Func& func, std::source_location location, std::function<Res(Args...)>) {
+    auto funcPtr = new NativeFunction<Func>(std::move(func), location);
 
-    struct FuncProtoBuilder : public ProtoBuilder::Opaque<Func>, public ProtoBuilder::Callable {
+    struct FuncProtoBuilder : public ProtoBuilder::Opaque<NativeFunction<Func>>, public ProtoBuilder::Callable {
         static Value callFunction(ContextRef ctx, ValueWeak funcObj, ValueWeak thisVal, std::vector<ValueWeak> args) {
-            Func* ptr = ProtoBuilder::Opaque<Func>::getOpaque(ctx, funcObj);
-            return processCall<Func, Res, Args...>(ctx, thisVal, args, *ptr);
+            NativeFunction<Func>* ptr = ProtoBuilder::Opaque<NativeFunction<Func>>::getOpaque(ctx, funcObj);
+            return tracedCall(ctx, *ptr, [&]() {
+                return processCall<Func, Res, Args...>(ctx, thisVal, args, ptr->func, ptr->stats);
+            });
         }
     };
 
@@ -128,13 +199,15 @@ inline Function FunctionFactory::newFunctionHelper(Func& func, std::function<Res
 }
 
 template<class Func, typename Res>
-Function FunctionFactory::newFunctionVariadicHelper(Func& func, std::function<Res(std::vector<ValueWeak>)>) {
-    Func* funcPtr = new Func(std::move(func));
+Function FunctionFactory::newFunctionVariadicHelper(Func& func, std::source_location location, std::function<Res(std::vector<ValueWeak>)>) {
+    auto funcPtr = new NativeFunction<Func>(std::move(func), location);
 
-    struct FuncProtoBuilder : public ProtoBuilder::Opaque<Func>, public ProtoBuilder::Callable {
+    struct FuncProtoBuilder : public ProtoBuilder::Opaque<NativeFunction<Func>>, public ProtoBuilder::Callable {
         static Value callFunction(ContextRef ctx, ValueWeak funcObj, ValueWeak thisVal, std::vector<ValueWeak> args) {
-            Func* ptr = ProtoBuilder::Opaque<Func>::getOpaque(ctx, funcObj);
-            return processCallVariadic<Func, Res>(ctx, thisVal, args, *ptr);
+            NativeFunction<Func>* ptr = ProtoBuilder::Opaque<NativeFunction<Func>>::getOpaque(ctx, funcObj);
+            return tracedCall(ctx, *ptr, [&]() {
+                return processCallVariadic<Func, Res>(ctx, thisVal, args, ptr->func, ptr->stats);
+            });
         }
     };
 
@@ -145,13 +218,15 @@ Function FunctionFactory::newFunctionVariadicHelper(Func& func, std::function<Re
 }
 
 template<typename Func, typename Res, typename... Args>
-Function FunctionFactory::newFunctionThisHelper(Func& func, std::function<Res(ContextRef, ValueWeak, Args...)>) {
-    Func* funcPtr = new Func(std::move(func));
+Function FunctionFactory::newFunctionThisHelper(Func& func, std::source_location location, std::function<Res(ContextRef, ValueWeak, Args...)>) {
+    auto funcPtr = new NativeFunction<Func>(std::move(func), location);
 
-    struct FuncProtoBuilder : public ProtoBuilder::Opaque<Func>, public ProtoBuilder::Callable {
+    struct FuncProtoBuilder : public ProtoBuilder::Opaque<NativeFunction<Func>>, public ProtoBuilder::Callable {
         static Value callFunction(ContextRef ctx, ValueWeak funcObj, ValueWeak thisVal, std::vector<ValueWeak> args) {
-            Func* ptr = ProtoBuilder::Opaque<Func>::getOpaque(ctx, funcObj);
-            return processCallThis<Func, Res, Args...>(ctx, thisVal, args, *ptr);
+            NativeFunction<Func>* ptr = ProtoBuilder::Opaque<NativeFunction<Func>>::getOpaque(ctx, funcObj);
+            return tracedCall(ctx, *ptr, [&]() {
+                return processCallThis<Func, Res, Args...>(ctx, thisVal, args, ptr->func, ptr->stats);
+            });
         }
     };
 
@@ -162,13 +237,15 @@ Function FunctionFactory::newFunctionThisHelper(Func& func, std::function<Res(Co
 }
 
 template<typename Func, typename Res>
-Function FunctionFactory::newFunctionThisVariadicHelper(Func& func, std::function<Res(ContextRef, ValueWeak, std::vector<ValueWeak>)>) {
-    Func* funcPtr = new Func(std::move(func));
+Function FunctionFactory::newFunctionThisVariadicHelper(Func& func, std::source_location location, std::function<Res(ContextRef, ValueWeak, std::vector<ValueWeak>)>) {
+    auto funcPtr = new NativeFunction<Func>(std::move(func), location);
 
-    struct FuncProtoBuilder : public ProtoBuilder::Opaque<Func>, public ProtoBuilder::Callable {
+    struct FuncProtoBuilder : public ProtoBuilder::Opaque<NativeFunction<Func>>, public ProtoBuilder::Callable {
         static Value callFunction(ContextRef ctx, ValueWeak funcObj, ValueWeak thisVal, std::vector<ValueWeak> args) {
-            Func* ptr = ProtoBuilder::Opaque<Func>::getOpaque(ctx, funcObj);
-            return processCallThisVariadic<Func, Res>(ctx, thisVal, args, *ptr);
+            NativeFunction<Func>* ptr = ProtoBuilder::Opaque<NativeFunction<Func>>::getOpaque(ctx, funcObj);
+            return tracedCall(ctx, *ptr, [&]() {
+                return processCallThisVariadic<Func, Res>(ctx, thisVal, args, ptr->func, ptr->stats);
+            });
         }
     };
 
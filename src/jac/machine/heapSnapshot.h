@@ -0,0 +1,522 @@
+#pragma once
+
+#include <quickjs.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "context.h"
+#include "internal/proxy.h"
+#include "values.h"
+
+
+namespace jac {
+
+
+/**
+ * @brief A snapshot of the object graph of a machine, which can be exported
+ * in the Chrome DevTools `.heapsnapshot` format.
+ *
+ * QuickJS does not expose its list of allocated objects, so the graph is
+ * built by walking own properties (including non-enumerable properties,
+ * symbols and accessor functions) and prototypes, starting from the global
+ * object and the given roots. Values held only by closures or module scopes
+ * are not reachable this way and have to be passed as roots. The memory not
+ * attributed to any reachable node is reported by a synthetic node.
+ *
+ * Object sizes are estimates based on the number of properties, sizes of
+ * strings and ArrayBuffers are exact up to the header size.
+ *
+ * @note No JavaScript code runs while walking the graph - getters are not
+ * invoked and Proxy objects are reported as opaque nodes without edges.
+ */
+class HeapSnapshot {
+public:
+    enum class NodeType {
+        Hidden,
+        ArrayNode,
+        String,
+        ObjectNode,
+        Code,
+        Closure,
+        RegExp,
+        Number,
+        Native,
+        Synthetic,
+        ConcatenatedString,
+        SlicedString,
+        Symbol,
+        BigInt
+    };
+
+    enum class EdgeType {
+        Context,
+        Element,
+        Property,
+        Internal,
+        Hidden,
+        Shortcut,
+        Weak
+    };
+
+    struct Edge {
+        EdgeType type;
+        /** @brief Name of the edge, empty for element edges */
+        std::string name;
+        /** @brief Index of the element for element edges */
+        uint32_t index;
+        /** @brief Index of the target node */
+        size_t to;
+    };
+
+    struct Node {
+        NodeType type;
+        /** @brief Class name, function name or string content */
+        std::string name;
+        uint64_t id;
+        size_t selfSize;
+        std::vector<Edge> edges;
+    };
+
+    static constexpr size_t objectSize = 48;
+    static constexpr size_t propertySize = 24;
+    static constexpr size_t stringSize = 16;
+    static constexpr size_t maxStringName = 256;
+
+private:
+    JSContext* _ctx;
+    std::vector<Node> _nodes;
+    std::unordered_map<void*, size_t> _index;
+    // references to all visited values, so their addresses are not reused while walking
+    std::vector<JSValue> _held;
+    std::deque<std::pair<size_t, JSValueConst>> _queue;
+
+    HeapSnapshot(JSContext* ctx) : _ctx(ctx) {}
+
+    void release() {
+        for (JSValue val : _held) {
+            JS_FreeValue(_ctx, val);
+        }
+        _held.clear();
+        _queue.clear();
+        _index.clear();
+    }
+
+    /**
+     * @brief Get the length of the longest prefix of at most maxLength bytes
+     * which does not split a UTF-8 sequence
+     */
+    static size_t utf8Prefix(std::string_view str, size_t maxLength) {
+        if (str.size() <= maxLength) {
+            return str.size();
+        }
+        size_t length = maxLength;
+        while (length > 0 && (static_cast<unsigned char>(str[length]) & 0xC0) == 0x80) {
+            length--;
+        }
+        return length;
+    }
+
+    void clearException() {
+        JS_FreeValue(_ctx, JS_GetException(_ctx));
+    }
+
+    std::string toString(JSValueConst val, size_t maxLength, size_t* length = nullptr) {
+        size_t len;
+        const char* str = JS_ToCStringLen(_ctx, &len, val);
+        if (!str) {
+            clearException();
+            return "";
+        }
+        std::string result(str, utf8Prefix({ str, len }, maxLength));
+        JS_FreeCString(_ctx, str);
+        if (length) {
+            *length = len;
+        }
+        return result;
+    }
+
+    std::string atomName(JSAtom atom) {
+        const char* str = JS_AtomToCString(_ctx, atom);
+        if (!str) {
+            clearException();
+            return "";
+        }
+        std::string result(str);
+        JS_FreeCString(_ctx, str);
+        return result;
+    }
+
+    /**
+     * @brief Get the value of an own data property without invoking getters
+     */
+    JSValue ownData(JSValueConst obj, const char* name) {
+        JSAtom atom = JS_NewAtom(_ctx, name);
+        JSPropertyDescriptor desc;
+        int res = JS_GetOwnProperty(_ctx, &desc, obj, atom);
+        JS_FreeAtom(_ctx, atom);
+        if (res < 0) {
+            clearException();
+        }
+        if (res <= 0) {
+            return JS_UNDEFINED;
+        }
+        JS_FreeValue(_ctx, desc.getter);
+        JS_FreeValue(_ctx, desc.setter);
+        return desc.value;
+    }
+
+    std::string functionName(JSValueConst func) {
+        JSValue name = ownData(func, "name");
+        std::string result = JS_IsString(name) ? toString(name, maxStringName) : "";
+        JS_FreeValue(_ctx, name);
+        return result;
+    }
+
+    std::string className(JSValueConst obj) {
+        std::string result;
+        JSValue proto = JS_GetPrototype(_ctx, obj);
+        if (JS_IsObject(proto)) {
+            JSValue ctor = ownData(proto, "constructor");
+            if (JS_IsFunction(_ctx, ctor)) {
+                result = functionName(ctor);
+            }
+            JS_FreeValue(_ctx, ctor);
+        }
+        JS_FreeValue(_ctx, proto);
+        return result.empty() ? "Object" : result;
+    }
+
+    static bool isIndex(std::string_view name) {
+        return !name.empty() && name.size() < 10 && name.find_first_not_of("0123456789") == std::string_view::npos
+            && (name == "0" || name[0] != '0');
+    }
+
+    static uint64_t idOf(void* ptr) {
+        return (reinterpret_cast<uintptr_t>(ptr) >> 3) * 2 + 1;
+    }
+
+    size_t addSynthetic(std::string name, size_t selfSize = 0) {
+        // pointers are aligned, so the ids do not collide with object ids
+        _nodes.push_back({ NodeType::Synthetic, std::move(name), _nodes.size() * 2 + 2, selfSize, {} });
+        return _nodes.size() - 1;
+    }
+
+    std::optional<size_t> nodeFor(JSValueConst val) {
+        int tag = JS_VALUE_GET_TAG(val);
+        if (tag != JS_TAG_OBJECT && tag != JS_TAG_STRING && tag != JS_TAG_SYMBOL) {
+            return std::nullopt;
+        }
+
+        void* ptr = JS_VALUE_GET_PTR(val);
+        if (auto it = _index.find(ptr); it != _index.end()) {
+            return it->second;
+        }
+
+        size_t index = _nodes.size();
+        _index.emplace(ptr, index);
+        _held.push_back(JS_DupValue(_ctx, val));
+        if (tag == JS_TAG_STRING) {
+            size_t length = 0;
+            std::string content = toString(val, maxStringName, &length);
+            _nodes.push_back({ NodeType::String, std::move(content), idOf(ptr), stringSize + length, {} });
+        }
+        else if (tag == JS_TAG_SYMBOL) {
+            _nodes.push_back({ NodeType::Symbol, "symbol", idOf(ptr), stringSize, {} });
+        }
+        else {
+            _nodes.push_back({ NodeType::ObjectNode, "", idOf(ptr), objectSize, {} });
+            _queue.emplace_back(index, val);
+        }
+        return index;
+    }
+
+    void addEdge(size_t from, EdgeType type, std::string name, JSValueConst val) {
+        if (auto to = nodeFor(val)) {
+            _nodes[from].edges.push_back({ type, std::move(name), 0, *to });
+        }
+    }
+
+    void addElement(size_t from, uint32_t index, JSValueConst val) {
+        if (auto to = nodeFor(val)) {
+            _nodes[from].edges.push_back({ EdgeType::Element, "", index, *to });
+        }
+    }
+
+    void expand(size_t index, JSValueConst obj) {
+        if (isProxy(_ctx, obj)) {
+            // enumerating a proxy would run its traps
+            _nodes[index].name = "Proxy";
+            return;
+        }
+
+        bool isFunction = JS_IsFunction(_ctx, obj);
+        int isArray = JS_IsArray(_ctx, obj);
+        if (isArray < 0) {
+            clearException();
+        }
+        std::string cls = className(obj);
+
+        NodeType type = NodeType::ObjectNode;
+        std::string name = cls;
+        size_t size = objectSize;
+        if (isFunction) {
+            type = NodeType::Closure;
+            name = functionName(obj);
+            if (name.empty()) {
+                name = "(anonymous)";
+            }
+        }
+        else if (isArray > 0) {
+            type = NodeType::ArrayNode;
+        }
+        else if (cls == "RegExp") {
+            type = NodeType::RegExp;
+        }
+        else if (cls == "ArrayBuffer" || cls == "SharedArrayBuffer") {
+            size_t length;
+            if (JS_GetArrayBuffer(_ctx, &length, obj)) {
+                size += length;
+            }
+            else {
+                clearException();
+            }
+        }
+        else if (cls.size() > 5 && cls.ends_with("Array")) {
+            JSValue buffer = JS_GetTypedArrayBuffer(_ctx, obj, nullptr, nullptr, nullptr);
+            if (JS_IsException(buffer)) {
+                clearException();
+            }
+            else {
+                addEdge(index, EdgeType::Internal, "buffer", buffer);
+                JS_FreeValue(_ctx, buffer);
+            }
+        }
+
+        JSPropertyEnum* props;
+        uint32_t count;
+        if (JS_GetOwnPropertyNames(_ctx, &props, &count, obj, JS_GPN_STRING_MASK | JS_GPN_SYMBOL_MASK) < 0) {
+            clearException();
+            count = 0;
+            props = nullptr;
+        }
+        size += count * propertySize;
+
+        for (uint32_t i = 0; i < count; i++) {
+            JSPropertyDescriptor desc;
+            int res = JS_GetOwnProperty(_ctx, &desc, obj, props[i].atom);
+            if (res < 0) {
+                clearException();
+            }
+            if (res <= 0) {
+                continue;
+            }
+
+            std::string propName = atomName(props[i].atom);
+            if (desc.flags & JS_PROP_GETSET) {
+                addEdge(index, EdgeType::Internal, "get " + propName, desc.getter);
+                addEdge(index, EdgeType::Internal, "set " + propName, desc.setter);
+            }
+            else if (isArray > 0 && isIndex(propName)) {
+                addElement(index, static_cast<uint32_t>(std::stoul(propName)), desc.value);
+            }
+            else {
+                addEdge(index, EdgeType::Property, std::move(propName), desc.value);
+            }
+            JS_FreeValue(_ctx, desc.value);
+            JS_FreeValue(_ctx, desc.getter);
+            JS_FreeValue(_ctx, desc.setter);
+        }
+        if (props) {
+            JS_FreePropertyEnum(_ctx, props, count);
+        }
+
+        JSValue proto = JS_GetPrototype(_ctx, obj);
+        addEdge(index, EdgeType::Property, "__proto__", proto);
+        JS_FreeValue(_ctx, proto);
+
+        Node& node = _nodes[index];
+        node.type = type;
+        node.name = std::move(name);
+        node.selfSize = size;
+    }
+
+    static void writeEscaped(std::ostream& os, std::string_view str) {
+        static constexpr char hex[] = "0123456789abcdef";
+        os << '"';
+        for (char c : str) {
+            switch (c) {
+                case '"': os << "\\\""; break;
+                case '\\': os << "\\\\"; break;
+                case '\n': os << "\\n"; break;
+                case '\r': os << "\\r"; break;
+                case '\t': os << "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        os << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+                    }
+                    else {
+                        os << c;
+                    }
+            }
+        }
+        os << '"';
+    }
+
+public:
+    /**
+     * @brief Take a snapshot of the objects reachable from the global object
+     * and the given roots
+     * @note Must be called from the thread running the machine
+     *
+     * @param ctx the context of the machine
+     * @param roots additional named roots, e.g. values held by module scopes
+     * @return The snapshot
+     */
+    static HeapSnapshot take(ContextRef ctx, std::vector<std::pair<std::string, ValueWeak>> roots = {}) {
+        HeapSnapshot snapshot(ctx);
+
+        size_t root = snapshot.addSynthetic("");
+        JSValue global = JS_GetGlobalObject(ctx);
+        snapshot.addEdge(root, EdgeType::Shortcut, "global", global);
+        JS_FreeValue(ctx, global);
+        for (auto& [name, value] : roots) {
+            snapshot.addEdge(root, EdgeType::Shortcut, name, value.getVal());
+        }
+
+        while (!snapshot._queue.empty()) {
+            auto [index, obj] = snapshot._queue.front();
+            snapshot._queue.pop_front();
+            snapshot.expand(index, obj);
+        }
+        snapshot.release();
+
+        JSMemoryUsage usage;
+        JS_ComputeMemoryUsage(JS_GetRuntime(ctx), &usage);
+        size_t attributed = snapshot.totalSize();
+        if (usage.malloc_size > 0 && static_cast<size_t>(usage.malloc_size) > attributed) {
+            size_t other = snapshot.addSynthetic("(unattributed)", static_cast<size_t>(usage.malloc_size) - attributed);
+            snapshot._nodes[root].edges.push_back({ EdgeType::Shortcut, "(unattributed)", 0, other });
+        }
+
+        return snapshot;
+    }
+
+    HeapSnapshot(const HeapSnapshot&) = delete;
+    HeapSnapshot& operator=(const HeapSnapshot&) = delete;
+    HeapSnapshot(HeapSnapshot&&) = default;
+    HeapSnapshot& operator=(HeapSnapshot&&) = default;
+
+    /**
+     * @brief Get the nodes of the graph. The first node is the synthetic root.
+     *
+     * @return The nodes
+     */
+    const std::vector<Node>& nodes() const {
+        return _nodes;
+    }
+
+    /**
+     * @brief Get the sum of the sizes of all nodes
+     *
+     * @return The size in bytes
+     */
+    size_t totalSize() const {
+        size_t total = 0;
+        for (auto& node : _nodes) {
+            total += node.selfSize;
+        }
+        return total;
+    }
+
+    /**
+     * @brief Write the snapshot in the Chrome DevTools `.heapsnapshot` format
+     *
+     * @param os the output stream
+     */
+    void writeJson(std::ostream& os) const {
+        static constexpr size_t nodeFields = 6;
+
+        std::vector<std::string_view> strings;
+        std::unordered_map<std::string_view, size_t> stringIndex;
+        auto intern = [&](std::string_view str) {
+            auto [it, inserted] = stringIndex.emplace(str, strings.size());
+            if (inserted) {
+                strings.push_back(str);
+            }
+            return it->second;
+        };
+
+        size_t edgeCount = 0;
+        for (auto& node : _nodes) {
+            edgeCount += node.edges.size();
+        }
+
+        os << "{\"snapshot\":{\"meta\":{"
+           << "\"node_fields\":[\"type\",\"name\",\"id\",\"self_size\",\"edge_count\",\"trace_node_id\"],"
+           << "\"node_types\":[[\"hidden\",\"array\",\"string\",\"object\",\"code\",\"closure\",\"regexp\",\"number\","
+           << "\"native\",\"synthetic\",\"concatenated string\",\"sliced string\",\"symbol\",\"bigint\"],"
+           << "\"string\",\"number\",\"number\",\"number\",\"number\"],"
+           << "\"edge_fields\":[\"type\",\"name_or_index\",\"to_node\"],"
+           << "\"edge_types\":[[\"context\",\"element\",\"property\",\"internal\",\"hidden\",\"shortcut\",\"weak\"],"
+           << "\"string_or_number\",\"node\"],"
+           << "\"trace_function_info_fields\":[\"function_id\",\"name\",\"script_name\",\"script_id\",\"line\",\"column\"],"
+           << "\"trace_node_fields\":[\"id\",\"function_info_index\",\"count\",\"size\",\"children\"],"
+           << "\"sample_fields\":[\"timestamp_us\",\"last_assigned_id\"],"
+           << "\"location_fields\":[\"object_index\",\"script_id\",\"line\",\"column\"]},"
+           << "\"node_count\":" << _nodes.size() << ",\"edge_count\":" << edgeCount << ",\"trace_function_count\":0},";
+
+        os << "\"nodes\":[";
+        for (size_t i = 0; i < _nodes.size(); i++) {
+            auto& node = _nodes[i];
+            os << (i == 0 ? "" : ",") << static_cast<int>(node.type) << "," << intern(node.name) << "," << node.id
+               << "," << node.selfSize << "," << node.edges.size() << ",0";
+        }
+
+        os << "],\"edges\":[";
+        bool first = true;
+        for (auto& node : _nodes) {
+            for (auto& edge : node.edges) {
+                os << (first ? "" : ",") << static_cast<int>(edge.type) << ","
+                   << (edge.type == EdgeType::Element ? edge.index : intern(edge.name)) << "," << edge.to * nodeFields;
+                first = false;
+            }
+        }
+
+        os << "],\"trace_function_infos\":[],\"trace_tree\":[],\"samples\":[],\"locations\":[],\"strings\":[";
+        for (size_t i = 0; i < strings.size(); i++) {
+            if (i > 0) {
+                os << ",";
+            }
+            writeEscaped(os, strings[i]);
+        }
+        os << "]}";
+    }
+
+    /**
+     * @brief Get the snapshot in the Chrome DevTools `.heapsnapshot` format
+     *
+     * @return The JSON string
+     */
+    std::string toJson() const {
+        std::ostringstream os;
+        writeJson(os);
+        return os.str();
+    }
+
+    ~HeapSnapshot() {
+        release();
+    }
+};
+
+
+} // namespace jac
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace jac {
+
+
+/**
+ * @brief Lock-free histogram with power-of-two buckets. Bucket i counts values
+ * less or equal to 2^i, the last bucket counts all larger values.
+ *
+ * All operations use relaxed atomics, so a snapshot taken concurrently with
+ * recording may be slightly inconsistent (e.g. the count may not match the
+ * sum of the buckets).
+ */
+class Histogram {
+public:
+    static constexpr size_t bucketCount = 32;
+
+    struct Snapshot {
+        std::array<uint64_t, bucketCount> buckets{};
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        /**
+         * @brief Get an upper estimate of the given percentile
+         *
+         * @param p the percentile in range [0, 1]
+         * @return Upper bound of the bucket containing the percentile
+         */
+        uint64_t percentile(double p) const {
+            uint64_t rank = static_cast<uint64_t>(p * count);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < bucketCount; i++) {
+                seen += buckets[i];
+                if (seen > rank || (seen == count && seen > 0)) {
+                    return bucketBound(i);
+                }
+            }
+            return 0;
+        }
+    };
+
+private:
+    std::array<std::atomic<uint64_t>, bucketCount> _buckets{};
+    std::atomic<uint64_t> _count = 0;
+    std::atomic<uint64_t> _sum = 0;
+
+public:
+    static uint64_t bucketBound(size_t bucket) {
+        return uint64_t(1) << bucket;
+    }
+
+    void record(uint64_t value) {
+        size_t bucket = value == 0 ? 0 : std::min<size_t>(std::bit_width(value - 1), bucketCount - 1);
+        _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        _count.fetch_add(1, std::memory_order_relaxed);
+        _sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot result;
+        for (size_t i = 0; i < bucketCount; i++) {
+            result.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        }
+        result.count = _count.load(std::memory_order_relaxed);
+        result.sum = _sum.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    /**
+     * @brief Reset all buckets to zero
+     * @note Values recorded concurrently may be partially lost
+     */
+    void reset() {
+        for (auto& bucket : _buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        _count.store(0, std::memory_order_relaxed);
+        _sum.store(0, std::memory_order_relaxed);
+    }
+};
+
+
+} // namespace jac
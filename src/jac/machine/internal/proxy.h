@@ -0,0 +1,87 @@
+#pragma once
+
+#include <quickjs.h>
+
+#include <atomic>
+
+
+namespace jac {
+
+
+/**
+ * @brief Get the class id of Proxy objects, which is not exported by QuickJS
+ *
+ * The id is found by constructing a proxy using the global `Proxy` constructor
+ * and probing the class ids. The proxy data are stored as the opaque pointer of
+ * the object, so only the class id of the proxy yields a pointer.
+ *
+ * @param ctx the context
+ * @return The class id, or 0 if it could not be found
+ */
+inline JSClassID proxyClassId(JSContext* ctx) {
+    // the ids of the built-in classes are the same in all runtimes
+    static std::atomic<JSClassID> cached = 0;
+    if (JSClassID id = cached.load(std::memory_order_relaxed)) {
+        return id;
+    }
+
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSAtom atom = JS_NewAtom(ctx, "Proxy");
+    JSPropertyDescriptor desc;
+    int res = JS_GetOwnProperty(ctx, &desc, global, atom);
+    JS_FreeAtom(ctx, atom);
+    JS_FreeValue(ctx, global);
+    if (res < 0) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+    }
+    if (res <= 0) {
+        return 0;
+    }
+    JS_FreeValue(ctx, desc.getter);
+    JS_FreeValue(ctx, desc.setter);
+
+    JSClassID found = 0;
+    if (JS_IsConstructor(ctx, desc.value)) {
+        JSValue args[] = { JS_NewObject(ctx), JS_NewObject(ctx) };
+        JSValue probe = JS_CallConstructor(ctx, desc.value, 2, args);
+        JS_FreeValue(ctx, args[0]);
+        JS_FreeValue(ctx, args[1]);
+        if (JS_IsException(probe)) {
+            JS_FreeValue(ctx, JS_GetException(ctx));
+        }
+        else {
+            for (JSClassID id = 1; id < 256 && !found; id++) {
+                if (JS_GetOpaque(probe, id)) {
+                    found = id;
+                }
+            }
+            JS_FreeValue(ctx, probe);
+        }
+    }
+    JS_FreeValue(ctx, desc.value);
+
+    if (found) {
+        cached.store(found, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+
+/**
+ * @brief Check whether the value is a Proxy object, without running any of
+ * its traps
+ *
+ * @param ctx the context
+ * @param val the value
+ * @return true if the value is a proxy
+ */
+inline bool isProxy(JSContext* ctx, JSValueConst val) {
+    if (!JS_IsObject(val)) {
+        return false;
+    }
+    JSClassID id = proxyClassId(ctx);
+    return id != 0 && JS_GetOpaque(val, id) != nullptr;
+}
+
+
+} // namespace jac
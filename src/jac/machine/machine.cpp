@@ -1,9 +1,32 @@
 #include "machine.h"
 
+#include <cstddef>
+#include <cstdlib>
+
 
 namespace jac {
 
 
+namespace {
+
+// the size of each allocation is stored in front of it
+constexpr size_t allocationHeader = alignof(std::max_align_t);
+
+size_t& allocationSize(void* block) {
+    return *static_cast<size_t*>(block);
+}
+
+void* blockOf(const void* ptr) {
+    return const_cast<char*>(static_cast<const char*>(ptr)) - allocationHeader;
+}
+
+bool overLimit(JSMallocState* state, size_t size) {
+    return state->malloc_limit != 0 && state->malloc_size + size > state->malloc_limit;
+}
+
+} // namespace
+
+
 Module::Module(ContextRef ctx, std::string name) : _ctx(ctx) {
     _def = JS_NewCModule(ctx, name.c_str(), [](JSContext* context, JSModuleDef* def) {
         Module& mdl = base(context).findModule(def);
@@ -23,15 +46,96 @@ void Module::addExport(std::string name, Value val) {
     exports.emplace_back(name, val);
 }
 
+void MachineBase::allocationFailed(JSMallocState* state) {
+    MachineBase& base = *static_cast<MachineBase*>(state->opaque);
+    base._outOfMemory = true;
+    base._outOfMemoryCount++;
+}
+
+void* MachineBase::jsMalloc(JSMallocState* state, size_t size) {
+    if (overLimit(state, size + allocationHeader)) {
+        allocationFailed(state);
+        return nullptr;
+    }
+    void* block = std::malloc(size + allocationHeader);
+    if (!block) {
+        allocationFailed(state);
+        return nullptr;
+    }
+    allocationSize(block) = size;
+    state->malloc_count++;
+    state->malloc_size += size + allocationHeader;
+    return static_cast<char*>(block) + allocationHeader;
+}
+
+void MachineBase::jsFree(JSMallocState* state, void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    void* block = blockOf(ptr);
+    state->malloc_count--;
+    state->malloc_size -= allocationSize(block) + allocationHeader;
+    std::free(block);
+}
+
+void* MachineBase::jsRealloc(JSMallocState* state, void* ptr, size_t size) {
+    if (!ptr) {
+        return size > 0 ? jsMalloc(state, size) : nullptr;
+    }
+    if (size == 0) {
+        jsFree(state, ptr);
+        return nullptr;
+    }
+
+    void* block = blockOf(ptr);
+    size_t oldSize = allocationSize(block);
+    if (size > oldSize && overLimit(state, size - oldSize)) {
+        allocationFailed(state);
+        return nullptr;
+    }
+    block = std::realloc(block, size + allocationHeader);
+    if (!block) {
+        allocationFailed(state);
+        return nullptr;
+    }
+    allocationSize(block) = size;
+    state->malloc_size = state->malloc_size - oldSize + size;
+    return static_cast<char*>(block) + allocationHeader;
+}
+
+size_t MachineBase::jsMallocUsableSize(const void* ptr) {
+    return ptr ? allocationSize(blockOf(ptr)) : 0;
+}
+
 void MachineBase::initialize() {
     // last in stack
 
-    _runtime = JS_NewRuntime();
+    if (_outOfMemoryHandler) {
+        static const JSMallocFunctions mallocFunctions = { jsMalloc, jsFree, jsRealloc, jsMallocUsableSize };
+        _runtime = JS_NewRuntime2(&mallocFunctions, this);
+    }
+    else {
+        _runtime = JS_NewRuntime();
+    }
+    if (_memoryLimit) {
+        JS_SetMemoryLimit(_runtime, *_memoryLimit > 0 ? *_memoryLimit : static_cast<size_t>(-1));
+    }
+    if (_maxStackSize) {
+        JS_SetMaxStackSize(_runtime, *_maxStackSize);
+    }
     _context = JS_NewContext(_runtime);
 
     JS_SetContextOpaque(_context, this);
     JS_SetInterruptHandler(_runtime, [](JSRuntime*, void* opaque) noexcept {
         MachineBase& base = *static_cast<MachineBase*>(opaque);
+        if (base._outOfMemory) {
+            // the handler runs once the code returns; code which keeps running after
+            // the failure (e.g. catches the error and allocates again) is interrupted
+            if (base._outOfMemoryPolled) {
+                return 1;
+            }
+            base._outOfMemoryPolled = true;
+        }
         if (base._interrupt) {
             base._interrupt = false;
             return 1;
@@ -50,6 +154,7 @@ void MachineBase::initialize() {
 }
 
 Value MachineBase::eval(std::string code, std::string filename, EvalFlags flags /*= EvalFlags::Global*/) {
+    TraceSpan span(_tracer, "eval", filename);
     resetWatchdog();
     Value bytecode(_context, JS_Eval(_context, code.c_str(), code.size(), filename.c_str(), static_cast<int>(flags | EvalFlags::CompileOnly)));
     if (static_cast<int>(flags & EvalFlags::CompileOnly) != 0) {
@@ -57,7 +162,9 @@ Value MachineBase::eval(std::string code, std::string filename, EvalFlags flags
     }
     code = "";
     resetWatchdog();
-    return Value(_context, JS_EvalFunction(_context, bytecode.loot().second));
+    Value result(_context, JS_EvalFunction(_context, bytecode.loot().second));
+    handleOutOfMemory();
+    return result;
 }
 
 Module& MachineBase::newModule(std::string name) {
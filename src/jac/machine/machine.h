@@ -4,11 +4,14 @@
 
 #include <chrono>
 #include <functional>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "memoryStats.h"
+#include "tracer.h"
 #include "values.h"
 
 
@@ -50,6 +53,26 @@ inline constexpr EvalFlags operator&(EvalFlags a, EvalFlags b) {
 class MachineBase;
 
 
+/**
+ * @brief Action taken when the machine runs out of memory, see
+ * MachineBase::setOutOfMemoryHandler
+ */
+enum class OutOfMemoryAction {
+    /** @brief Only throw the out of memory error to javascript */
+    Ignore,
+    /** @brief Run the garbage collector */
+    CollectGarbage,
+    /**
+     * @brief Only throw the out of memory error to javascript, kept for
+     * compatibility - the code which caused the failure has already
+     * returned or has been interrupted when the handler runs
+     */
+    Interrupt,
+    /** @brief Stop the event loop */
+    Kill
+};
+
+
 /**
  * @brief A wrapper around JSModuleDef that allows for easy exporting of values
  */
@@ -120,6 +143,22 @@ private:
 
     JSRuntime* _runtime = nullptr;
     ContextRef _context = nullptr;
+
+    Tracer* _tracer = nullptr;
+
+    std::optional<size_t> _memoryLimit;
+    std::optional<size_t> _maxStackSize;
+    std::function<OutOfMemoryAction()> _outOfMemoryHandler;
+    bool _outOfMemory = false;
+    bool _outOfMemoryPolled = false;
+    bool _outOfMemoryKill = false;
+    uint64_t _outOfMemoryCount = 0;
+
+    static void* jsMalloc(JSMallocState* state, size_t size);
+    static void jsFree(JSMallocState* state, void* ptr);
+    static void* jsRealloc(JSMallocState* state, void* ptr, size_t size);
+    static size_t jsMallocUsableSize(const void* ptr);
+    static void allocationFailed(JSMallocState* state);
 public:
     /**
      * @brief Get the JSRuntime* for this machine
@@ -154,6 +193,7 @@ public:
     MachineBase& operator=(MachineBase&&) = delete;
 
     virtual ~MachineBase() {
+        setTracer(nullptr);
         _modules.clear();
         if (_context) {
             JS_FreeContext(_context);
@@ -220,6 +260,161 @@ public:
         _wathdogCallback = callback;
     }
 
+    /**
+     * @brief Set the maximum amount of memory the machine can allocate.
+     * Allocations over the limit fail and throw an out of memory error
+     * to javascript.
+     *
+     * @param limit the limit in bytes, zero for no limit
+     */
+    void setMemoryLimit(size_t limit) {
+        _memoryLimit = limit;
+        if (_runtime) {
+            JS_SetMemoryLimit(_runtime, limit > 0 ? limit : static_cast<size_t>(-1));
+        }
+    }
+
+    /**
+     * @brief Set the maximum stack size used by javascript code. Deeper
+     * recursion throws a stack overflow error to javascript.
+     * @note The stack is measured from the point where the event loop
+     * was entered (see JS_UpdateStackTop)
+     *
+     * @param size the size in bytes, zero for no limit
+     */
+    void setMaxStackSize(size_t size) {
+        _maxStackSize = size;
+        if (_runtime) {
+            JS_SetMaxStackSize(_runtime, size);
+        }
+    }
+
+    /**
+     * @brief Set the handler called when an allocation of the machine
+     * fails. The handler is not called from the allocator, but once the
+     * running code returns - after eval and before the event loop
+     * continues. Code which keeps running after the failure (e.g. catches
+     * the error in a loop) is interrupted, so that the handler can run.
+     * @note Must be set before the machine is initialized, a custom
+     * allocator is used to detect failed allocations. The handler must not
+     * throw.
+     *
+     * @param handler the handler returning the action to take
+     */
+    void setOutOfMemoryHandler(std::function<OutOfMemoryAction()> handler) {
+        _outOfMemoryHandler = std::move(handler);
+    }
+
+    /**
+     * @brief Call the out of memory handler if an allocation failed since
+     * the last call and take the returned action. Called by eval and by
+     * EventLoopFeature once the running code returns.
+     *
+     * @return The action taken
+     */
+    OutOfMemoryAction handleOutOfMemory() {
+        if (!_outOfMemory) {
+            return OutOfMemoryAction::Ignore;
+        }
+        _outOfMemory = false;
+        _outOfMemoryPolled = false;
+
+        OutOfMemoryAction action = _outOfMemoryHandler ? _outOfMemoryHandler() : OutOfMemoryAction::Ignore;
+        switch (action) {
+            case OutOfMemoryAction::Ignore:
+            case OutOfMemoryAction::Interrupt:
+                break;
+            case OutOfMemoryAction::CollectGarbage:
+                runGC();
+                break;
+            case OutOfMemoryAction::Kill:
+                _outOfMemoryKill = true;
+                break;
+        }
+        return action;
+    }
+
+    /**
+     * @brief Check if the out of memory handler requested the machine to
+     * be killed
+     *
+     * @return true if OutOfMemoryAction::Kill was returned
+     */
+    bool outOfMemoryKillRequested() {
+        return _outOfMemoryKill;
+    }
+
+    /**
+     * @brief Get the number of failed allocations. Only counted when an
+     * out of memory handler is set.
+     *
+     * @return The number of failed allocations
+     */
+    uint64_t outOfMemoryCount() {
+        return _outOfMemoryCount;
+    }
+
+    /**
+     * @brief Set the tracer recording spans of the machine activity. The
+     * tracer must outlive the machine or be detached by setting nullptr.
+     * One tracer can be shared by multiple machines.
+     *
+     * @param tracer the tracer or nullptr to disable tracing
+     */
+    void setTracer(Tracer* tracer) {
+        if (_tracer) {
+            Tracer::attached(false);
+        }
+        _tracer = tracer;
+        if (_tracer) {
+            Tracer::attached(true);
+        }
+    }
+
+    /**
+     * @brief Get the tracer of the machine
+     *
+     * @return The tracer or nullptr if tracing is disabled
+     */
+    Tracer* tracer() {
+        return _tracer;
+    }
+
+    /**
+     * @brief Get the tracer of the machine owning the given context
+     *
+     * @param ctx the context
+     * @return The tracer or nullptr if tracing is disabled
+     */
+    static Tracer* tracer(ContextRef ctx) {
+        if (!Tracer::anyAttached()) {
+            return nullptr;
+        }
+        auto base = static_cast<MachineBase*>(JS_GetContextOpaque(ctx));
+        return base ? base->_tracer : nullptr;
+    }
+
+    /**
+     * @brief Compute a snapshot of the memory used by the machine. Walks
+     * all objects of the runtime, so its cost grows with the heap size.
+     * @note Must be called from the thread running the machine
+     *
+     * @return The snapshot
+     */
+    MemoryStats memoryStats() {
+        JSMemoryUsage usage;
+        JS_ComputeMemoryUsage(_runtime, &usage);
+        return MemoryStats::from(usage);
+    }
+
+    /**
+     * @brief Run the garbage collector
+     */
+    void runGC() {
+        TraceSpan span(_tracer, "gc", "gc");
+        JS_RunGC(_runtime);
+    }
+
     friend class Module;
 };
 
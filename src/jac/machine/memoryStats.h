@@ -0,0 +1,117 @@
+#pragma once
+
+#include <quickjs.h>
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+
+namespace jac {
+
+
+/**
+ * @brief Snapshot of the memory used by a machine, see MachineBase::memoryStats.
+ * Sizes are in bytes.
+ */
+struct MemoryStats {
+    /** @brief Memory allocated by the runtime */
+    int64_t mallocSize = 0;
+    /** @brief Memory limit of the runtime, -1 if unlimited */
+    int64_t mallocLimit = 0;
+    /** @brief Number of live allocations */
+    int64_t mallocCount = 0;
+    /** @brief Memory used by the engine data structures */
+    int64_t memoryUsedSize = 0;
+
+    int64_t atomCount = 0;
+    int64_t atomSize = 0;
+    int64_t stringCount = 0;
+    int64_t stringSize = 0;
+    int64_t objectCount = 0;
+    int64_t objectSize = 0;
+    int64_t propertyCount = 0;
+    int64_t propertySize = 0;
+    int64_t shapeCount = 0;
+    int64_t shapeSize = 0;
+
+    /** @brief Number of bytecode functions */
+    int64_t functionCount = 0;
+    /** @brief Size of bytecode functions including their code */
+    int64_t functionSize = 0;
+    int64_t functionCodeSize = 0;
+    /** @brief Number of native functions */
+    int64_t nativeFunctionCount = 0;
+
+    int64_t arrayCount = 0;
+    int64_t fastArrayCount = 0;
+    int64_t fastArrayElements = 0;
+    /** @brief Number of ArrayBuffers and typed arrays */
+    int64_t binaryObjectCount = 0;
+    /** @brief Size of ArrayBuffer data */
+    int64_t binaryObjectSize = 0;
+
+    static MemoryStats from(const JSMemoryUsage& usage) {
+        MemoryStats stats;
+        stats.mallocSize = usage.malloc_size;
+        stats.mallocLimit = usage.malloc_limit;
+        stats.mallocCount = usage.malloc_count;
+        stats.memoryUsedSize = usage.memory_used_size;
+        stats.atomCount = usage.atom_count;
+        stats.atomSize = usage.atom_size;
+        stats.stringCount = usage.str_count;
+        stats.stringSize = usage.str_size;
+        stats.objectCount = usage.obj_count;
+        stats.objectSize = usage.obj_size;
+        stats.propertyCount = usage.prop_count;
+        stats.propertySize = usage.prop_size;
+        stats.shapeCount = usage.shape_count;
+        stats.shapeSize = usage.shape_size;
+        stats.functionCount = usage.js_func_count;
+        stats.functionSize = usage.js_func_size;
+        stats.functionCodeSize = usage.js_func_code_size;
+        stats.nativeFunctionCount = usage.c_func_count;
+        stats.arrayCount = usage.array_count;
+        stats.fastArrayCount = usage.fast_array_count;
+        stats.fastArrayElements = usage.fast_array_elements;
+        stats.binaryObjectCount = usage.binary_object_count;
+        stats.binaryObjectSize = usage.binary_object_size;
+        return stats;
+    }
+
+    /**
+     * @brief Export the snapshot as a JSON object
+     *
+     * @return The JSON string
+     */
+    std::string toJson() const {
+        std::ostringstream os;
+        os << "{\"mallocSize\":" << mallocSize
+           << ",\"mallocLimit\":" << mallocLimit
+           << ",\"mallocCount\":" << mallocCount
+           << ",\"memoryUsedSize\":" << memoryUsedSize
+           << ",\"atomCount\":" << atomCount
+           << ",\"atomSize\":" << atomSize
+           << ",\"stringCount\":" << stringCount
+           << ",\"stringSize\":" << stringSize
+           << ",\"objectCount\":" << objectCount
+           << ",\"objectSize\":" << objectSize
+           << ",\"propertyCount\":" << propertyCount
+           << ",\"propertySize\":" << propertySize
+           << ",\"shapeCount\":" << shapeCount
+           << ",\"shapeSize\":" << shapeSize
+           << ",\"functionCount\":" << functionCount
+           << ",\"functionSize\":" << functionSize
+           << ",\"functionCodeSize\":" << functionCodeSize
+           << ",\"nativeFunctionCount\":" << nativeFunctionCount
+           << ",\"arrayCount\":" << arrayCount
+           << ",\"fastArrayCount\":" << fastArrayCount
+           << ",\"fastArrayElements\":" << fastArrayElements
+           << ",\"binaryObjectCount\":" << binaryObjectCount
+           << ",\"binaryObjectSize\":" << binaryObjectSize << "}";
+        return os.str();
+    }
+};
+
+
+} // namespace jac
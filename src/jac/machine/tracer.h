@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+
+namespace jac {
+
+
+/**
+ * @brief Records spans of machine activity into a lock-free ring buffer.
+ * The recorded spans can be exported in the Chrome Trace Event format
+ * (e.g. for Perfetto or chrome://tracing).
+ *
+ * Spans can be recorded from multiple threads. When the buffer is full,
+ * the oldest spans are overwritten. Reading the buffer never blocks the
+ * recording threads - spans overwritten while being read are skipped.
+ */
+class Tracer {
+public:
+    static constexpr size_t maxNameLength = 47;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t nameWords = (maxNameLength + 1) / sizeof(uint64_t);
+
+    struct Slot {
+        // odd while the slot is being written
+        std::atomic<uint64_t> sequence = 0;
+        std::atomic<const char*> category = nullptr;
+        std::array<std::atomic<uint64_t>, nameWords> name{};
+        std::atomic<int64_t> start = 0;
+        std::atomic<int64_t> duration = 0;
+        std::atomic<uint32_t> thread = 0;
+    };
+
+    struct Span {
+        const char* category;
+        char name[maxNameLength + 1];
+        int64_t start;
+        int64_t duration;
+        uint32_t thread;
+    };
+
+    std::unique_ptr<Slot[]> _slots;
+    size_t _capacity;
+    std::atomic<uint64_t> _head = 0;
+    Clock::time_point _origin = Clock::now();
+
+    static inline std::atomic<int> _attached = 0;
+
+    static uint32_t threadId() {
+        static std::atomic<uint32_t> nextId = 1;
+        thread_local uint32_t id = nextId++;
+        return id;
+    }
+
+    bool read(size_t index, Span& span) const {
+        const Slot& slot = _slots[index];
+        uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence == 0 || sequence % 2 == 1) {
+            return false;
+        }
+
+        span.category = slot.category.load(std::memory_order_relaxed);
+        std::array<uint64_t, nameWords> words;
+        for (size_t i = 0; i < nameWords; i++) {
+            words[i] = slot.name[i].load(std::memory_order_relaxed);
+        }
+        std::memcpy(span.name, words.data(), sizeof(span.name));
+        span.name[maxNameLength] = '\0';
+        span.start = slot.start.load(std::memory_order_relaxed);
+        span.duration = slot.duration.load(std::memory_order_relaxed);
+        span.thread = slot.thread.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+    static void writeEscaped(std::ostream& os, std::string_view str) {
+        for (char c : str) {
+            switch (c) {
+                case '"': os << "\\\""; break;
+                case '\\': os << "\\\\"; break;
+                case '\n': os << "\\n"; break;
+                case '\t': os << "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        os << ' ';
+                    }
+                    else {
+                        os << c;
+                    }
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Create a new tracer
+     *
+     * @param capacity number of spans kept in the ring buffer
+     */
+    Tracer(size_t capacity = 65536) : _slots(std::make_unique<Slot[]>(capacity > 0 ? capacity : 1)), _capacity(capacity > 0 ? capacity : 1) {}
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    /**
+     * @brief Check if any tracer is attached to a machine. Used to skip
+     * tracing overhead when tracing is not used at all.
+     */
+    static bool anyAttached() {
+        return _attached.load(std::memory_order_relaxed) > 0;
+    }
+
+    /**
+     * @brief Register attaching (true) or detaching (false) of a tracer,
+     * see MachineBase::setTracer
+     */
+    static void attached(bool value) {
+        _attached.fetch_add(value ? 1 : -1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Record a finished span
+     *
+     * @param category category of the span, must be a string literal
+     * @param name name of the span, truncated to maxNameLength characters
+     * @param start start of the span
+     * @param end end of the span
+     */
+    void record(const char* category, std::string_view name, Clock::time_point start, Clock::time_point end) {
+        uint64_t index = _head.fetch_add(1, std::memory_order_relaxed) % _capacity;
+        Slot& slot = _slots[index];
+
+        uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::array<uint64_t, nameWords> words{};
+        std::memcpy(words.data(), name.data(), std::min(name.size(), maxNameLength));
+        for (size_t i = 0; i < nameWords; i++) {
+            slot.name[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.category.store(category, std::memory_order_relaxed);
+        slot.start.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start - _origin).count(), std::memory_order_relaxed);
+        slot.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+        slot.thread.store(threadId(), std::memory_order_relaxed);
+
+        slot.sequence.store((sequence | 1) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Get the number of spans recorded since the tracer was created
+     * or cleared, including overwritten ones
+     */
+    uint64_t recorded() const {
+        return _head.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Write the spans in the buffer as a Chrome Trace Event JSON object
+     *
+     * @param os the output stream
+     */
+    void writeChromeTrace(std::ostream& os) const {
+        uint64_t head = _head.load(std::memory_order_acquire);
+        uint64_t first = head > _capacity ? head - _capacity : 0;
+
+        os << "{\"traceEvents\":[";
+        bool firstEvent = true;
+        Span span;
+        for (uint64_t i = first; i < head; i++) {
+            if (!read(i % _capacity, span)) {
+                continue;
+            }
+
+            os << (firstEvent ? "" : ",") << "{\"name\":\"";
+            writeEscaped(os, span.name);
+            os << "\",\"cat\":\"" << (span.category ? span.category : "") << "\",\"ph\":\"X\""
+               << ",\"ts\":" << static_cast<double>(span.start) / 1000
+               << ",\"dur\":" << static_cast<double>(span.duration) / 1000
+               << ",\"pid\":1,\"tid\":" << span.thread << "}";
+            firstEvent = false;
+        }
+        os << "],\"displayTimeUnit\":\"ms\"}";
+    }
+
+    /**
+     * @brief Get the spans in the buffer as a Chrome Trace Event JSON object
+     *
+     * @return The JSON string
+     */
+    std::string toChromeTrace() const {
+        std::ostringstream os;
+        writeChromeTrace(os);
+        return os.str();
+    }
+
+    /**
+     * @brief Discard all recorded spans
+     * @note Must not be called while spans are being recorded
+     */
+    void clear() {
+        for (size_t i = 0; i < _capacity; i++) {
+            _slots[i].sequence.store(0, std::memory_order_relaxed);
+        }
+        _head.store(0, std::memory_order_release);
+    }
+};
+
+
+/**
+ * @brief Records a span from its construction to its destruction. Does
+ * nothing if the tracer is null.
+ */
+class TraceSpan {
+    Tracer* _tracer;
+    const char* _category;
+    std::string_view _name;
+    std::chrono::steady_clock::time_point _start;
+public:
+    /**
+     * @brief Start a new span
+     *
+     * @param tracer the tracer or nullptr
+     * @param category category of the span, must be a string literal
+     * @param name name of the span, must outlive the span
+     */
+    TraceSpan(Tracer* tracer, const char* category, std::string_view name) : _tracer(tracer), _category(category), _name(name) {
+        if (_tracer) {
+            _start = std::chrono::steady_clock::now();
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        if (_tracer) {
+            _tracer->record(_category, _name, _start, std::chrono::steady_clock::now());
+        }
+    }
+};
+
+
+} // namespace jac
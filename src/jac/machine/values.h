@@ -722,6 +722,10 @@ protected:
     static void freeArrayBuffer(JSRuntime*, void*, void *ptr) {
         delete[] static_cast<uint8_t*>(ptr);
     }
+
+    static void freeVector(JSRuntime*, void* opaque, void*) {
+        delete static_cast<std::vector<uint8_t>*>(opaque);
+    }
 public:
     /**
      * @brief Wrap an existing JSValue. If managed is true, JSValue will be freed when the ArrayBuffer is destroyed.
@@ -795,6 +799,19 @@ public:
     static ArrayBuffer create(ContextRef ctx, std::span<const uint8_t> data) {
         return ArrayBuffer(ctx, JS_NewArrayBufferCopy(ctx, data.data(), data.size()));
     }
+
+    /**
+     * @brief Create a new ArrayBuffer object which takes ownership of the
+     * data without copying it
+     *
+     * @param ctx context to work in
+     * @param data data to move into the buffer
+     * @return The new ArrayBuffer object
+     */
+    static ArrayBuffer create(ContextRef ctx, std::vector<uint8_t>&& data) {
+        auto vec = new std::vector<uint8_t>(std::move(data));
+        return ArrayBuffer(ctx, JS_NewArrayBuffer(ctx, vec->data(), vec->size(), freeVector, vec, false));
+    }
 };
 
 template<bool managed>
@@ -0,0 +1,266 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/loopMetricsFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#ifdef __linux__
+#include <poll.h>
+#endif
+
+#include "util.h"
+
+
+using Machine =
+    jac::EventLoopTerminal<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>;
+
+using MetricsMachine =
+    jac::EventLoopTerminal<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    jac::LoopMetricsFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>>;
+
+
+TEST_CASE("Run once", "[eventLoop]") {
+    Machine machine;
+    machine.initialize();
+
+    SECTION("Until exit") {
+        evalCode(machine, R"(
+            report("start");
+            Promise.resolve().then(() => report("job"));
+            setTimeout(() => { report("timeout"); exit(0); }, 10);
+        )", "test", jac::EvalFlags::Global);
+
+        while (!machine.hasExited()) {
+            machine.runOnce(std::chrono::milliseconds(100));
+        }
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "start", "job", "timeout" });
+        REQUIRE(machine.getExitCode() == 0);
+    }
+
+    SECTION("Next deadline") {
+        evalCode(machine, "setTimeout(() => report('timeout'), 200);", "test", jac::EvalFlags::Global);
+
+        auto start = std::chrono::steady_clock::now();
+        auto next = machine.poll();
+
+        REQUIRE(next);
+        REQUIRE(*next > start + std::chrono::milliseconds(100));
+        REQUIRE(std::chrono::steady_clock::now() < start + std::chrono::milliseconds(100));
+        REQUIRE(machine.getReports().empty());
+    }
+
+    SECTION("Idle") {
+        REQUIRE_FALSE(machine.poll());
+    }
+
+    SECTION("Event budget") {
+        for (int i = 0; i < 10; i++) {
+            machine.scheduleEvent([&machine, i]() {
+                machine.report(std::to_string(i));
+            });
+        }
+
+        auto next = machine.runOnce(std::chrono::milliseconds(0), 3);
+
+        REQUIRE(next);
+        REQUIRE(*next <= std::chrono::steady_clock::now());
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "0", "1", "2" });
+
+        machine.runOnce();
+        REQUIRE(machine.getReports().size() == 10);
+    }
+}
+
+
+TEST_CASE("Job budget", "[eventLoop]") {
+    Machine machine;
+    machine.initialize();
+
+    evalCode(machine, R"(
+        let count = 0;
+        function spin() {
+            count++;
+            Promise.resolve().then(spin);
+        }
+        spin();
+        setTimeout(() => { report("timeout"); exit(0); }, 10);
+    )", "test", jac::EvalFlags::Global);
+
+    SECTION("Max jobs") {
+        machine.setJobBudget(100);
+        machine.runEventLoop();
+        REQUIRE(machine.jobStats().maxJobsPerDrain == 100);
+    }
+
+    SECTION("Max time") {
+        machine.setJobBudget(0, std::chrono::milliseconds(1));
+        machine.runEventLoop();
+    }
+
+    SECTION("Run once") {
+        machine.setJobBudget(100);
+        while (!machine.hasExited()) {
+            machine.runOnce(std::chrono::milliseconds(100));
+        }
+    }
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "timeout" });
+    REQUIRE(machine.getExitCode() == 0);
+
+    auto stats = machine.jobStats();
+    REQUIRE(stats.jobs > 0);
+    REQUIRE(stats.budgetExceeded > 0);
+    REQUIRE(stats.maxStarvation <= stats.totalDrainTime);
+}
+
+
+TEST_CASE("Loop metrics", "[eventLoop]") {
+    static_assert(!jac::HasLoopMetrics<Machine>);
+    static_assert(jac::HasLoopMetrics<MetricsMachine>);
+
+    MetricsMachine machine;
+    machine.initialize();
+
+    for (int i = 0; i < 5; i++) {
+        machine.scheduleEvent([&machine]() {
+            machine.report("event");
+        });
+    }
+    REQUIRE(machine.loopMetrics().queueDepth == 5);
+
+    evalCode(machine, R"(
+        Promise.resolve().then(() => {}).then(() => {});
+        setTimeout(() => report("timeout"), 20);
+    )", "test", jac::EvalFlags::Global);
+    while (machine.getReports().size() < 6) {
+        machine.runOnce(std::chrono::milliseconds(100));
+    }
+
+    auto& metrics = machine.loopMetrics();
+    REQUIRE(metrics.queueDepth == 0);
+    REQUIRE(metrics.eventsScheduled == 6);
+    REQUIRE(metrics.eventsDispatched == 6);
+    REQUIRE(metrics.dispatchLatency.snapshot().count == 6);
+    REQUIRE(metrics.executionTime.snapshot().count == 6);
+    REQUIRE(metrics.loopLag.snapshot().count == 1);
+    REQUIRE(metrics.jobsPerTurn.snapshot().sum >= 2);
+    REQUIRE(metrics.idleTime > 10000);
+
+    auto json = metrics.toJson();
+    REQUIRE(json.find("\"eventsDispatched\":6") != std::string::npos);
+
+    auto prometheus = metrics.toPrometheus("machine=\"a\"");
+    REQUIRE(prometheus.find("# TYPE jac_event_loop_dispatch_latency_seconds histogram") != std::string::npos);
+    REQUIRE(prometheus.find("jac_event_loop_events_dispatched_total{machine=\"a\"} 6") != std::string::npos);
+    REQUIRE(prometheus.find("jac_event_loop_lag_seconds_count{machine=\"a\"} 1") != std::string::npos);
+}
+
+
+TEST_CASE("Event priority", "[eventLoop]") {
+    Machine machine;
+    machine.initialize();
+
+    auto schedule = [&machine](std::string name, jac::EventPriority priority) {
+        machine.scheduleEvent([&machine, name]() {
+            machine.report(name);
+        }, priority);
+    };
+
+    SECTION("Default weights") {
+        for (int i = 0; i < 3; i++) {
+            schedule("B", jac::EventPriority::Background);
+            schedule("N", jac::EventPriority::Normal);
+            schedule("U", jac::EventPriority::Urgent);
+        }
+        machine.poll();
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "U", "U", "U", "N", "N", "N", "B", "B", "B" });
+    }
+
+    SECTION("Round robin") {
+        machine.setPriorityWeight(jac::EventPriority::Urgent, 2);
+        machine.setPriorityWeight(jac::EventPriority::Normal, 1);
+        for (int i = 0; i < 4; i++) {
+            schedule("B", jac::EventPriority::Background);
+            schedule("N", jac::EventPriority::Normal);
+            schedule("U", jac::EventPriority::Urgent);
+        }
+        machine.poll();
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{
+            "U", "U", "N", "B", "U", "U", "N", "B", "N", "B", "N", "B"
+        });
+    }
+}
+
+TEST_CASE("Urgent latency under load", "[eventLoop]") {
+    MetricsMachine machine;
+    machine.initialize();
+
+    for (int i = 0; i < 100; i++) {
+        machine.scheduleEvent([]() {
+            auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(100);
+            while (std::chrono::steady_clock::now() < until);
+        }, jac::EventPriority::Background);
+    }
+    machine.scheduleEvent([&machine]() {
+        machine.report("urgent");
+    }, jac::EventPriority::Urgent);
+
+    machine.runOnce(std::chrono::milliseconds(0), 200);
+
+    auto urgent = machine.loopMetrics().laneLatency[static_cast<size_t>(jac::EventPriority::Urgent)].snapshot();
+    auto background = machine.loopMetrics().laneLatency[static_cast<size_t>(jac::EventPriority::Background)].snapshot();
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "urgent" });
+    REQUIRE(urgent.count == 1);
+    REQUIRE(background.count == 100);
+    REQUIRE(urgent.sum < background.percentile(0.99));
+}
+
+
+#ifdef __linux__
+TEST_CASE("Event fd", "[eventLoop]") {
+    Machine machine;
+    machine.initialize();
+
+    int fd = machine.eventFd();
+    pollfd pfd{ .fd = fd, .events = POLLIN, .revents = 0 };
+
+    REQUIRE(::poll(&pfd, 1, 0) == 0);
+
+    std::thread producer([&machine]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        machine.scheduleEvent([&machine]() {
+            machine.report("event");
+        });
+    });
+
+    REQUIRE(::poll(&pfd, 1, 1000) == 1);
+    producer.join();
+
+    machine.poll();
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "event" });
+    REQUIRE(::poll(&pfd, 1, 0) == 0);
+}
+#endif
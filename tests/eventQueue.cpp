@@ -0,0 +1,205 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/loopMetricsFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    jac::EventLoopTerminal<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    jac::LoopMetricsFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>>;
+
+
+TEST_CASE("Overflow policy", "[eventQueue]") {
+    Machine machine;
+    machine.initialize();
+
+    auto schedule = [&machine](int i) {
+        return machine.scheduleEvent([&machine, i]() {
+            machine.report(std::to_string(i));
+        });
+    };
+
+    SECTION("Drop newest") {
+        machine.setQueueLimit(3, jac::OverflowPolicy::DropNewest);
+        std::vector<bool> results;
+        for (int i = 0; i < 5; i++) {
+            results.push_back(schedule(i));
+        }
+        machine.poll();
+
+        REQUIRE(results == std::vector<bool>{ true, true, true, false, false });
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "0", "1", "2" });
+        REQUIRE(machine.loopMetrics().eventsDropped == 2);
+    }
+
+    SECTION("Drop oldest") {
+        machine.setQueueLimit(3, jac::OverflowPolicy::DropOldest);
+        for (int i = 0; i < 5; i++) {
+            REQUIRE(schedule(i));
+        }
+        machine.poll();
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "2", "3", "4" });
+        REQUIRE(machine.loopMetrics().eventsDropped == 2);
+    }
+
+    SECTION("Drop oldest of lowest priority") {
+        machine.setQueueLimit(2, jac::OverflowPolicy::DropOldest);
+        machine.scheduleEvent([&machine]() { machine.report("urgent"); }, jac::EventPriority::Urgent);
+        machine.scheduleEvent([&machine]() { machine.report("background"); }, jac::EventPriority::Background);
+        schedule(0);
+        machine.poll();
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "urgent", "0" });
+    }
+
+    SECTION("Reject") {
+        machine.setQueueLimit(3, jac::OverflowPolicy::Reject);
+        for (int i = 0; i < 3; i++) {
+            REQUIRE(schedule(i));
+        }
+        REQUIRE_FALSE(schedule(3));
+        REQUIRE(machine.loopMetrics().eventsRejected == 1);
+
+        machine.poll();
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "0", "1", "2" });
+    }
+
+    SECTION("Block") {
+        constexpr int count = 1000;
+        machine.setQueueLimit(10, jac::OverflowPolicy::Block);
+
+        std::atomic<size_t> maxSize = 0;
+        std::thread producer([&]() {
+            for (int i = 0; i < count; i++) {
+                schedule(i);
+                maxSize = std::max(maxSize.load(), machine.queueSize());
+            }
+        });
+
+        while (machine.getReports().size() < count) {
+            machine.runOnce(std::chrono::milliseconds(100));
+        }
+        producer.join();
+
+        REQUIRE(maxSize <= 10);
+        REQUIRE(machine.getReports().front() == "0");
+        REQUIRE(machine.getReports().back() == std::to_string(count - 1));
+    }
+
+    SECTION("Loop thread is not limited") {
+        machine.setQueueLimit(1, jac::OverflowPolicy::Reject);
+        evalCode(machine, R"(
+            setTimeout(() => report("a"), 0);
+            setTimeout(() => report("b"), 0);
+        )", "test", jac::EvalFlags::Global);
+        machine.scheduleEvent([&machine]() {
+            for (int i = 0; i < 3; i++) {
+                REQUIRE(machine.scheduleEvent([]() {}));
+            }
+        });
+
+        while (machine.getReports().size() < 2) {
+            machine.runOnce(std::chrono::milliseconds(100));
+        }
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "a", "b" });
+    }
+
+    SECTION("Thread is limited after the loop returns") {
+        machine.setQueueLimit(1, jac::OverflowPolicy::Reject);
+        machine.poll();
+
+        REQUIRE(schedule(0));
+        REQUIRE_FALSE(schedule(1));
+    }
+
+    SECTION("Block does not wait for the calling thread") {
+        machine.setQueueLimit(1, jac::OverflowPolicy::Block);
+        REQUIRE(schedule(0));
+        REQUIRE(schedule(1));
+        evalCode(machine, "setImmediate(() => report('immediate'));", "test", jac::EvalFlags::Global);
+        machine.poll();
+        REQUIRE(schedule(2));
+        REQUIRE(schedule(3));
+        machine.poll();
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "0", "1", "immediate", "2", "3" });
+    }
+}
+
+
+TEST_CASE("High-water mark", "[eventQueue]") {
+    Machine machine;
+    machine.initialize();
+
+    std::vector<bool> calls;
+    machine.setHighWaterMark(4, 1, [&calls](bool above) {
+        calls.push_back(above);
+    });
+
+    for (int i = 0; i < 6; i++) {
+        machine.scheduleEvent([]() {});
+    }
+    REQUIRE(calls == std::vector<bool>{ true });
+
+    machine.runOnce(std::chrono::milliseconds(0), 4);
+    REQUIRE(calls == std::vector<bool>{ true });
+
+    machine.runOnce(std::chrono::milliseconds(0), 1);
+    REQUIRE(calls == std::vector<bool>{ true, false });
+}
+
+
+TEST_CASE("Bounded queue stress", "[eventQueue]") {
+    constexpr int count = 200000;
+    constexpr size_t capacity = 1000;
+
+    Machine machine;
+    machine.initialize();
+    machine.setQueueLimit(capacity, jac::OverflowPolicy::DropOldest);
+
+    std::atomic<bool> done = false;
+    size_t maxSize = 0;
+    std::thread producer([&]() {
+        std::vector<char> payload(64);
+        for (int i = 0; i < count; i++) {
+            machine.scheduleEvent([payload]() {});
+            maxSize = std::max(maxSize, machine.queueSize());
+        }
+        done = true;
+    });
+
+    // a slow consumer
+    while (!done) {
+        machine.runOnce(std::chrono::milliseconds(1), 10);
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    producer.join();
+    while (machine.queueSize() > 0) {
+        machine.poll();
+    }
+
+    auto& metrics = machine.loopMetrics();
+    REQUIRE(maxSize <= capacity);
+    REQUIRE(metrics.eventsDropped > 0);
+    REQUIRE(metrics.eventsDispatched + metrics.eventsDropped == count);
+}
@@ -0,0 +1,114 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+#include <jac/machine/class.h>
+#include <jac/machine/ffiStats.h>
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    TestReportFeature<
+    jac::MachineBase
+>;
+
+
+static const jac::FfiStats::Entry* findEntry(const std::vector<jac::FfiStats::Entry>& entries, const std::string& name) {
+    for (auto& entry : entries) {
+        if (entry.name == name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+
+TEST_CASE("FFI stats", "[ffiStats]") {
+    jac::FfiStats::reset();
+
+    Machine machine;
+    machine.initialize();
+    jac::Object global = machine.context().getGlobalObject();
+    jac::FunctionFactory ff(machine.context());
+
+    SECTION("FunctionFactory") {
+        unsigned line = __LINE__ + 1;
+        global.set("add", ff.newFunction([](int a, int b) {
+            return a + b;
+        }));
+        global.set("count", ff.newFunctionVariadic([](std::vector<jac::ValueWeak> args) {
+            return static_cast<int>(args.size());
+        }));
+
+        evalCode(machine, R"(
+            for (let i = 0; i < 10; i++) {
+                report(add(i, 1));
+            }
+            report(count(1, 2, 3));
+        )", "test", jac::EvalFlags::Global);
+        REQUIRE(machine.getReports().size() == 11);
+
+        auto entries = jac::FfiStats::snapshot(jac::FfiStats::SortBy::Calls);
+        auto add = findEntry(entries, "ffiStats.cpp:" + std::to_string(line));
+        auto count = findEntry(entries, "ffiStats.cpp:" + std::to_string(line + 3));
+        REQUIRE(add);
+        REQUIRE(count);
+        REQUIRE(add->calls == 10);
+        REQUIRE(count->calls == 1);
+        REQUIRE(add->latency.count == 10);
+        REQUIRE(add->latency.sum == add->totalTime());
+        REQUIRE(add < count);
+
+        auto report = jac::FfiStats::report();
+        REQUIRE(report.starts_with("function"));
+        REQUIRE(report.find("ffiStats.cpp:" + std::to_string(line)) != std::string::npos);
+
+        jac::FfiStats::reset();
+        REQUIRE(jac::FfiStats::snapshot().empty());
+    }
+
+    SECTION("Method member") {
+        struct Opq {
+            int a = 40;
+
+            int add(int b) {
+                return a + b;
+            }
+        };
+
+        struct ClassBuilder : jac::ProtoBuilder::Opaque<Opq>, jac::ProtoBuilder::Properties {
+            static void addProperties(jac::ContextRef ctx, jac::Value proto) {
+                addMethodMember<decltype(&Opq::add), &Opq::add>(ctx, proto, "ffiStatsAdd");
+            }
+        };
+
+        using TestClass = jac::Class<ClassBuilder>;
+        TestClass::init("TestClass", false);
+
+        global.defineProperty("val", TestClass::createInstance(machine.context(), new Opq()));
+
+        evalCode(machine, "report(val.ffiStatsAdd(2)); report(val.ffiStatsAdd(3));", "test", jac::EvalFlags::Global);
+        REQUIRE(machine.getReports() == std::vector<std::string>{"42", "43"});
+
+        auto entries = jac::FfiStats::snapshot();
+        auto add = findEntry(entries, "ffiStatsAdd");
+        REQUIRE(add);
+        REQUIRE(add->calls == 2);
+    }
+
+    SECTION("Exceptions are not counted") {
+        global.set("fail", ff.newFunction([](int) -> int {
+            throw jac::Exception::create(jac::Exception::Type::Error, "fail");
+        }));
+
+        evalCodeThrows(machine, "fail(1)", "test", jac::EvalFlags::Global);
+        evalCodeThrows(machine, "fail()", "test", jac::EvalFlags::Global);
+
+        REQUIRE(jac::FfiStats::snapshot().empty());
+    }
+}
@@ -0,0 +1,312 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/httpFeature.h>
+#include <jac/features/ioReactorFeature.h>
+#include <jac/features/netFeature.h>
+#include <jac/features/util/http.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+std::vector<jac::HttpRequest> parseAll(jac::HttpRequestParser& parser) {
+    std::vector<jac::HttpRequest> requests;
+    jac::HttpRequest request;
+    while (parser.next(request)) {
+        requests.push_back(std::move(request));
+    }
+    return requests;
+}
+
+
+std::string bodyOf(const jac::HttpRequest& request) {
+    return std::string(request.body.begin(), request.body.end());
+}
+
+
+TEST_CASE("HTTP request parser", "[http]") {
+    jac::HttpRequestParser parser;
+
+    SECTION("Headers") {
+        parser.feed("GET /path?q=1 HTTP/1.1\r\nHost: example\r\nX-Multi:  a \r\nx-multi: b\r\n\r\n");
+        auto requests = parseAll(parser);
+        REQUIRE(requests.size() == 1);
+        REQUIRE(requests[0].method == "GET");
+        REQUIRE(requests[0].target == "/path?q=1");
+        REQUIRE(requests[0].keepAlive);
+        REQUIRE(requests[0].headers.size() == 3);
+        REQUIRE(requests[0].headerName(1) == "X-Multi");
+        REQUIRE(requests[0].headerValue(1) == "a");
+        REQUIRE(requests[0].header("HOST") == "example");
+        REQUIRE(!requests[0].header("missing"));
+    }
+
+    SECTION("Byte by byte with pipelining") {
+        std::string data = "POST /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+                           "POST /b HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3;ext=1\r\nabc\r\nA\r\n0123456789\r\n0\r\nTrailer: x\r\n\r\n"
+                           "GET /c HTTP/1.0\r\n\r\n";
+        std::vector<jac::HttpRequest> requests;
+        for (char c : data) {
+            parser.feed(std::string(1, c));
+            auto parsed = parseAll(parser);
+            requests.insert(requests.end(), parsed.begin(), parsed.end());
+        }
+        REQUIRE(requests.size() == 3);
+        REQUIRE(bodyOf(requests[0]) == "hello");
+        REQUIRE(bodyOf(requests[1]) == "abc0123456789");
+        REQUIRE(requests[2].target == "/c");
+        REQUIRE(!requests[2].keepAlive);
+        REQUIRE(!parser.hasBuffered());
+    }
+
+    SECTION("Connection") {
+        parser.feed("GET / HTTP/1.1\r\nConnection: Close\r\n\r\nGET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+        auto requests = parseAll(parser);
+        REQUIRE(requests.size() == 2);
+        REQUIRE(!requests[0].keepAlive);
+        REQUIRE(requests[1].keepAlive);
+    }
+
+    auto requireError = [&](std::string data, int status) {
+        parser.feed(data);
+        jac::HttpRequest request;
+        try {
+            parser.next(request);
+            FAIL("Expected an error");
+        }
+        catch (jac::HttpError& e) {
+            REQUIRE(e.status() == status);
+        }
+    };
+
+    SECTION("Malformed request line") {
+        requireError("GET\r\n\r\n", 400);
+    }
+
+    SECTION("Unsupported version") {
+        requireError("GET / HTTP/2.0\r\n\r\n", 505);
+    }
+
+    SECTION("Malformed header") {
+        requireError("GET / HTTP/1.1\r\nNo colon\r\n\r\n", 400);
+    }
+
+    SECTION("Line folding") {
+        requireError("GET / HTTP/1.1\r\nA: b\r\n c\r\n\r\n", 400);
+    }
+
+    SECTION("Both framings") {
+        requireError("POST / HTTP/1.1\r\nContent-Length: 1\r\nTransfer-Encoding: chunked\r\n\r\n", 400);
+    }
+
+    SECTION("Conflicting lengths") {
+        requireError("POST / HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 50\r\n\r\nhello", 400);
+    }
+
+    SECTION("Repeated equal lengths") {
+        parser.feed("POST / HTTP/1.1\r\nContent-Length: 2\r\ncontent-length: 2\r\n\r\nhi");
+        auto requests = parseAll(parser);
+        REQUIRE(requests.size() == 1);
+        REQUIRE(bodyOf(requests[0]) == "hi");
+    }
+
+    SECTION("Repeated transfer coding") {
+        requireError("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n", 400);
+        jac::HttpRequestParser other;
+        other.feed("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nX-A: b\r\ntransfer-encoding: identity\r\n\r\n0\r\n\r\n");
+        jac::HttpRequest request;
+        try {
+            other.next(request);
+            FAIL("Expected an error");
+        }
+        catch (jac::HttpError& e) {
+            REQUIRE(e.status() == 400);
+        }
+    }
+
+    SECTION("Invalid length") {
+        requireError("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n", 400);
+    }
+
+    SECTION("Limits") {
+        jac::HttpRequestParser limited({ 64, 4 });
+        limited.feed("POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\n");
+        jac::HttpRequest request;
+        REQUIRE_THROWS_AS(limited.next(request), jac::HttpError);
+
+        jac::HttpRequestParser limitedHead({ 64, 4 });
+        limitedHead.feed("GET / HTTP/1.1\r\nA: " + std::string(100, 'a'));
+        REQUIRE_THROWS_AS(limitedHead.next(request), jac::HttpError);
+    }
+}
+
+
+TEST_CASE("HTTP response head", "[http]") {
+    jac::HttpResponse response;
+    response.status = 404;
+    response.headers.emplace_back("Content-Type", "text/plain");
+    response.bodyString = "missing";
+
+    std::string head;
+    response.serializeHead(head, false);
+    REQUIRE(head == "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 7\r\nConnection: close\r\n\r\n");
+
+    response.headers.emplace_back("X-Injected", "a\r\nb");
+    REQUIRE_THROWS(response.serializeHead(head, true));
+}
+
+
+// sends the requests from a separate thread and collects the whole response stream
+std::string exchange(int port, std::string requests, std::chrono::milliseconds readDelay = std::chrono::milliseconds(0)) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return "connect failed";
+    }
+    send(fd, requests.data(), requests.size(), 0);
+    // lets the response fill the send buffer of the server
+    std::this_thread::sleep_for(readDelay);
+
+    std::string response;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        response.append(buffer, static_cast<size_t>(count));
+    }
+    close(fd);
+    return response;
+}
+
+
+TEST_CASE("HTTP connection", "[http]") {
+    jac::EpollReactor reactor;
+    auto registry = std::make_shared<jac::SocketRegistry>(reactor);
+
+    std::string body(16 * 1024 * 1024, 'x');
+    for (size_t i = 0; i < body.size(); i += 4096) {
+        body[i] = static_cast<char>('a' + i % 26);
+    }
+    auto server = jac::SocketServer::listen(registry, jac::SocketAddress::tcp("127.0.0.1", 0), [&](std::shared_ptr<jac::Socket> socket) {
+        // the connection is owned only by the pending operations of the socket
+        auto connection = std::make_shared<jac::HttpConnection>(std::move(socket), [&body](jac::HttpRequest, jac::HttpResponder responder) {
+            jac::HttpResponse response;
+            response.bodyString = body;
+            responder.send(std::move(response));
+        });
+        connection->start();
+    });
+
+    SECTION("Connection: close with a response larger than the send buffer") {
+        std::atomic<bool> done = false;
+        std::string response;
+        std::thread client([&]() {
+            response = exchange(server->port(), "GET / HTTP/1.1\r\nConnection: close\r\n\r\n", std::chrono::milliseconds(100));
+            done = true;
+        });
+        while (!done) {
+            if (auto io = reactor.wait(10)) {
+                (*io)();
+            }
+        }
+        client.join();
+
+        size_t headEnd = response.find("\r\n\r\n");
+        REQUIRE(headEnd != std::string::npos);
+        REQUIRE(response.substr(0, headEnd).find("Connection: close") != std::string::npos);
+        REQUIRE(response.size() - headEnd - 4 == body.size());
+        REQUIRE(response.compare(headEnd + 4, std::string::npos, body) == 0);
+    }
+
+    registry->detachAll();
+}
+
+
+TEST_CASE("HTTP module", "[http]") {
+    using Machine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::IoReactorFeature,
+        jac::EventLoopFeature,
+        jac::BasicStreamFeature,
+        jac::NetFeature,
+        jac::HttpFeature,
+        jac::EventLoopTerminal
+    >;
+
+    Machine machine;
+    machine.initialize();
+
+    std::string response;
+    std::thread client;
+    jac::FunctionFactory ff(machine.context());
+    machine.context().getGlobalObject().set("startClient", ff.newFunction([&](int port, std::string requests) {
+        client = std::thread([&machine, &response, port, requests]() {
+            response = exchange(port, requests);
+            machine.scheduleEvent([&machine]() { machine.exit(0); });
+        });
+    }));
+
+    evalModuleWithEventLoop(machine, R"(
+        import { serve } from "http";
+
+        let server = serve({ port: 0 }, async (request) => {
+            if (request.url === "/slow") {
+                await new Promise((resolve) => resolve());
+                return "slow";
+            }
+            if (request.url === "/json") {
+                return {
+                    status: 201,
+                    headers: { "Content-Type": "application/json" },
+                    body: JSON.stringify({ agent: request.headers["user-agent"], body: request.body })
+                };
+            }
+            if (request.url === "/binary") {
+                return { body: new Uint8Array([65, 66, 67]) };
+            }
+            if (request.url === "/throw") {
+                throw new Error("failure");
+            }
+            report(request.method + " " + request.url + " " + request.header("x-id"));
+            server.close();
+            return "bye";
+        });
+
+        startClient(server.port,
+            "GET /slow HTTP/1.1\r\n\r\n" +
+            "POST /json HTTP/1.1\r\nUser-Agent: test\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nhi\r\n0\r\n\r\n" +
+            "GET /binary HTTP/1.1\r\n\r\n" +
+            "GET /throw HTTP/1.1\r\n\r\n" +
+            "GET /last HTTP/1.1\r\nX-Id: 7\r\nConnection: close\r\n\r\n");
+    )", "test");
+
+    client.join();
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "GET /last 7" });
+    REQUIRE(response ==
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: 4\r\n\r\nslow"
+        "HTTP/1.1 201 Created\r\nContent-Type: application/json\r\nContent-Length: 28\r\n\r\n{\"agent\":\"test\",\"body\":\"hi\"}"
+        "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nABC"
+        "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n"
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: 3\r\nConnection: close\r\n\r\nbye");
+}
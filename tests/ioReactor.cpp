@@ -0,0 +1,287 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/ioReactorFeature.h>
+#include <jac/features/stdioFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/features/util/fdReadable.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+class StringWritable : public jac::Writable {
+public:
+    std::vector<std::string> writes;
+
+    void write(std::string data) override {
+        writes.push_back(std::move(data));
+    }
+};
+
+
+void writeAll(int fd, std::string data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t count = ::write(fd, data.data() + written, data.size() - written);
+        REQUIRE(count > 0);
+        written += static_cast<size_t>(count);
+    }
+}
+
+
+TEST_CASE("Epoll reactor", "[ioReactor]") {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    jac::EpollReactor reactor;
+    std::vector<std::string> calls;
+    auto dispatch = [&]() {
+        auto io = reactor.wait(1000);
+        REQUIRE(io);
+        (*io)();
+    };
+
+    SECTION("Readable and writable watchers") {
+        reactor.watchReadable(fds[0], [&]() { calls.push_back("readable"); });
+        reactor.watchWritable(fds[1], [&]() { calls.push_back("writable"); });
+        dispatch();
+        REQUIRE(calls == std::vector<std::string>{ "writable" });
+
+        reactor.unwatchWritable(fds[1]);
+        REQUIRE(!reactor.wait(0));
+
+        writeAll(fds[1], "x");
+        dispatch();
+        REQUIRE(calls == std::vector<std::string>{ "writable", "readable" });
+
+        reactor.unwatch(fds[0]);
+        REQUIRE(reactor.empty());
+        REQUIRE(!reactor.wait(0));
+    }
+
+    SECTION("Hang-up is reported to the readable watcher") {
+        reactor.watchReadable(fds[0], [&]() {
+            char c;
+            calls.push_back(::read(fds[0], &c, 1) == 0 ? "eof" : "data");
+            reactor.unwatchReadable(fds[0]);
+        });
+        close(fds[1]);
+        fds[1] = -1;
+        dispatch();
+        REQUIRE(calls == std::vector<std::string>{ "eof" });
+        REQUIRE(reactor.empty());
+    }
+
+    SECTION("Wake up descriptor does not call watchers") {
+        int wakeFds[2];
+        REQUIRE(::pipe(wakeFds) == 0);
+        reactor.setWakeFd(wakeFds[0]);
+        reactor.watchReadable(fds[0], [&]() { calls.push_back("readable"); });
+        writeAll(wakeFds[1], "x");
+        REQUIRE(!reactor.wait(1000));
+        REQUIRE(calls.empty());
+        close(wakeFds[0]);
+        close(wakeFds[1]);
+    }
+
+    SECTION("Invalid descriptor") {
+        REQUIRE_THROWS(reactor.watchReadable(-1, []() {}));
+        REQUIRE(reactor.empty());
+    }
+
+    reactor.unwatch(fds[0]);
+    reactor.unwatch(fds[1]);
+    close(fds[0]);
+    if (fds[1] >= 0) {
+        close(fds[1]);
+    }
+}
+
+
+TEST_CASE("Fd readable", "[ioReactor]") {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    jac::EpollReactor reactor;
+    std::vector<std::string> chunks;
+    auto collect = [&](std::optional<std::string> data) {
+        chunks.push_back(data ? *data : "<end>");
+    };
+
+    SECTION("Ready data are read synchronously") {
+        jac::FdReadable readable(reactor, fds[0]);
+        writeAll(fds[1], "abc");
+        REQUIRE(readable.read(collect));
+        REQUIRE(chunks == std::vector<std::string>{ "abc" });
+        REQUIRE(reactor.empty());
+    }
+
+    SECTION("Descriptor flags are not changed") {
+        int flags = fcntl(fds[0], F_GETFL);
+        jac::FdReadable readable(reactor, fds[0]);
+        REQUIRE(readable.read(collect));
+        REQUIRE(fcntl(fds[0], F_GETFL) == flags);
+        REQUIRE((flags & O_NONBLOCK) == 0);
+        REQUIRE(chunks.empty());
+    }
+
+    SECTION("Pending read waits for the reactor") {
+        jac::FdReadable readable(reactor, fds[0]);
+        REQUIRE(readable.read(collect));
+        REQUIRE(readable.read(collect));
+        REQUIRE(chunks.empty());
+        REQUIRE(!reactor.empty());
+        REQUIRE(!reactor.wait(0));
+
+        writeAll(fds[1], "abc");
+        auto io = reactor.wait(1000);
+        REQUIRE(io);
+        (*io)();
+        REQUIRE(chunks == std::vector<std::string>{ "abc" });
+
+        close(fds[1]);
+        fds[1] = -1;
+        io = reactor.wait(1000);
+        REQUIRE(io);
+        (*io)();
+        REQUIRE(chunks == std::vector<std::string>{ "abc", "<end>" });
+        REQUIRE(reactor.empty());
+        REQUIRE(!readable.read(collect));
+    }
+
+    close(fds[0]);
+    if (fds[1] >= 0) {
+        close(fds[1]);
+    }
+}
+
+
+TEST_CASE("Reading stdin through the I/O reactor", "[ioReactor]") {
+    using Machine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::IoReactorFeature,
+        jac::EventLoopFeature,
+        jac::TimersFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::EventLoopTerminal
+    >;
+
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    Machine machine;
+    machine.stdio.out = std::make_unique<StringWritable>();
+    machine.stdio.err = std::make_unique<StringWritable>();
+    machine.stdio.in = std::make_unique<jac::FdReadable>(machine.ioReactor(), fds[0]);
+    machine.initialize();
+
+    std::thread writer([fd = fds[1]]() {
+        for (auto line : { "one\n", "two\nthr", "ee\n" }) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            writeAll(fd, line);
+        }
+        close(fd);
+    });
+
+    SECTION("Lines") {
+        evalModuleWithEventLoop(machine, R"(
+            import { stdin } from "stdio";
+            (async () => {
+                let line;
+                while ((line = await stdin.readLine()) !== null) {
+                    report(line);
+                }
+                exit(0);
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "one", "two", "three" });
+    }
+
+    SECTION("Timers keep running while waiting for input") {
+        evalModuleWithEventLoop(machine, R"(
+            import { stdin } from "stdio";
+            let ticks = 0;
+            let timer = setInterval(() => ticks++, 1);
+            (async () => {
+                let data = "";
+                for await (const chunk of stdin) {
+                    data += chunk;
+                }
+                clearInterval(timer);
+                report(data);
+                report(String(ticks > 0));
+                exit(0);
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "one\ntwo\nthree\n", "true" });
+    }
+
+    writer.join();
+    close(fds[0]);
+}
+
+
+TEST_CASE("Native watchers on the event loop", "[ioReactor]") {
+    using Machine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::IoReactorFeature,
+        jac::EventLoopFeature,
+        jac::TimersFeature,
+        jac::EventLoopTerminal
+    >;
+
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    Machine machine;
+    machine.initialize();
+
+    // the watcher is registered on the loop thread, the data and the exit come from other threads
+    std::string received;
+    machine.scheduleEvent([&]() {
+        machine.ioReactor().watchReadable(fds[0], [&]() {
+            char buffer[16];
+            ssize_t count = ::read(fds[0], buffer, sizeof(buffer));
+            if (count <= 0) {
+                machine.ioReactor().unwatch(fds[0]);
+                machine.exit(0);
+                return;
+            }
+            received.append(buffer, static_cast<size_t>(count));
+        });
+    });
+
+    std::thread writer([fd = fds[1]]() {
+        writeAll(fd, "hello ");
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        writeAll(fd, "world");
+        close(fd);
+    });
+
+    machine.runEventLoop();
+    writer.join();
+    close(fds[0]);
+
+    REQUIRE(received == "hello world");
+}
@@ -0,0 +1,380 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/memoryUsageFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/machine/heapSnapshot.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    jac::EventLoopTerminal<
+    jac::MemoryUsageFeature<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>>;
+
+
+TEST_CASE("Memory stats", "[memoryUsage]") {
+    Machine machine;
+    machine.initialize();
+
+    auto before = machine.memoryStats();
+    REQUIRE(before.mallocSize > 0);
+    REQUIRE(before.objectCount > 0);
+
+    evalCode(machine, R"(
+        globalThis.items = [];
+        for (let i = 0; i < 1000; i++) {
+            items.push({ value: "item" + i });
+        }
+    )", "test", jac::EvalFlags::Global);
+
+    auto after = machine.memoryStats();
+    REQUIRE(after.objectCount >= before.objectCount + 1000);
+    REQUIRE(after.stringCount >= before.stringCount + 1000);
+    REQUIRE(after.mallocSize > before.mallocSize);
+    REQUIRE(after.toJson().starts_with("{\"mallocSize\":"));
+
+    evalCode(machine, "globalThis.items = undefined;", "test", jac::EvalFlags::Global);
+    machine.runGC();
+    REQUIRE(machine.memoryStats().objectCount < after.objectCount);
+}
+
+
+TEST_CASE("process.memoryUsage", "[memoryUsage]") {
+    Machine machine;
+    machine.initialize();
+
+    evalCode(machine, R"(
+        let usage = process.memoryUsage();
+        report(String(usage.heapUsed > 0));
+        report(String(usage.heapTotal >= usage.heapUsed));
+        new ArrayBuffer(100000);
+        report(String(process.memoryUsage().arrayBuffers >= 100000));
+    )", "test", jac::EvalFlags::Global);
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "true", "true", "true" });
+}
+
+
+TEST_CASE("Heap snapshot", "[memoryUsage]") {
+    Machine machine;
+    machine.initialize();
+
+    evalCode(machine, R"(
+        class Leaky {
+            constructor(i) {
+                this.payload = "payload-" + i;
+            }
+        }
+        globalThis.leaks = [];
+        for (let i = 0; i < 100; i++) {
+            leaks.push(new Leaky(i));
+        }
+    )", "test", jac::EvalFlags::Global);
+
+    auto snapshot = jac::HeapSnapshot::take(machine.context());
+    auto& nodes = snapshot.nodes();
+    REQUIRE(nodes.size() > 200);
+    REQUIRE(nodes[0].type == jac::HeapSnapshot::NodeType::Synthetic);
+
+    size_t leaky = 0;
+    for (auto& node : nodes) {
+        if (node.type == jac::HeapSnapshot::NodeType::ObjectNode && node.name == "Leaky") {
+            leaky++;
+        }
+    }
+    REQUIRE(leaky == 100);
+
+    auto& global = nodes[nodes[0].edges[0].to];
+    auto leaks = std::find_if(global.edges.begin(), global.edges.end(), [](auto& edge) {
+        return edge.name == "leaks";
+    });
+    REQUIRE(leaks != global.edges.end());
+    REQUIRE(nodes[leaks->to].type == jac::HeapSnapshot::NodeType::ArrayNode);
+    REQUIRE(std::count_if(nodes[leaks->to].edges.begin(), nodes[leaks->to].edges.end(), [](auto& edge) {
+        return edge.type == jac::HeapSnapshot::EdgeType::Element;
+    }) == 100);
+
+    auto json = snapshot.toJson();
+    REQUIRE(json.starts_with("{\"snapshot\":{\"meta\":"));
+    REQUIRE(json.find("\"node_count\":" + std::to_string(nodes.size())) != std::string::npos);
+}
+
+
+TEST_CASE("Heap snapshot does not run code", "[memoryUsage]") {
+    Machine machine;
+    machine.initialize();
+
+    evalCode(machine, R"(
+        globalThis.proxied = new Proxy({ inner: {} }, {
+            ownKeys(target) { report("ownKeys"); return Reflect.ownKeys(target); },
+            getOwnPropertyDescriptor(target, key) {
+                report("getOwnPropertyDescriptor");
+                return Reflect.getOwnPropertyDescriptor(target, key);
+            },
+            getPrototypeOf(target) { report("getPrototypeOf"); return null; }
+        });
+        globalThis.accessor = { get value() { report("get"); return 1; } };
+        globalThis.text = "x" + "\u00e9".repeat(200);
+    )", "test", jac::EvalFlags::Global);
+
+    auto snapshot = jac::HeapSnapshot::take(machine.context());
+    REQUIRE(machine.getReports().empty());
+
+    auto& nodes = snapshot.nodes();
+    auto& global = nodes[nodes[0].edges[0].to];
+    auto edge = [&](std::string name) -> const jac::HeapSnapshot::Node& {
+        auto it = std::find_if(global.edges.begin(), global.edges.end(), [&](auto& e) {
+            return e.name == name;
+        });
+        REQUIRE(it != global.edges.end());
+        return nodes[it->to];
+    };
+
+    auto& proxied = edge("proxied");
+    REQUIRE(proxied.name == "Proxy");
+    REQUIRE(proxied.edges.empty());
+
+    auto& text = edge("text");
+    REQUIRE(text.type == jac::HeapSnapshot::NodeType::String);
+    REQUIRE(text.name.size() == jac::HeapSnapshot::maxStringName - 1);
+    REQUIRE(text.name.ends_with("\u00e9"));
+}
+
+
+TEST_CASE("Heap snapshot from JavaScript", "[memoryUsage]") {
+    Machine machine;
+    machine.initialize();
+
+    evalCode(machine, R"(
+        class Hidden {}
+        let hidden = new Hidden();
+
+        let snapshot = JSON.parse(process.heapSnapshot());
+        report(String(snapshot.snapshot.node_count == snapshot.nodes.length / 6));
+        report(String(snapshot.strings.includes("Hidden")));
+
+        let withRoots = JSON.parse(process.heapSnapshot({ hidden }));
+        report(String(withRoots.strings.includes("Hidden")));
+    )", "test", jac::EvalFlags::Global);
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "true", "false", "true" });
+}
+
+
+TEST_CASE("Memory sampler", "[memoryUsage]") {
+    Machine machine;
+    machine.initialize();
+
+    std::vector<jac::MemoryStats> samples;
+    machine.setMemorySampler(std::chrono::milliseconds(5), [&samples](const jac::MemoryStats& stats) {
+        samples.push_back(stats);
+    });
+
+    evalModuleWithEventLoop(machine, "setTimeout(() => exit(0), 40);", "test.js");
+
+    REQUIRE(samples.size() >= 3);
+    REQUIRE(samples.size() <= 10);
+    REQUIRE(samples.front().mallocSize > 0);
+
+    machine.setMemorySampler(std::chrono::milliseconds(0), nullptr);
+    REQUIRE_FALSE(machine.nextDeadline());
+}
+
+
+TEST_CASE("Memory sampler set from another thread", "[memoryUsage]") {
+    Machine machine;
+    machine.initialize();
+
+    auto start = std::chrono::steady_clock::now();
+    std::optional<std::chrono::steady_clock::duration> firstSample;
+    std::thread setter([&machine, &firstSample, start]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        machine.setMemorySampler(std::chrono::milliseconds(1000), [&firstSample, start](const jac::MemoryStats&) {
+            if (!firstSample) {
+                firstSample = std::chrono::steady_clock::now() - start;
+            }
+        });
+    });
+
+    // the waiting event loop is woken up to take the first sample
+    evalModuleWithEventLoop(machine, "setTimeout(() => exit(0), 300);", "test.js");
+    setter.join();
+
+    REQUIRE(firstSample);
+    REQUIRE(*firstSample < std::chrono::milliseconds(200));
+}
+
+
+TEST_CASE("Out of memory", "[memoryUsage]") {
+    Machine machine;
+    machine.setMemoryLimit(16 * 1024 * 1024);
+
+    int handlerCalls = 0;
+    jac::OutOfMemoryAction action = jac::OutOfMemoryAction::Kill;
+    machine.setOutOfMemoryHandler([&]() {
+        handlerCalls++;
+        return action;
+    });
+
+    SECTION("Kill") {
+        machine.initialize();
+        REQUIRE_NOTHROW(machine.evalModuleWithEventLoop(R"(
+            function bomb() {
+                let items = [];
+                while (true) {
+                    items.push(new Array(100000).fill(1));
+                }
+            }
+            bomb();
+        )", "bomb.js"));
+
+        REQUIRE(handlerCalls >= 1);
+        REQUIRE(machine.outOfMemoryCount() >= 1);
+        REQUIRE(machine.getExitCode() == Machine::outOfMemoryExitCode);
+    }
+
+    SECTION("Kill when the error is caught") {
+        machine.initialize();
+        REQUIRE_NOTHROW(machine.evalModuleWithEventLoop(R"(
+            function bomb() {
+                let items = [];
+                try {
+                    while (true) {
+                        items.push(new Array(100000).fill(1));
+                    }
+                }
+                catch (e) {}
+            }
+            while (true) {
+                bomb();
+            }
+        )", "bomb.js"));
+
+        REQUIRE(handlerCalls >= 1);
+        REQUIRE(machine.getExitCode() == Machine::outOfMemoryExitCode);
+    }
+
+    SECTION("Code which ignores the error is interrupted") {
+        action = jac::OutOfMemoryAction::Ignore;
+        machine.initialize();
+        REQUIRE_THROWS(machine.evalModuleWithEventLoop(R"(
+            while (true) {
+                let items = [];
+                try {
+                    while (true) {
+                        items.push(new Array(100000).fill(1));
+                    }
+                }
+                catch (e) {}
+            }
+        )", "bomb.js"));
+
+        REQUIRE(handlerCalls >= 1);
+    }
+
+    SECTION("Collect garbage") {
+        action = jac::OutOfMemoryAction::CollectGarbage;
+        machine.initialize();
+        evalModuleWithEventLoop(machine, R"(
+            function bomb() {
+                let items = [];
+                try {
+                    while (true) {
+                        items.push(new Array(100000).fill(1));
+                    }
+                }
+                catch (e) {
+                    report(e.message);
+                }
+            }
+            bomb();
+            setTimeout(() => {
+                report(String(new Array(1000).fill(1).length));
+                exit(0);
+            }, 1);
+        )", "bomb.js");
+
+        REQUIRE(handlerCalls >= 1);
+        REQUIRE(machine.getExitCode() == 0);
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "out of memory", "1000" });
+    }
+}
+
+
+TEST_CASE("Out of memory in another machine", "[memoryUsage]") {
+    Machine healthy;
+    healthy.initialize();
+
+    std::thread thread([&healthy]() {
+        evalModuleWithEventLoop(healthy, R"(
+            let ticks = 0;
+            let id = setInterval(() => {
+                report(String(++ticks));
+                if (ticks == 20) {
+                    clearInterval(id);
+                    exit(0);
+                }
+            }, 1);
+        )", "healthy.js");
+    });
+
+    Machine bomb;
+    bomb.setMemoryLimit(16 * 1024 * 1024);
+    bomb.setOutOfMemoryHandler([]() {
+        return jac::OutOfMemoryAction::Kill;
+    });
+    bomb.initialize();
+    REQUIRE_NOTHROW(bomb.evalModuleWithEventLoop(R"(
+        let strings = [];
+        function grow() {
+            strings.push("x".repeat(100000) + strings.length);
+            setTimeout(grow, 0);
+        }
+        grow();
+    )", "bomb.js"));
+
+    thread.join();
+
+    REQUIRE(bomb.getExitCode() == Machine::outOfMemoryExitCode);
+    REQUIRE(healthy.getExitCode() == 0);
+    REQUIRE(healthy.getReports().size() == 20);
+}
+
+
+TEST_CASE("Stack size", "[memoryUsage]") {
+    Machine machine;
+    machine.setMaxStackSize(256 * 1024);
+    machine.initialize();
+
+    evalModuleWithEventLoop(machine, R"(
+        function recurse(n) {
+            return recurse(n + 1) + 1;
+        }
+        try {
+            recurse(0);
+        }
+        catch (e) {
+            report("overflow");
+        }
+        exit(0);
+    )", "stack.js");
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "overflow" });
+}
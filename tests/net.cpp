@@ -0,0 +1,298 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/ioReactorFeature.h>
+#include <jac/features/netFeature.h>
+#include <jac/features/stdioFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/features/util/socket.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+class StringWritable : public jac::Writable {
+public:
+    std::vector<std::string> writes;
+
+    void write(std::string data) override {
+        writes.push_back(std::move(data));
+    }
+};
+
+
+TEST_CASE("Native sockets", "[net]") {
+    jac::EpollReactor reactor;
+    auto registry = std::make_shared<jac::SocketRegistry>(reactor);
+    auto step = [&]() {
+        auto io = reactor.wait(1000);
+        REQUIRE(io);
+        (*io)();
+    };
+
+    std::vector<std::shared_ptr<jac::Socket>> accepted;
+    auto server = jac::SocketServer::listen(registry, jac::SocketAddress::tcp("127.0.0.1", 0), [&](std::shared_ptr<jac::Socket> socket) {
+        accepted.push_back(socket);
+        jac::pipeStreams(*socket, *socket, [socket](size_t, std::exception_ptr) {
+            socket->end();
+        });
+    });
+    REQUIRE(server->port() > 0);
+
+    std::shared_ptr<jac::Socket> client;
+    jac::Socket::connect(registry, jac::SocketAddress::tcp("localhost", server->port()), [&](std::shared_ptr<jac::Socket> socket, std::string error) {
+        CAPTURE(error);
+        REQUIRE(socket);
+        client = socket;
+    });
+    while (!client) {
+        step();
+    }
+
+    SECTION("Echo with backpressure") {
+        std::string data(8 * 1024 * 1024, 'x');
+        for (size_t i = 0; i < data.size(); i += 4096) {
+            data[i] = static_cast<char>('a' + i % 26);
+        }
+        client->write(data);
+        // the socket does not accept all data at once, the rest is buffered
+        REQUIRE(client->needsDrain());
+        client->end();
+        REQUIRE_THROWS(client->write(std::string("late")));
+
+        std::string received;
+        bool ended = false;
+        std::function<void()> readNext = [&]() {
+            client->readBytes([&](std::optional<std::vector<uint8_t>> chunk) {
+                if (!chunk) {
+                    ended = true;
+                    return;
+                }
+                received.append(chunk->begin(), chunk->end());
+                readNext();
+            });
+        };
+        readNext();
+        while (!ended) {
+            step();
+        }
+        REQUIRE(received == data);
+        REQUIRE(client->writableLength() == 0);
+        REQUIRE(!client->read([](std::optional<std::string>) {}));
+    }
+
+    SECTION("Close ends pending reads") {
+        std::vector<std::optional<std::string>> chunks;
+        client->read([&](std::optional<std::string> chunk) { chunks.push_back(chunk); });
+        client->read([&](std::optional<std::string> chunk) { chunks.push_back(chunk); });
+        client->close();
+        REQUIRE(chunks == std::vector<std::optional<std::string>>{ std::nullopt, std::nullopt });
+        REQUIRE(!client->isOpen());
+    }
+
+    SECTION("Connection refused") {
+        server->close();
+        bool failed = false;
+        jac::Socket::connect(registry, jac::SocketAddress::tcp("127.0.0.1", server->port()), [&](std::shared_ptr<jac::Socket> socket, std::string error) {
+            REQUIRE(!socket);
+            REQUIRE(!error.empty());
+            failed = true;
+        });
+        while (!failed) {
+            step();
+        }
+    }
+
+    SECTION("Out of descriptors") {
+        std::vector<int> errors;
+        server->onError([&](const std::system_error& e) {
+            errors.push_back(e.code().value());
+        });
+
+        int peer = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        REQUIRE(peer >= 0);
+        rlimit original;
+        REQUIRE(getrlimit(RLIMIT_NOFILE, &original) == 0);
+        rlimit limited = original;
+        limited.rlim_cur = std::min<rlim_t>(original.rlim_cur, 1024);
+        REQUIRE(setrlimit(RLIMIT_NOFILE, &limited) == 0);
+        std::vector<int> filler;
+        int fd;
+        while ((fd = ::dup(peer)) >= 0) {
+            filler.push_back(fd);
+        }
+
+        auto address = jac::SocketAddress::tcp("127.0.0.1", server->port());
+        REQUIRE(::connect(peer, address.get(), address.length) == 0);
+        step();
+
+        // the connection is dropped and the listener does not stay readable
+        REQUIRE(errors == std::vector<int>{ EMFILE });
+        REQUIRE(accepted.size() == 1);
+        REQUIRE(!reactor.wait(0));
+        char c;
+        REQUIRE(::recv(peer, &c, 1, MSG_DONTWAIT) == 0);
+
+        for (int fd_ : filler) {
+            ::close(fd_);
+        }
+        REQUIRE(setrlimit(RLIMIT_NOFILE, &original) == 0);
+        ::close(peer);
+    }
+
+    registry->detachAll();
+    REQUIRE(reactor.empty());
+}
+
+
+TEST_CASE("Socket addresses", "[net]") {
+    REQUIRE(jac::SocketAddress::tcp("127.0.0.1", 80).family() == AF_INET);
+    REQUIRE(jac::SocketAddress::tcp("::1", 80).family() == AF_INET6);
+    REQUIRE(jac::SocketAddress::local("/tmp/socket").family() == AF_UNIX);
+    REQUIRE_THROWS(jac::SocketAddress::tcp("example.com", 80));
+    REQUIRE_THROWS(jac::SocketAddress::tcp("127.0.0.1", 65536));
+    REQUIRE_THROWS(jac::SocketAddress::local(std::string(200, 'x')));
+}
+
+
+TEST_CASE("Net module", "[net]") {
+    using Machine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::IoReactorFeature,
+        jac::EventLoopFeature,
+        jac::TimersFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::NetFeature,
+        jac::EventLoopTerminal
+    >;
+
+    Machine machine;
+    machine.stdio.out = std::make_unique<StringWritable>();
+    machine.stdio.err = std::make_unique<StringWritable>();
+    machine.initialize();
+
+    SECTION("TCP echo") {
+        evalModuleWithEventLoop(machine, R"(
+            import { connect, listen } from "net";
+
+            const server = listen({ port: 0 }, async (socket) => {
+                await socket.readable.pipe(socket.writable);
+                socket.end();
+            });
+
+            (async () => {
+                const socket = await connect({ host: "127.0.0.1", port: server.port });
+                socket.writable.write("hello ");
+                socket.writable.write(new Uint8Array([119, 111, 114, 108, 100]));
+                socket.end();
+
+                let data = "";
+                for await (const chunk of socket.readable) {
+                    data += chunk;
+                }
+                report(data);
+                server.close();
+                exit(0);
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "hello world" });
+    }
+
+    SECTION("Unix domain socket with binary chunks") {
+        std::string path = "/tmp/jac-net-test-" + std::to_string(getpid()) + ".sock";
+        machine.context().getGlobalObject().set("socketPath", path);
+
+        evalModuleWithEventLoop(machine, R"(
+            import { connect, listen } from "net";
+
+            const server = listen({ path: socketPath }, (socket) => {
+                socket.writable.write(new Uint8Array([1, 2, 3]));
+                socket.end();
+            });
+
+            (async () => {
+                const socket = await connect({ path: socketPath });
+                let bytes = [];
+                let chunk;
+                while ((chunk = await socket.readable.readBytes()) !== null) {
+                    bytes.push(...new Uint8Array(chunk));
+                }
+                report(bytes.join(","));
+                socket.close();
+                server.close();
+                exit(0);
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "1,2,3" });
+        REQUIRE(access(path.c_str(), F_OK) != 0);
+    }
+
+    SECTION("Connection refused") {
+        evalModuleWithEventLoop(machine, R"(
+            import { connect, listen } from "net";
+
+            const server = listen({ port: 0 }, () => {});
+            const port = server.port;
+            server.close();
+
+            connect({ port }).then(() => report("connected"), (e) => report("refused"))
+                .then(() => exit(0));
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "refused" });
+    }
+
+    SECTION("Backpressure") {
+        evalModuleWithEventLoop(machine, R"(
+            import { connect, listen } from "net";
+
+            let received = 0;
+            const server = listen({ port: 0 }, async (socket) => {
+                // read slowly, so that the writer has to wait for the drain
+                for await (const chunk of socket.readable) {
+                    received += chunk.length;
+                    await new Promise((resolve) => setTimeout(resolve, 1));
+                }
+                report(String(received));
+                server.close();
+                exit(0);
+            });
+
+            (async () => {
+                const socket = await connect({ port: server.port });
+                const chunk = "x".repeat(64 * 1024);
+                let waited = false;
+                for (let i = 0; i < 256; i++) {
+                    if (!socket.writable.write(chunk)) {
+                        waited = true;
+                        await socket.writable.drain();
+                    }
+                }
+                report(String(waited));
+                socket.end();
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "true", std::to_string(256 * 64 * 1024) });
+    }
+}
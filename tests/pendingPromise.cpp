@@ -0,0 +1,139 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/pendingPromiseFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    jac::EventLoopTerminal<
+    jac::PendingPromiseFeature<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>>;
+
+
+TEST_CASE("Resolve from thread", "[pendingPromise]") {
+    Machine machine;
+    machine.initialize();
+
+    auto [promise, pending] = machine.createPendingPromise();
+    machine.context().getGlobalObject().set("promise", promise);
+
+    evalCode(machine, R"(
+        promise.then(value => {
+            report(value);
+            exit(0);
+        });
+    )", "test", jac::EvalFlags::Global);
+
+    std::thread worker([pending = std::move(pending)]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        pending.resolve(std::string("done"));
+    });
+
+    machine.runEventLoop();
+    worker.join();
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "done" });
+    REQUIRE(machine.pendingPromiseCount() == 0);
+}
+
+
+TEST_CASE("Reject", "[pendingPromise]") {
+    Machine machine;
+    machine.initialize();
+
+    auto [promise, pending] = machine.createPendingPromise();
+    machine.context().getGlobalObject().set("promise", promise);
+
+    evalCode(machine, R"(
+        promise.catch(err => {
+            report(err instanceof RangeError ? "RangeError" : "other");
+            report(err.message);
+        });
+    )", "test", jac::EvalFlags::Global);
+
+    SECTION("Explicit") {
+        pending.reject("out of range", jac::Exception::Type::RangeError);
+        machine.poll();
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "RangeError", "out of range" });
+    }
+
+    SECTION("Abandoned") {
+        {
+            auto abandoned = std::move(pending);
+        }
+        machine.poll();
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "other", "Pending promise was abandoned" });
+    }
+
+    REQUIRE_FALSE(pending.pending());
+}
+
+
+TEST_CASE("Batched completions", "[pendingPromise]") {
+    constexpr int count = 1000;
+
+    Machine machine;
+    machine.initialize();
+
+    auto promises = jac::Array::create(machine.context());
+    std::vector<Machine::PendingPromise> handles;
+    for (int i = 0; i < count; i++) {
+        auto [promise, pending] = machine.createPendingPromise();
+        promises.set(i, promise);
+        handles.push_back(std::move(pending));
+    }
+    machine.context().getGlobalObject().set("promises", promises);
+
+    evalCode(machine, R"(
+        Promise.all(promises).then(values => {
+            report(String(values.length));
+            report(String(values.reduce((a, b) => a + b, 0)));
+        });
+    )", "test", jac::EvalFlags::Global);
+
+    std::thread worker([&handles]() {
+        for (int i = 0; i < count; i++) {
+            handles[i].resolve(i);
+        }
+    });
+    worker.join();
+
+    // all completions are applied in a single step
+    machine.runOnce(std::chrono::milliseconds(0), 1);
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ std::to_string(count), std::to_string(count * (count - 1) / 2) });
+}
+
+
+TEST_CASE("Handle outlives machine", "[pendingPromise]") {
+    std::optional<Machine::PendingPromise> pending;
+    {
+        Machine machine;
+        machine.initialize();
+
+        auto [promise, handle] = machine.createPendingPromise();
+        pending = std::move(handle);
+    }
+
+    pending->resolve(42);
+    REQUIRE_FALSE(pending->pending());
+}
@@ -0,0 +1,94 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <thread>
+
+#include <jac/features/performanceFeature.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    jac::PerformanceFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>;
+
+
+TEST_CASE("Performance now", "[performance]") {
+    Machine machine;
+    machine.initialize();
+
+    double first = evalCode(machine, "performance.now()", "test", jac::EvalFlags::Global).to<double>();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    double second = evalCode(machine, "performance.now()", "test", jac::EvalFlags::Global).to<double>();
+
+    REQUIRE(first >= 0);
+    REQUIRE(second - first >= 5);
+    REQUIRE(evalCode(machine, "performance.now() != performance.now()", "test", jac::EvalFlags::Global).to<bool>());
+    REQUIRE(evalCode(machine, "performance.timeOrigin > 0", "test", jac::EvalFlags::Global).to<bool>());
+}
+
+
+TEST_CASE("Performance measure", "[performance]") {
+    Machine machine;
+    machine.initialize();
+
+    SECTION("Between marks") {
+        evalCode(machine, R"(
+            performance.mark("start");
+            let until = performance.now() + 2;
+            while (performance.now() < until) {}
+            performance.mark("end");
+            let m = performance.measure("work", "start", "end");
+            report(m.entryType);
+            report(String(m.duration >= 2));
+        )", "test", jac::EvalFlags::Global);
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "measure", "true" });
+
+        auto measures = machine.drainMeasures();
+        REQUIRE(measures.size() == 1);
+        REQUIRE(measures[0].name == "work");
+        REQUIRE(measures[0].duration >= 2);
+        REQUIRE(machine.drainMeasures().empty());
+    }
+
+    SECTION("From mark to now") {
+        evalCode(machine, R"(
+            performance.mark("start");
+            performance.measure("a", "start");
+            performance.measure("b");
+        )", "test", jac::EvalFlags::Global);
+
+        auto measures = machine.drainMeasures();
+        REQUIRE(measures.size() == 2);
+        REQUIRE(measures[0].startTime > 0);
+        REQUIRE(measures[1].startTime == 0);
+    }
+
+    SECTION("Missing mark") {
+        evalCodeThrows(machine, "performance.measure('a', 'missing');", "test", jac::EvalFlags::Global);
+    }
+
+    SECTION("Cleared mark") {
+        evalCode(machine, "performance.mark('start'); performance.clearMarks('start');", "test", jac::EvalFlags::Global);
+        evalCodeThrows(machine, "performance.measure('a', 'start');", "test", jac::EvalFlags::Global);
+    }
+
+    SECTION("Bounded buffer") {
+        machine.setMeasureBufferSize(10);
+        evalCode(machine, R"(
+            for (let i = 0; i < 15; i++) {
+                performance.measure(String(i));
+            }
+        )", "test", jac::EvalFlags::Global);
+
+        auto measures = machine.drainMeasures();
+        REQUIRE(measures.size() == 10);
+        REQUIRE(measures.front().name == "5");
+        REQUIRE(machine.droppedMeasures() == 5);
+    }
+}
@@ -0,0 +1,118 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/features/util/scheduler.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    jac::EventLoopTerminal<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>;
+
+
+TEST_CASE("Scheduler", "[scheduler]") {
+    constexpr int count = 50;
+
+    std::vector<std::unique_ptr<Machine>> machines;
+    for (int i = 0; i < count; i++) {
+        auto machine = std::make_unique<Machine>();
+        machine->initialize();
+        evalCode(*machine, R"(
+            let ticks = 0;
+            let id = setInterval(() => {
+                ticks++;
+                if (ticks == 5) {
+                    clearInterval(id);
+                    Promise.resolve().then(() => {
+                        report("done");
+                        exit(ticks);
+                    });
+                }
+            }, 2);
+        )", "test", jac::EvalFlags::Global);
+        machines.push_back(std::move(machine));
+    }
+
+    std::atomic<int> finished = 0;
+    std::atomic<int> failed = 0;
+    {
+        jac::MachineScheduler scheduler(4);
+        for (auto& machine : machines) {
+            scheduler.add(*machine, [&](std::exception_ptr error) {
+                finished++;
+                if (error) {
+                    failed++;
+                }
+            });
+        }
+        scheduler.waitAll();
+    }
+
+    REQUIRE(finished == count);
+    REQUIRE(failed == 0);
+    for (auto& machine : machines) {
+        REQUIRE(machine->getExitCode() == 5);
+        REQUIRE(machine->getReports() == std::vector<std::string>{ "done" });
+    }
+}
+
+
+TEST_CASE("Scheduler wakeup", "[scheduler]") {
+    Machine machine;
+    machine.initialize();
+
+    jac::MachineScheduler scheduler(2);
+    scheduler.add(machine);
+
+    std::thread producer([&machine]() {
+        for (int i = 0; i < 100; i++) {
+            machine.scheduleEvent([&machine, i]() {
+                machine.report(std::to_string(i));
+                if (i == 99) {
+                    machine.exit(0);
+                }
+            });
+        }
+    });
+
+    scheduler.waitAll();
+    producer.join();
+
+    REQUIRE(machine.getReports().size() == 100);
+    REQUIRE(machine.getReports().back() == "99");
+}
+
+
+TEST_CASE("Machine outlives scheduler", "[scheduler]") {
+    Machine machine;
+    machine.initialize();
+
+    {
+        jac::MachineScheduler scheduler(2);
+        scheduler.add(machine);
+    }
+
+    // the wakeup handler of the destroyed scheduler is not called
+    machine.scheduleEvent([&machine]() {
+        machine.report("later");
+        machine.exit(0);
+    });
+    machine.runEventLoop();
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "later" });
+}
@@ -0,0 +1,628 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/stdioFeature.h>
+#include <jac/features/util/bufferedWritable.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#if __has_include(<unistd.h>)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+#include "util.h"
+
+
+using Machine = jac::ComposeMachine<
+    jac::MachineBase,
+    jac::BasicStreamFeature,
+    jac::StdioFeature
+>;
+
+
+struct Output {
+    std::mutex mutex;
+    std::vector<std::pair<std::string, std::string>> writes;
+
+    std::vector<std::pair<std::string, std::string>> get() {
+        std::scoped_lock lock(mutex);
+        return writes;
+    }
+};
+
+
+class CaptureWritable : public jac::Writable {
+    Output& _output;
+    std::string _name;
+public:
+    CaptureWritable(Output& output, std::string name) : _output(output), _name(std::move(name)) {}
+
+    void write(std::string data) override {
+        std::scoped_lock lock(_output.mutex);
+        _output.writes.emplace_back(_name, std::move(data));
+    }
+
+    void write(std::span<const uint8_t> data) override {
+        std::scoped_lock lock(_output.mutex);
+        _output.writes.emplace_back(_name + " bytes", std::string(data.begin(), data.end()));
+    }
+};
+
+
+class SlowWritable : public jac::Writable {
+public:
+    std::string written;
+    size_t pending = 0;
+    std::vector<std::function<void()>> drainCallbacks;
+    bool fail = false;
+
+    void write(std::string data) override {
+        if (fail) {
+            throw std::runtime_error("write failed");
+        }
+        written += data;
+        pending += data.size();
+    }
+
+    size_t writableLength() override {
+        return pending;
+    }
+
+    void onDrain(std::function<void()> callback) override {
+        if (!needsDrain()) {
+            callback();
+            return;
+        }
+        drainCallbacks.push_back(std::move(callback));
+    }
+
+    void release() {
+        pending = 0;
+        auto callbacks = std::move(drainCallbacks);
+        drainCallbacks.clear();
+        for (auto& callback : callbacks) {
+            callback();
+        }
+    }
+};
+
+
+class ChunkReadable : public jac::Readable {
+public:
+    std::vector<std::vector<uint8_t>> chunks;
+    const uint8_t* lastChunk = nullptr;
+
+protected:
+    bool doRead(std::function<void(std::optional<std::string>)> callback) override {
+        return doReadBytes([&](std::optional<std::vector<uint8_t>> data) {
+            callback(std::string(data->begin(), data->end()));
+        });
+    }
+
+    bool doReadBytes(std::function<void(std::optional<std::vector<uint8_t>>)> callback) override {
+        if (chunks.empty()) {
+            return false;
+        }
+        lastChunk = chunks.front().data();
+        callback(std::move(chunks.front()));
+        chunks.erase(chunks.begin());
+        return true;
+    }
+};
+
+
+TEST_CASE("Buffered writable", "[stdio]") {
+    Output output;
+
+    SECTION("Flush") {
+        jac::BufferedWritable buffered(std::make_unique<CaptureWritable>(output, "out"), 1024, std::chrono::milliseconds(0));
+        buffered.writeLine("a");
+        buffered.write("b");
+        buffered.writeLine("c");
+        REQUIRE(output.get().empty());
+
+        buffered.flush();
+        REQUIRE(output.get() == std::vector<std::pair<std::string, std::string>>{ { "out", "a\nbc\n" } });
+        REQUIRE(buffered.flushes() == 1);
+
+        buffered.flush();
+        REQUIRE(buffered.flushes() == 1);
+    }
+
+    SECTION("Batches by size") {
+        jac::BufferedWritable buffered(std::make_unique<CaptureWritable>(output, "out"), 16, std::chrono::milliseconds(0));
+        std::string expected;
+        for (int i = 0; i < 10; i++) {
+            std::string line = "line " + std::to_string(i);
+            buffered.writeLine(line);
+            expected += line + "\n";
+        }
+        buffered.flush();
+
+        std::string written;
+        for (auto& [_, data] : output.get()) {
+            REQUIRE(data.size() <= 16);
+            written += data;
+        }
+        REQUIRE(written == expected);
+        REQUIRE(buffered.flushes() == 5);
+    }
+
+    SECTION("Large write") {
+        jac::BufferedWritable buffered(std::make_unique<CaptureWritable>(output, "out"), 8, std::chrono::milliseconds(0));
+        buffered.write("abc");
+        buffered.writeLine("0123456789");
+
+        REQUIRE(output.get() == std::vector<std::pair<std::string, std::string>>{ { "out", "abc" }, { "out", "0123456789\n" } });
+    }
+
+    SECTION("Interval flush") {
+        jac::BufferedWritable buffered(std::make_unique<CaptureWritable>(output, "out"), 1024, std::chrono::milliseconds(5));
+        REQUIRE_FALSE(buffered.flushDeadline());
+
+        buffered.writeLine("a");
+        auto deadline = buffered.flushDeadline();
+        REQUIRE(deadline);
+        buffered.flushIfDue();
+        if (std::chrono::steady_clock::now() < *deadline) {
+            REQUIRE(output.get().empty());
+        }
+
+        std::this_thread::sleep_until(*deadline);
+        buffered.flushIfDue();
+        REQUIRE(output.get() == std::vector<std::pair<std::string, std::string>>{ { "out", "a\n" } });
+        REQUIRE_FALSE(buffered.flushDeadline());
+    }
+
+    SECTION("Destruction") {
+        {
+            jac::BufferedWritable buffered(std::make_unique<CaptureWritable>(output, "out"), 1024, std::chrono::milliseconds(0));
+            buffered.writeLine("a");
+        }
+        REQUIRE(output.get() == std::vector<std::pair<std::string, std::string>>{ { "out", "a\n" } });
+    }
+}
+
+
+#if __has_include(<unistd.h>)
+TEST_CASE("Buffered writable to file descriptor", "[stdio]") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    {
+        jac::BufferedWritable buffered(fds[1], 8, std::chrono::milliseconds(0));
+        buffered.writeLine("abc");
+        buffered.writeLine("de");
+        // wraps around the end of the buffer
+        buffered.writeLine("fg");
+    }
+    close(fds[1]);
+
+    std::string result;
+    char data[64];
+    ssize_t size;
+    while ((size = read(fds[0], data, sizeof(data))) > 0) {
+        result.append(data, static_cast<size_t>(size));
+    }
+    close(fds[0]);
+
+    REQUIRE(result == "abc\nde\nfg\n");
+}
+
+
+TEST_CASE("Buffered writable to non-blocking file descriptor", "[stdio]") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    // more than the pipe accepts at once
+    std::string data(512 * 1024, 'x');
+    for (size_t i = 0; i < data.size(); i += 100) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+
+    std::string result;
+    auto readAvailable = [&]() {
+        char chunk[4096];
+        ssize_t size;
+        while ((size = read(fds[0], chunk, sizeof(chunk))) > 0) {
+            result.append(chunk, static_cast<size_t>(size));
+        }
+    };
+
+    {
+        jac::BufferedWritable buffered(fds[1], data.size(), std::chrono::milliseconds(1));
+        buffered.write(data);
+
+        // the data the pipe does not accept stay buffered and are retried
+        while (auto deadline = buffered.flushDeadline()) {
+            std::this_thread::sleep_until(*deadline);
+            buffered.flushIfDue();
+            readAvailable();
+        }
+        REQUIRE(result == data);
+
+        // onDrain does not wait, flushIfDue calls the callback once the data drop below the high-water mark
+        result.clear();
+        buffered.write(data);
+        bool drained = false;
+        buffered.onDrain([&]() {
+            drained = true;
+        });
+        REQUIRE_FALSE(drained);
+        while (auto deadline = buffered.flushDeadline()) {
+            std::this_thread::sleep_until(*deadline);
+            buffered.flushIfDue();
+            readAvailable();
+        }
+        REQUIRE(drained);
+        REQUIRE(result == data);
+
+        // flush waits until the descriptor accepts everything
+        result.clear();
+        buffered.write(data);
+        std::thread reader([&]() {
+            while (result.size() < data.size()) {
+                readAvailable();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+        buffered.flush();
+        reader.join();
+        REQUIRE(result == data);
+    }
+    close(fds[0]);
+    close(fds[1]);
+}
+#endif
+
+
+TEST_CASE("Buffered console", "[stdio]") {
+    Output output;
+
+    Machine machine;
+    machine.stdio.out = std::make_unique<jac::BufferedWritable>(std::make_unique<CaptureWritable>(output, "out"), 1024, std::chrono::milliseconds(0));
+    machine.stdio.err = std::make_unique<CaptureWritable>(output, "err");
+    machine.initialize();
+
+    evalCode(machine, R"(
+        console.log("a");
+        console.info("b");
+        console.error("c");
+        console.log("d");
+    )", "test", jac::EvalFlags::Global);
+
+    REQUIRE(output.get() == std::vector<std::pair<std::string, std::string>>{ { "out", "a\nb\n" }, { "err", "c\n" } });
+
+    machine.stdio.out->flush();
+    REQUIRE(output.get().back() == std::pair<std::string, std::string>{ "out", "d\n" });
+}
+
+
+TEST_CASE("Console formatting", "[stdio]") {
+    Output output;
+
+    Machine machine;
+    machine.stdio.out = std::make_unique<CaptureWritable>(output, "out");
+    machine.stdio.err = std::make_unique<CaptureWritable>(output, "err");
+    machine.initialize();
+
+    auto log = [&](std::string code) {
+        output.writes.clear();
+        evalCode(machine, code, "test", jac::EvalFlags::Global);
+        REQUIRE(output.writes.size() == 1);
+        return output.writes[0].second;
+    };
+
+    SECTION("Primitives") {
+        REQUIRE(log("console.log()") == "\n");
+        REQUIRE(log("console.log('a', 1, 1.5, -0, true, null, undefined)") == "a 1 1.5 -0 true null undefined\n");
+        REQUIRE(log("console.log(NaN, -Infinity, 1e21, 2 ** 40)") == "NaN -Infinity 1e+21 1099511627776\n");
+        REQUIRE(log("console.log(Symbol('s'), 10n)") == "Symbol(s) 10n\n");
+    }
+
+    SECTION("Objects") {
+        REQUIRE(log("console.log({ a: 1, 'b-c': 'x\\'y', d: [1, 'z'] })") == "{ a: 1, 'b-c': 'x\\'y', d: [ 1, 'z' ] }\n");
+        REQUIRE(log("console.log({}, [], [[]])") == "{} [] [ [] ]\n");
+        REQUIRE(log("console.log({ a: { b: { c: { d: 1 } } }, e: [[[[1]]]] })") == "{ a: { b: { c: [Object] } }, e: [ [ [Array] ] ] }\n");
+        REQUIRE(log("let o = { a: 1 }; o.self = o; console.log(o)") == "{ a: 1, self: [Circular] }\n");
+        REQUIRE(log("console.log(new (class Foo { constructor() { this.x = 1; } })())") == "Foo { x: 1 }\n");
+        REQUIRE(log("console.log({ get a() { return 1; }, f() {}, g: () => 1 })") == "{ a: [Getter], f: [Function: f], g: [Function: g] }\n");
+        REQUIRE(log("console.log(new Uint8Array([1, 2]), new ArrayBuffer(3))") == "Uint8Array(2) [ 1, 2 ] ArrayBuffer { byteLength: 3 }\n");
+    }
+
+    SECTION("Limits") {
+        machine.consoleOptions.depth = 0;
+        machine.consoleOptions.maxItems = 2;
+        REQUIRE(log("console.log({ a: { b: 1 } }, [1, 2, 3])") == "{ a: [Object] } [ 1, 2, ... 1 more items ]\n");
+    }
+
+    SECTION("Format string") {
+        REQUIRE(log("console.log('%s=%d (%i%%)', 'x', 42.5, 7.9, 'rest')") == "x=42 (7%) rest\n");
+        REQUIRE(log("console.log('%f %d %o %j', '1.5', {}, 'q', { a: [1] })") == "1.5 NaN 'q' {\"a\":[1]}\n");
+        REQUIRE(log("console.log('%s %s', 1)") == "1 %s\n");
+        REQUIRE(log("console.log('%c%x', 'color: red')") == "%x\n");
+    }
+
+    SECTION("Errors") {
+        REQUIRE(log("console.error(new TypeError('bad'))").starts_with("TypeError: bad\n"));
+        REQUIRE(output.writes[0].first == "err");
+    }
+
+    SECTION("No code runs") {
+        REQUIRE(log(R"(
+            var calls = 0;
+            var proxy = new Proxy({}, {
+                ownKeys() { calls++; return []; },
+                getPrototypeOf() { calls++; return null; }
+            });
+            var array = [1];
+            Object.defineProperty(array, 1, { get() { calls++; return 2; }, enumerable: true });
+            class Foo {}
+            Object.defineProperty(Foo.prototype, "constructor", { get() { calls++; return Foo; } });
+            console.log(proxy, array, new Foo());
+        )") == "[Proxy] [ 1, [Getter] ] {}\n");
+
+        REQUIRE(log(R"(
+            var error = new Error("e");
+            Object.defineProperty(error, "message", { get() { calls++; throw new Error("getter"); } });
+            console.log(error);
+        )").starts_with("Error\n"));
+
+        REQUIRE(log("console.log(calls)") == "0\n");
+    }
+}
+
+
+TEST_CASE("Binary streams", "[stdio]") {
+    using EventLoopMachine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::EventLoopFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::EventLoopTerminal
+    >;
+
+    Output output;
+    auto readable = std::make_unique<ChunkReadable>();
+    ChunkReadable& in = *readable;
+    in.chunks.push_back({ 1, 0, 255 });
+    in.chunks.push_back({ 104, 105 });
+
+    EventLoopMachine machine;
+    machine.stdio.out = std::make_unique<CaptureWritable>(output, "out");
+    machine.stdio.err = std::make_unique<CaptureWritable>(output, "err");
+    machine.stdio.in = std::move(readable);
+    machine.initialize();
+
+    SECTION("Write") {
+        evalCode(machine, R"(
+            import { stdout } from "stdio";
+            stdout.write(new Uint8Array([104, 105, 0, 255]).subarray(1, 3));
+            stdout.write(new Uint8Array([65]).buffer);
+            stdout.write("x");
+        )", "test", jac::EvalFlags::Module);
+
+        REQUIRE(output.get() == std::vector<std::pair<std::string, std::string>>{
+            { "out bytes", std::string("i\0", 2) },
+            { "out bytes", "A" },
+            { "out", "x" }
+        });
+    }
+
+    SECTION("Read") {
+        evalModuleWithEventLoop(machine, R"(
+            import { stdin } from "stdio";
+            stdin.readBytes().then(buffer => {
+                report(buffer instanceof ArrayBuffer);
+                report(Array.from(new Uint8Array(buffer)).join());
+                return stdin.read();
+            }).then(text => {
+                report(text);
+                return stdin.readBytes();
+            }).catch(e => {
+                report(e.message);
+                exit(0);
+            });
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "true", "1,0,255", "hi", "Stream is not readable" });
+    }
+
+    SECTION("Zero-copy ArrayBuffer") {
+        std::vector<uint8_t> data{ 1, 2, 3 };
+        const uint8_t* ptr = data.data();
+        jac::ArrayBuffer buffer = jac::ArrayBuffer::create(machine.context(), std::move(data));
+        REQUIRE(buffer.data() == ptr);
+        REQUIRE(buffer.size() == 3);
+    }
+}
+
+
+TEST_CASE("Buffered reads", "[stdio]") {
+    using EventLoopMachine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::EventLoopFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::EventLoopTerminal
+    >;
+
+    Output output;
+    auto readable = std::make_unique<ChunkReadable>();
+    ChunkReadable& in = *readable;
+    auto addChunk = [&in](std::string chunk) {
+        in.chunks.emplace_back(chunk.begin(), chunk.end());
+    };
+
+    EventLoopMachine machine;
+    machine.stdio.out = std::make_unique<CaptureWritable>(output, "out");
+    machine.stdio.err = std::make_unique<CaptureWritable>(output, "err");
+    machine.stdio.in = std::move(readable);
+    machine.initialize();
+
+    SECTION("Lines") {
+        addChunk("ab\ncd");
+        addChunk("e\r\nf");
+        addChunk("g");
+
+        evalModuleWithEventLoop(machine, R"(
+            import { stdin } from "stdio";
+            (async () => {
+                report(await stdin.readLine());
+                report(await stdin.readLine());
+                report(await stdin.read(1));
+                report(await stdin.readLine());
+                report(String(await stdin.readLine()));
+                await stdin.readLine().catch(e => report(e.message));
+                exit(0);
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "ab", "cde", "f", "g", "null", "Stream is not readable" });
+    }
+
+    SECTION("Read into buffer") {
+        addChunk("hello");
+
+        evalModuleWithEventLoop(machine, R"(
+            import { stdin } from "stdio";
+            (async () => {
+                let buffer = new Uint8Array(5);
+                let count = await stdin.readInto(buffer.subarray(1, 4));
+                report(count);
+                report(Array.from(buffer).join());
+                report(await stdin.read());
+                exit(0);
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "3", "0,104,101,108,0", "lo" });
+    }
+
+    SECTION("Async iterator") {
+        addChunk("a");
+        addChunk("bc");
+        addChunk("d");
+
+        evalModuleWithEventLoop(machine, R"(
+            import { stdin } from "stdio";
+            (async () => {
+                let chunks = [];
+                for await (const chunk of stdin) {
+                    chunks.push(chunk);
+                }
+                report(chunks.join());
+                exit(0);
+            })();
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "a,bc,d" });
+    }
+}
+
+
+TEST_CASE("Pipe", "[stdio]") {
+    ChunkReadable in;
+    for (std::string chunk : { "ab", "cd", "ef" }) {
+        in.chunks.emplace_back(chunk.begin(), chunk.end());
+    }
+    SlowWritable out;
+    out.setHighWaterMark(4);
+
+    std::optional<size_t> result;
+    std::exception_ptr error;
+    auto done = [&](size_t transferred, std::exception_ptr error_) {
+        result = transferred;
+        error = error_;
+    };
+
+    SECTION("Backpressure") {
+        jac::pipeStreams(in, out, done);
+        REQUIRE(out.written == "abcd");
+        REQUIRE(out.drainCallbacks.size() == 1);
+        REQUIRE(!result);
+
+        out.release();
+        REQUIRE(out.written == "abcdef");
+        REQUIRE(result == 6);
+        REQUIRE(!error);
+    }
+
+    SECTION("Error") {
+        out.fail = true;
+        jac::pipeStreams(in, out, done);
+        REQUIRE(result == 0);
+        REQUIRE(error);
+    }
+
+    SECTION("Many chunks") {
+        for (int i = 0; i < 100000; i++) {
+            in.chunks.push_back({ 'x' });
+        }
+        out.setHighWaterMark(std::numeric_limits<size_t>::max());
+        jac::pipeStreams(in, out, done);
+        REQUIRE(result == 100006);
+    }
+}
+
+
+TEST_CASE("Pipe from JavaScript", "[stdio]") {
+    using EventLoopMachine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::EventLoopFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::EventLoopTerminal
+    >;
+
+    auto readable = std::make_unique<ChunkReadable>();
+    for (std::string chunk : { "ab", "cd" }) {
+        readable->chunks.emplace_back(chunk.begin(), chunk.end());
+    }
+    auto writable = std::make_unique<SlowWritable>();
+    SlowWritable& out = *writable;
+
+    EventLoopMachine machine;
+    machine.stdio.out = std::move(writable);
+    machine.stdio.err = std::make_unique<SlowWritable>();
+    machine.stdio.in = std::move(readable);
+    machine.initialize();
+
+    evalModuleWithEventLoop(machine, R"(
+        import { stdin, stdout, stderr } from "stdio";
+        stderr.setHighWaterMark(2);
+        report(stderr.write("a"));
+        report(stderr.write("b"));
+        stdin.pipe(stdout).then(count => {
+            report(count);
+            exit(0);
+        });
+    )", "test");
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "true", "false", "4" });
+    REQUIRE(out.written == "abcd");
+}
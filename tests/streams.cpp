@@ -0,0 +1,349 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <jac/features/basicStreamFeature.h>
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/stdioFeature.h>
+#include <jac/features/util/streamTransforms.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+class ChunkReadable : public jac::Readable {
+public:
+    std::deque<std::string> chunks;
+
+    bool ended = false;
+
+    ChunkReadable(std::vector<std::string> chunks_) : chunks(chunks_.begin(), chunks_.end()) {}
+
+protected:
+    bool doRead(std::function<void(std::optional<std::string>)> callback) override {
+        if (chunks.empty()) {
+            if (ended) {
+                return false;
+            }
+            ended = true;
+            callback(std::nullopt);
+            return true;
+        }
+        std::string chunk = std::move(chunks.front());
+        chunks.pop_front();
+        callback(std::move(chunk));
+        return true;
+    }
+};
+
+
+class StringWritable : public jac::Writable {
+public:
+    std::vector<std::string> writes;
+
+    void write(std::string data) override {
+        writes.push_back(std::move(data));
+    }
+};
+
+
+std::vector<std::string> readAll(jac::Readable& readable) {
+    std::vector<std::string> result;
+    bool ended = false;
+    while (!ended && readable.read([&](std::optional<std::string> data) {
+        if (data) {
+            result.push_back(std::move(*data));
+        }
+        else {
+            ended = true;
+        }
+    })) {}
+    return result;
+}
+
+
+TEST_CASE("Readable lines", "[streams]") {
+    SECTION("Blank line is not the end") {
+        ChunkReadable source({ "a\n\nb", "\nc" });
+        std::vector<std::optional<std::string>> lines;
+        for (int i = 0; i < 5; i++) {
+            REQUIRE(source.readLine([&](std::optional<std::string> line) { lines.push_back(std::move(line)); }));
+        }
+        REQUIRE(lines == std::vector<std::optional<std::string>>{ "a", "", "b", "c", std::nullopt });
+    }
+
+    SECTION("Reads after a line return the rest of the chunk") {
+        ChunkReadable source({ "head\r\nbody", "tail" });
+        std::optional<std::string> line;
+        REQUIRE(source.readLine([&](std::optional<std::string> line_) { line = std::move(line_); }));
+        REQUIRE(line == "head");
+
+        std::optional<std::vector<uint8_t>> bytes;
+        REQUIRE(source.readBytes([&](std::optional<std::vector<uint8_t>> bytes_) { bytes = std::move(bytes_); }));
+        REQUIRE(bytes == std::vector<uint8_t>{ 'b', 'o', 'd', 'y' });
+
+        std::optional<char> c;
+        REQUIRE(source.get([&](std::optional<char> c_) { c = c_; }));
+        REQUIRE(c == 't');
+        REQUIRE(readAll(source) == std::vector<std::string>{ "ail" });
+    }
+
+    SECTION("Get at the end") {
+        ChunkReadable source({ "", "a" });
+        std::vector<std::optional<char>> chars;
+        for (int i = 0; i < 2; i++) {
+            REQUIRE(source.get([&](std::optional<char> c) { chars.push_back(c); }));
+        }
+        REQUIRE(chars == std::vector<std::optional<char>>{ 'a', std::nullopt });
+    }
+}
+
+
+TEST_CASE("UTF-8 decoding", "[streams]") {
+    auto decode = [](std::string data, bool final) {
+        std::string out;
+        size_t consumed = jac::decodeUtf8(data, out, final);
+        return std::make_pair(consumed, out);
+    };
+
+    SECTION("ASCII prefix") {
+        std::string data(100, 'a');
+        REQUIRE(jac::asciiPrefix(data.data(), data.size()) == 100);
+        data[37] = '\xC3';
+        REQUIRE(jac::asciiPrefix(data.data(), data.size()) == 37);
+        data[3] = '\x80';
+        REQUIRE(jac::asciiPrefix(data.data(), data.size()) == 3);
+    }
+
+    SECTION("Valid") {
+        std::string data = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80z";
+        REQUIRE(decode(data, false) == std::make_pair(data.size(), data));
+    }
+
+    SECTION("Invalid") {
+        REQUIRE(decode("a\xFF" "b", true).second == "a\xEF\xBF\xBD" "b");
+        REQUIRE(decode("\xED\xA0\x80", true).second == "\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD");
+        REQUIRE(decode("\xE2\x82" "a", true).second == "\xEF\xBF\xBD" "a");
+    }
+
+    SECTION("Incomplete") {
+        REQUIRE(decode("ab\xE2\x82", false) == std::make_pair(size_t(2), std::string("ab")));
+        REQUIRE(decode("ab\xE2\x82", true) == std::make_pair(size_t(4), std::string("ab\xEF\xBF\xBD")));
+    }
+}
+
+
+TEST_CASE("Stream transforms", "[streams]") {
+    SECTION("Lines") {
+        ChunkReadable source({ "ab\ncd", "e\r\n\nf", "g" });
+        jac::LineSplitter lines(source);
+        REQUIRE(readAll(lines) == std::vector<std::string>{ "ab", "cde", "", "fg" });
+    }
+
+    SECTION("Terminated last line") {
+        ChunkReadable source({ "a\n", "\n" });
+        jac::LineSplitter lines(source);
+        REQUIRE(readAll(lines) == std::vector<std::string>{ "a", "" });
+        REQUIRE(!lines.error());
+    }
+
+    SECTION("Line too long") {
+        ChunkReadable source({ "ab\n", "abcd\r", "\n", "cdef", "gh\n" });
+        jac::LineSplitter lines(source, 4);
+        REQUIRE(readAll(lines) == std::vector<std::string>{ "ab", "abcd" });
+        REQUIRE_THROWS_WITH(std::rethrow_exception(lines.error()), "Line length exceeds the limit of 4");
+    }
+
+    SECTION("Long line in many chunks") {
+        std::vector<std::string> chunks(100000, "x");
+        chunks.push_back("\n");
+        ChunkReadable source(std::move(chunks));
+        jac::LineSplitter lines(source);
+        REQUIRE(readAll(lines) == std::vector<std::string>{ std::string(100000, 'x') });
+    }
+
+    SECTION("Pipe keeps blank lines") {
+        ChunkReadable source({ "a\n\nb\n" });
+        jac::LineSplitter lines(source);
+        StringWritable sink;
+        size_t transferred = 0;
+        jac::pipeStreams(lines, sink, [&](size_t transferred_, std::exception_ptr error) {
+            REQUIRE(!error);
+            transferred = transferred_;
+        });
+        REQUIRE(sink.writes == std::vector<std::string>{ "a", "", "b" });
+        REQUIRE(transferred == 2);
+    }
+
+    SECTION("Pipe reports the error of the stream") {
+        ChunkReadable source({ std::string("\0\1a\xFF\xFF", 5) });
+        jac::FrameDecoder frames(source, 2, 16);
+        StringWritable sink;
+        std::exception_ptr error;
+        jac::pipeStreams(frames, sink, [&](size_t, std::exception_ptr error_) {
+            error = error_;
+        });
+        REQUIRE(sink.writes == std::vector<std::string>{ "a" });
+        REQUIRE(error);
+    }
+
+    SECTION("Frames") {
+        ChunkReadable source({ std::string("\0\0\0\3ab", 6), std::string("c\0\0\0\0\0\0", 7), std::string("\0\1x\0\0\0\5y", 8) });
+        jac::FrameDecoder frames(source);
+        // the last frame is incomplete
+        REQUIRE(readAll(frames) == std::vector<std::string>{ "abc", "", "x" });
+    }
+
+    SECTION("Frame too large") {
+        ChunkReadable source({ "\xFF\xFF\xFF\xFF" });
+        jac::FrameDecoder frames(source, 4, 1024);
+        REQUIRE(readAll(frames).empty());
+        REQUIRE_THROWS_WITH(std::rethrow_exception(frames.error()), "Frame size 4294967295 exceeds the limit");
+        REQUIRE(!frames.read([](std::optional<std::string>) {}));
+    }
+
+    SECTION("Frame encoder") {
+        StringWritable sink;
+        jac::FrameEncoder encoder(sink, 2);
+        encoder.write("abc");
+        encoder.write(std::string(300, 'x'));
+        REQUIRE(sink.writes[0] == std::string("\0\3abc", 5));
+        REQUIRE(sink.writes[1].substr(0, 2) == "\x01\x2C");
+        REQUIRE(sink.writes[1].size() == 302);
+
+        jac::FrameEncoder small(sink, 1);
+        REQUIRE_THROWS(small.write(std::string(256, 'x')));
+    }
+
+    SECTION("Round trip") {
+        StringWritable sink;
+        jac::FrameEncoder encoder(sink, 4);
+        encoder.write("first");
+        encoder.write("second");
+
+        std::string encoded = sink.writes[0] + sink.writes[1];
+        std::vector<std::string> chunks;
+        for (char c : encoded) {
+            chunks.emplace_back(1, c);
+        }
+        ChunkReadable source(chunks);
+        jac::FrameDecoder frames(source);
+        REQUIRE(readAll(frames) == std::vector<std::string>{ "first", "second" });
+    }
+
+    SECTION("UTF-8 across chunks") {
+        ChunkReadable source({ "a\xE2", "\x82", "\xAC" "b\xF0\x9F", "\x98" });
+        jac::Utf8Decoder utf8(source);
+        REQUIRE(readAll(utf8) == std::vector<std::string>{ "a", "\xE2\x82\xAC" "b", "\xEF\xBF\xBD" });
+    }
+}
+
+
+TEST_CASE("Stream transforms from JavaScript", "[streams]") {
+    using Machine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::EventLoopFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::EventLoopTerminal
+    >;
+
+    auto out = std::make_unique<StringWritable>();
+    StringWritable& out_ = *out;
+
+    Machine machine;
+    machine.stdio.out = std::move(out);
+    machine.stdio.err = std::make_unique<StringWritable>();
+    machine.stdio.in = std::make_unique<ChunkReadable>(std::vector<std::string>{ "one\ntw", "o\nthree" });
+    machine.initialize();
+
+    evalModuleWithEventLoop(machine, R"(
+        import { stdin, stdout } from "stdio";
+        import { lines, utf8, framed } from "streams";
+        (async () => {
+            let framedOut = framed(stdout, 1);
+            for await (const line of lines(utf8(stdin))) {
+                report(line);
+                framedOut.write(line);
+            }
+            exit(0);
+        })();
+    )", "test");
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "one", "two", "three" });
+    REQUIRE(out_.writes == std::vector<std::string>{ "\3one", "\3two", "\5three" });
+}
+
+
+TEST_CASE("Stream transform errors from JavaScript", "[streams]") {
+    using Machine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::EventLoopFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::EventLoopTerminal
+    >;
+
+    Machine machine;
+    machine.stdio.out = std::make_unique<StringWritable>();
+    machine.stdio.err = std::make_unique<StringWritable>();
+    machine.stdio.in = std::make_unique<ChunkReadable>(std::vector<std::string>{ std::string("\0\0\0\0\xFF\xFF\xFF\xFF", 8) });
+    machine.initialize();
+
+    evalModuleWithEventLoop(machine, R"(
+        import { stdin } from "stdio";
+        import { frames } from "streams";
+        (async () => {
+            let input = frames(stdin);
+            report(JSON.stringify(await input.read()));
+            await input.read().catch(e => report(e.message));
+            exit(0);
+        })();
+    )", "test");
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "\"\"", "Frame size 4294967295 exceeds the limit" });
+}
+
+
+TEST_CASE("Reading characters from JavaScript", "[streams]") {
+    using Machine = jac::ComposeMachine<
+        jac::MachineBase,
+        TestReportFeature,
+        jac::EventQueueFeature,
+        jac::EventLoopFeature,
+        jac::BasicStreamFeature,
+        jac::StdioFeature,
+        jac::EventLoopTerminal
+    >;
+
+    Machine machine;
+    machine.stdio.out = std::make_unique<StringWritable>();
+    machine.stdio.err = std::make_unique<StringWritable>();
+    machine.stdio.in = std::make_unique<ChunkReadable>(std::vector<std::string>{ "a", "", "b" });
+    machine.initialize();
+
+    evalModuleWithEventLoop(machine, R"(
+        import { stdin } from "stdio";
+        (async () => {
+            for (let i = 0; i < 3; i++) {
+                report(String(await stdin.get()));
+            }
+            exit(0);
+        })();
+    )", "test");
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "a", "b", "null" });
+}
@@ -0,0 +1,218 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <string>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    jac::EventLoopTerminal<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>;
+
+
+TEST_CASE("Timeout order", "[timers]") {
+    Machine machine;
+    machine.initialize();
+
+    evalModuleWithEventLoop(machine, R"(
+        setTimeout(() => report("30"), 30);
+        setTimeout(() => report("10"), 10);
+        setTimeout(() => { report("50"); exit(0); }, 50);
+        let id = setTimeout(() => report("cancelled"), 20);
+        clearTimeout(id);
+    )", "test");
+
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "10", "30", "50" });
+}
+
+
+TEST_CASE("Interval mode", "[timers]") {
+    Machine machine;
+
+    SECTION("Fixed rate does not drift") {
+        machine.setIntervalMode(jac::IntervalMode::FixedRate);
+        machine.initialize();
+
+        // each tick busy-waits 4 ms, with fixed delay 20 ticks would take at least 280 ms
+        evalModuleWithEventLoop(machine, R"(
+            let count = 0;
+            let start = Date.now();
+            let id = setInterval(() => {
+                count++;
+                let until = Date.now() + 4;
+                while (Date.now() < until) {}
+                if (count == 20) {
+                    clearInterval(id);
+                    report(String(Date.now() - start < 270));
+                    exit(0);
+                }
+            }, 10);
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "true" });
+    }
+
+    SECTION("Fixed rate skips missed periods") {
+        machine.setIntervalMode(jac::IntervalMode::FixedRateSkip);
+        machine.initialize();
+
+        // the first tick stalls for 3.5 periods, the missed ones are not fired
+        evalModuleWithEventLoop(machine, R"(
+            let ticks = [];
+            let id = setInterval(() => {
+                ticks.push(Date.now());
+                if (ticks.length == 1) {
+                    let until = Date.now() + 35;
+                    while (Date.now() < until) {}
+                }
+                if (ticks.length == 3) {
+                    clearInterval(id);
+                    report(String(ticks[2] - ticks[1] >= 5));
+                    exit(0);
+                }
+            }, 10);
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "true" });
+    }
+}
+
+
+TEST_CASE("Timer coalescing", "[timers]") {
+    Machine machine;
+
+    SECTION("Disabled") {
+        machine.initialize();
+
+        evalModuleWithEventLoop(machine, R"(
+            setTimeout(() => { report("a"); Promise.resolve().then(() => report("job")); }, 1);
+            setTimeout(() => report("b"), 10);
+            setTimeout(() => report("c"), 20);
+            setTimeout(() => exit(0), 100);
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "a", "job", "b", "c" });
+    }
+
+    SECTION("Enabled") {
+        machine.setTimerCoalescing(std::chrono::milliseconds(50));
+        machine.initialize();
+
+        // the timers are dispatched in a single wakeup, jobs still run between them
+        evalModuleWithEventLoop(machine, R"(
+            setTimeout(() => { report("a"); Promise.resolve().then(() => report("job")); }, 1);
+            setTimeout(() => report("b"), 10);
+            setTimeout(() => report("c"), 20);
+            setTimeout(() => exit(0), 100);
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "a", "job", "b", "c" });
+    }
+
+    SECTION("Timers are delayed, not fired early") {
+        machine.setTimerCoalescing(std::chrono::milliseconds(200));
+        machine.initialize();
+
+        evalModuleWithEventLoop(machine, R"(
+            let start = Date.now();
+            setTimeout(() => report(String(Date.now() - start >= 90)), 1);
+            setTimeout(() => report(String(Date.now() - start >= 100)), 100);
+            setTimeout(() => exit(0), 400);
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "true", "true" });
+    }
+}
+
+
+TEST_CASE("Throwing timer", "[timers]") {
+    Machine machine;
+    machine.initialize();
+
+    evalCode(machine, R"(
+        let ticks = 0;
+        setTimeout(() => { throw new Error("first"); }, 5);
+        setTimeout(() => report("second"), 5);
+        let id = setInterval(() => {
+            if (++ticks === 1) {
+                throw new Error("tick");
+            }
+            if (ticks === 3) {
+                clearInterval(id);
+                report("interval");
+                exit(0);
+            }
+        }, 5);
+    )", "test", jac::EvalFlags::Global);
+
+    int errors = 0;
+    while (!machine.hasExited()) {
+        try {
+            machine.runOnce(std::chrono::milliseconds(100));
+        }
+        catch (jac::Exception&) {
+            errors++;
+        }
+    }
+
+    REQUIRE(errors == 2);
+    REQUIRE(machine.getReports() == std::vector<std::string>{ "second", "interval" });
+}
+
+
+TEST_CASE("Immediate and microtask", "[timers]") {
+    Machine machine;
+    machine.initialize();
+
+    SECTION("Order") {
+        evalModuleWithEventLoop(machine, R"(
+            report("start");
+            setTimeout(() => report("timeout"), 0);
+            setImmediate(() => report("immediate"));
+            queueMicrotask(() => report("microtask"));
+            Promise.resolve().then(() => report("promise"));
+            let id = setImmediate(() => report("cleared"));
+            clearImmediate(id);
+            setTimeout(() => exit(0), 20);
+            report("end");
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{
+            "start", "end", "microtask", "promise", "immediate", "timeout"
+        });
+    }
+
+    SECTION("Yield loop") {
+        evalModuleWithEventLoop(machine, R"(
+            let count = 0;
+            function chunk() {
+                if (++count < 1000) {
+                    setImmediate(chunk);
+                }
+                else {
+                    report(String(count));
+                    exit(0);
+                }
+            }
+            setImmediate(chunk);
+        )", "test");
+
+        REQUIRE(machine.getReports() == std::vector<std::string>{ "1000" });
+    }
+
+    SECTION("Invalid microtask") {
+        evalCodeThrows(machine, "queueMicrotask(1);", "test", jac::EvalFlags::Global);
+    }
+}
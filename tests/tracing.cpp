@@ -0,0 +1,118 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <jac/features/eventLoopFeature.h>
+#include <jac/features/eventQueueFeature.h>
+#include <jac/features/timersFeature.h>
+#include <jac/machine/functionFactory.h>
+#include <jac/machine/machine.h>
+#include <jac/machine/tracer.h>
+#include <jac/machine/values.h>
+
+#include "util.h"
+
+
+using Machine =
+    jac::EventLoopTerminal<
+    jac::TimersFeature<
+    jac::EventLoopFeature<
+    jac::EventQueueFeature<
+    TestReportFeature<
+    jac::MachineBase
+>>>>>;
+
+
+static size_t count(const std::string& str, const std::string& sub) {
+    size_t result = 0;
+    for (size_t pos = str.find(sub); pos != std::string::npos; pos = str.find(sub, pos + 1)) {
+        result++;
+    }
+    return result;
+}
+
+
+TEST_CASE("Machine trace", "[tracing]") {
+    jac::Tracer tracer;
+
+    Machine machine;
+    machine.setTracer(&tracer);
+    machine.initialize();
+
+    jac::FunctionFactory ff(machine.context());
+    machine.context().getGlobalObject().set("native", ff.newFunction([](int a) {
+        return a + 1;
+    }));
+
+    evalModuleWithEventLoop(machine, R"(
+        native(1);
+        Promise.resolve().then(() => native(2));
+        setTimeout(() => exit(0), 1);
+    )", "traced.js");
+    machine.runGC();
+    machine.setTracer(nullptr);
+
+    auto trace = tracer.toChromeTrace();
+
+    REQUIRE(trace.starts_with("{\"traceEvents\":["));
+    REQUIRE(count(trace, "\"ph\":\"X\"") == tracer.recorded());
+    REQUIRE(count(trace, "\"name\":\"traced.js\",\"cat\":\"eval\"") == 1);
+    REQUIRE(count(trace, "\"cat\":\"native\"") >= 2);
+    REQUIRE(count(trace, "\"name\":\"tracing.cpp:") == 2);
+    REQUIRE(count(trace, "\"cat\":\"jobs\"") >= 1);
+    REQUIRE(count(trace, "\"cat\":\"event\"") >= 1);
+    REQUIRE(count(trace, "\"name\":\"timeout\",\"cat\":\"timer\"") == 1);
+    REQUIRE(count(trace, "\"cat\":\"gc\"") == 1);
+}
+
+
+TEST_CASE("Trace ring buffer", "[tracing]") {
+    jac::Tracer tracer(4);
+
+    SECTION("Overwrite") {
+        auto now = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10; i++) {
+            tracer.record("test", "span" + std::to_string(i), now, now);
+        }
+        auto trace = tracer.toChromeTrace();
+
+        REQUIRE(tracer.recorded() == 10);
+        REQUIRE(count(trace, "\"ph\":\"X\"") == 4);
+        REQUIRE(count(trace, "span5") == 0);
+        REQUIRE(count(trace, "span6") == 1);
+        REQUIRE(count(trace, "span9") == 1);
+    }
+
+    SECTION("Long name and escaping") {
+        auto now = std::chrono::steady_clock::now();
+        tracer.record("test", std::string(100, 'a') + "\"", now, now);
+        tracer.record("test", "quote\"", now, now);
+        auto trace = tracer.toChromeTrace();
+
+        REQUIRE(count(trace, std::string(jac::Tracer::maxNameLength, 'a') + "\"") == 1);
+        REQUIRE(count(trace, "quote\\\"") == 1);
+    }
+
+    SECTION("Concurrent") {
+        std::atomic<bool> stop = false;
+        std::vector<std::thread> writers;
+        for (int i = 0; i < 4; i++) {
+            writers.emplace_back([&tracer, &stop]() {
+                while (!stop) {
+                    jac::TraceSpan span(&tracer, "test", "concurrent");
+                }
+            });
+        }
+        for (int i = 0; i < 100; i++) {
+            auto trace = tracer.toChromeTrace();
+            REQUIRE(count(trace, "\"ph\":\"X\"") <= 4);
+        }
+        stop = true;
+        for (auto& writer : writers) {
+            writer.join();
+        }
+    }
+}